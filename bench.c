@@ -0,0 +1,1857 @@
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "defs.h"
+
+/* Benchmarks for the entry manager. Build without loader.o:
+       gcc -O2 -Wall bench.c manager.c wal.c snapshot.c csv.c -o bench
+   Run all benchmarks with ./bench, or one of them with ./bench <name>. */
+
+#define BENCH_ROOMS  16
+
+static double now_seconds(void);
+static int setup_rooms(RoomCollection *rc);
+static void bench_insert(void);
+static int legacy_entry_cmp(const LogEntry *a, const LogEntry *b);
+static int qsort_legacy_cmp(const void *a, const void *b);
+static int qsort_key_cmp(const void *a, const void *b);
+static void shuffle_copy(LogEntry **dst, LogEntry *const *src, int count);
+static void bench_cmp(void);
+static int fill_sorted(RoomCollection *rc, EntryCollection *ec, int count);
+static void make_burst(SensorReading *burst, int count, int max_timestamp);
+static void bench_batch(void);
+static void bench_append(void);
+static void bench_scan(void);
+static int count_reading(const Room *room, int type, int timestamp, ReadingValue value, void *ctx);
+static void bench_range(void);
+static int count_bucket(const Room *room, int type, const Aggregate *bucket, void *ctx);
+static void bench_agg(void);
+static double ingest_stream(RoomCollection *rc, EntryCollection *ec, int count);
+static void bench_rolling(void);
+static double wal_stream(WriteAheadLog *wal, int group_records, int count);
+static void bench_wal(void);
+static void bench_snapshot(void);
+static int write_csv(const char *path, int count);
+static int scanf_import(const char *path, RoomCollection *rc, EntryCollection *ec);
+static void bench_csv(void);
+static double export_with_buffer(const EntryCollection *ec, int mode);
+static void bench_script(void);
+static void bench_print(void);
+static int count_motion(const Room *room, int type, int timestamp, ReadingValue value, void *ctx);
+static void bench_motion(void);
+static void bench_footprint(void);
+static void fill_sensors(RoomCollection *rc, EntryCollection *ec, int per_series);
+static size_t sealed_bytes(const EntryCollection *ec, int type);
+static double time_queries(const RoomCollection *rc, int per_series, int queries, long *found);
+static double time_aggregates(const RoomCollection *rc, int per_series, long *readings);
+static void bench_compress(void);
+static double shift_survivors(const EntryCollection *ec, int cut, void *scratch);
+static void bench_retention(void);
+static double replay_stream(RoomCollection *rc, EntryCollection *ec, int late_percent,
+                            int settle, long *found);
+static void bench_lsm(void);
+static void bench_validate(void);
+static void bench_profile(void);
+static void bench_latency(void);
+
+int main(int argc, char *argv[]) {
+    // Benchmark selected on the command line, NULL runs all of them
+    const char *which = (argc > 1) ? argv[1] : NULL;
+
+    if (which == NULL || strcmp(which, "insert") == 0) {
+        bench_insert();
+    }
+    if (which == NULL || strcmp(which, "cmp") == 0) {
+        bench_cmp();
+    }
+    if (which == NULL || strcmp(which, "batch") == 0) {
+        bench_batch();
+    }
+    if (which == NULL || strcmp(which, "append") == 0) {
+        bench_append();
+    }
+    if (which == NULL || strcmp(which, "scan") == 0) {
+        bench_scan();
+    }
+    if (which == NULL || strcmp(which, "range") == 0) {
+        bench_range();
+    }
+    if (which == NULL || strcmp(which, "agg") == 0) {
+        bench_agg();
+    }
+    if (which == NULL || strcmp(which, "rolling") == 0) {
+        bench_rolling();
+    }
+    if (which == NULL || strcmp(which, "wal") == 0) {
+        bench_wal();
+    }
+    if (which == NULL || strcmp(which, "snapshot") == 0) {
+        bench_snapshot();
+    }
+    if (which == NULL || strcmp(which, "csv") == 0) {
+        bench_csv();
+    }
+    if (which == NULL || strcmp(which, "script") == 0) {
+        bench_script();
+    }
+    if (which == NULL || strcmp(which, "print") == 0) {
+        bench_print();
+    }
+    if (which == NULL || strcmp(which, "motion") == 0) {
+        bench_motion();
+    }
+    if (which == NULL || strcmp(which, "footprint") == 0) {
+        bench_footprint();
+    }
+    if (which == NULL || strcmp(which, "compress") == 0) {
+        bench_compress();
+    }
+    if (which == NULL || strcmp(which, "retention") == 0) {
+        bench_retention();
+    }
+    if (which == NULL || strcmp(which, "lsm") == 0) {
+        bench_lsm();
+    }
+    if (which == NULL || strcmp(which, "validate") == 0) {
+        bench_validate();
+    }
+    if (which == NULL || strcmp(which, "profile") == 0) {
+        bench_profile();
+    }
+    if (which == NULL || strcmp(which, "latency") == 0) {
+        bench_latency();
+    }
+
+    return 0;
+}
+
+/* ---- now_seconds -----------------------------------------------------------
+   Purpose: Read a monotonic clock for timing.
+   Returns: seconds as a double
+----------------------------------------------------------------------------- */
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* ---- setup_rooms -----------------------------------------------------------
+   Purpose: Add BENCH_ROOMS rooms named "room-00" .. "room-15" (already in
+            sorted name order).
+   Params:
+     - rc (out): empty room collection to fill
+   Returns: C_ERR_OK or the first rooms_add error
+----------------------------------------------------------------------------- */
+static int setup_rooms(RoomCollection *rc) {
+    // Loop counter and rooms_add result
+    int i;
+    int result;
+    char name[MAX_STR];
+
+    for (i = 0; i < BENCH_ROOMS; i++) {
+        snprintf(name, sizeof(name), "room-%02d", i);
+        result = rooms_add(rc, name);
+        if (result != C_ERR_OK) {
+            return result;
+        }
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- bench_insert ----------------------------------------------------------
+   Purpose: Report the cost of out-of-order entries_create calls at 10^3,
+            10^5 and 10^7 entries. Each collection is pre-filled in sorted
+            order, then a sample of inserts older than the newest reading of
+            their series is measured. Those all go into the series'
+            late-reading B+tree, so the search no longer depends on n: it
+            descends a tree of the late readings of one series (k), one
+            node per level. The sample grows with n so the trees get
+            deeper, and the report shows their depth and the comparisons
+            per insert against log2(k) and log2(n). The merge into the
+            columns is timed separately, once for the whole sample.
+----------------------------------------------------------------------------- */
+static void bench_insert(void) {
+    // Collection sizes to measure and the number of late inserts at each:
+    // about 10, 100 and 800 per series, so no tree fills up and spills
+    const int sizes[]   = { 1000, 100000, 10000000 };
+    const int samples[] = { 480, 4800, 40000 };
+    // Loop counters
+    int s, i, t, r;
+    // Entries per (room, type) series after pre-filling
+    int per_series;
+    // Largest tree depth (levels, leaves included) and mean tree size
+    int depth, trees;
+    long late;
+    unsigned long before;
+    double start, elapsed, merged;
+    ReadingValue value;
+
+    printf("\n== insert: late entries_create into the per-series B+trees ==\n");
+    printf("%10s %8s %8s %6s %11s %8s %8s %12s %11s\n", "entries", "inserts", "k/tree",
+           "depth", "cmp/insert", "log2(k)", "log2(n)", "usec/insert", "merge usec");
+
+    srand(1);
+    for (s = 0; s < 3; s++) {
+        RoomCollection  rooms   = { .size = 0 };
+        EntryCollection entries = { .size = 0 };
+
+        if (fill_sorted(&rooms, &entries, sizes[s]) != C_ERR_OK) {
+            printf("pre-fill failed at %d entries\n", entries.size);
+            return;
+        }
+        per_series = sizes[s] / (BENCH_ROOMS * 3);
+        value.decibels = 40;
+
+        // Odd timestamps fall between the pre-filled ones, before the newest
+        before = entries.comparisons;
+        start = now_seconds();
+        for (i = 0; i < samples[s]; i++) {
+            r = rand() % BENCH_ROOMS;
+            t = TYPE_TEMP + rand() % 3;
+            entries_create(&entries, rooms.rooms[r], t, value,
+                           (rand() % ((per_series - 1) * 10)) | 1);
+        }
+        elapsed = now_seconds() - start;
+
+        depth = 0;
+        trees = 0;
+        late = 0;
+        for (i = 0; i < entries.num_series; i++) {
+            if (entries.series[i]->late.count > 0) {
+                trees++;
+                late += entries.series[i]->late.count;
+                if (entries.series[i]->late.height + 1 > depth) {
+                    depth = entries.series[i]->late.height + 1;
+                }
+            }
+        }
+        late = (trees > 0) ? late / trees : 0;
+
+        start = now_seconds();
+        for (i = 0; i < entries.num_series; i++) {
+            series_settle(entries.series[i]);
+        }
+        merged = now_seconds() - start;
+
+        printf("%10d %8d %8ld %6d %11.1f %8d %8d %12.2f %11.1f\n", entries.size - samples[s],
+               samples[s], late, depth,
+               (double)(entries.comparisons - before) / samples[s],
+               (late > 0) ? 31 - __builtin_clz((unsigned)late) : 0,
+               31 - __builtin_clz((unsigned)entries.size),
+               elapsed * 1e6 / samples[s], merged * 1e6);
+
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+    }
+}
+
+/* The LogEntry layout before it was packed: 24 bytes on LP64, 32 once it
+   carried the 8-byte sort key */
+typedef struct {
+    Reading  data;
+    Room    *room;
+    int      timestamp;
+} PointerLogEntry;
+
+typedef struct {
+    Reading  data;
+    Room    *room;
+    int      timestamp;
+    unsigned long long key;
+} KeyedLogEntry;
+
+/* Rooms the legacy comparator looks names up in (qsort passes no context) */
+static const RoomCollection *legacy_rooms;
+
+/* ---- legacy_entry_cmp ------------------------------------------------------
+   Purpose: The comparator entry_cmp used before packed keys: room name,
+            then type, then timestamp, following the room each time.
+   Returns <0 if a<b, >0 if a>b, 0 if equal.
+----------------------------------------------------------------------------- */
+static int legacy_entry_cmp(const LogEntry *a, const LogEntry *b) {
+    int room_cmp = strncmp(entry_room(legacy_rooms, a)->name, entry_room(legacy_rooms, b)->name,
+                           MAX_STR);
+
+    if (room_cmp != 0) {
+        return room_cmp;
+    }
+    if (a->type != b->type) {
+        return (a->type < b->type) ? -1 : 1;
+    }
+    if (a->timestamp != b->timestamp) {
+        return (a->timestamp < b->timestamp) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* qsort adapters over arrays of LogEntry pointers */
+static int qsort_legacy_cmp(const void *a, const void *b) {
+    return legacy_entry_cmp(*(LogEntry *const *)a, *(LogEntry *const *)b);
+}
+
+static int qsort_key_cmp(const void *a, const void *b) {
+    unsigned long long ka = ENTRY_KEY_OF(*(LogEntry *const *)a);
+    unsigned long long kb = ENTRY_KEY_OF(*(LogEntry *const *)b);
+
+    return (ka > kb) - (ka < kb);
+}
+
+/* ---- shuffle_copy ----------------------------------------------------------
+   Purpose: Copy an array of entry pointers and shuffle the copy with a fixed
+            seed, so every run sees the same permutation.
+   Params:
+     - dst (out): destination array of count pointers
+     - src (in): source array
+     - count (in): number of pointers
+----------------------------------------------------------------------------- */
+static void shuffle_copy(LogEntry **dst, LogEntry *const *src, int count) {
+    int i, j;
+    LogEntry *tmp;
+
+    memcpy(dst, src, (size_t)count * sizeof(LogEntry *));
+    srand(2);
+    for (i = count - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = dst[i];
+        dst[i] = dst[j];
+        dst[j] = tmp;
+    }
+}
+
+/* ---- bench_cmp -------------------------------------------------------------
+   Purpose: Compare the packed-key path against the old name/type/timestamp
+            comparator on the same data: sorting a shuffled array of entry
+            pointers with qsort, and running one binary search per entry.
+            Room names share a long prefix, as real building names do.
+----------------------------------------------------------------------------- */
+static void bench_cmp(void) {
+    // Number of rooms and entries in the data set
+    const int num_rooms = 1000;
+    const int count = 2000000;
+    const int stride = count / ENTRY_CHUNK_SIZE;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    EntryCursor cursor;
+    LogEntry **sorted, **shuffled;
+    char name[MAX_STR];
+    ReadingValue value;
+    // Loop counters and binary search bounds
+    int i, low, high, mid;
+    long found;
+    double start, t_legacy_sort, t_key_sort, t_legacy_search, t_key_search;
+
+    printf("\n== cmp: packed key vs. legacy entry compare (%d entries, %d rooms) ==\n",
+           count, num_rooms);
+
+    for (i = 0; i < num_rooms; i++) {
+        snprintf(name, sizeof(name), "bldg-north/floor-%d/room-%03d", i / 100, i % 100);
+        rooms_add(&rooms, name);
+    }
+    legacy_rooms = &rooms;
+
+    // Append in sorted order, then shuffle a copy of the sorted view
+    value.temperature = 21.5f;
+    for (i = 0; i < count; i++) {
+        entries_create(&entries, rooms.sorted[i / (count / num_rooms)],
+                       TYPE_TEMP + (i % 3), value, i);
+    }
+
+    sorted = malloc((size_t)count * sizeof(LogEntry *));
+    shuffled = malloc((size_t)count * sizeof(LogEntry *));
+    if (sorted == NULL || shuffled == NULL) {
+        printf("out of memory\n");
+        return;
+    }
+
+    // Flatten the runs into one sorted array to search over
+    entries_cursor_init(&cursor, &entries);
+    for (i = 0; i < count; i++) {
+        sorted[i] = entries_cursor_next(&cursor);
+    }
+
+    shuffle_copy(shuffled, sorted, count);
+    start = now_seconds();
+    qsort(shuffled, (size_t)count, sizeof(LogEntry *), qsort_legacy_cmp);
+    t_legacy_sort = now_seconds() - start;
+
+    shuffle_copy(shuffled, sorted, count);
+    start = now_seconds();
+    qsort(shuffled, (size_t)count, sizeof(LogEntry *), qsort_key_cmp);
+    t_key_sort = now_seconds() - start;
+
+    // One lower-bound search per probe; probes cycle through ENTRY_CHUNK_SIZE
+    // entries spread evenly over the array
+    found = 0;
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        low = 0;
+        high = count;
+        while (low < high) {
+            mid = low + (high - low) / 2;
+            if (legacy_entry_cmp(sorted[mid], sorted[(i % ENTRY_CHUNK_SIZE) * stride]) < 0) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        found += low;
+    }
+    t_legacy_search = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        unsigned long long key = ENTRY_KEY_OF(sorted[(i % ENTRY_CHUNK_SIZE) * stride]);
+
+        low = 0;
+        high = count;
+        while (low < high) {
+            mid = low + (high - low) / 2;
+            if (ENTRY_KEY_OF(sorted[mid]) < key) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        found -= low;
+    }
+    t_key_search = now_seconds() - start;
+
+    printf("%-22s %12s %12s %8s\n", "operation", "legacy (s)", "key (s)", "speedup");
+    printf("%-22s %12.3f %12.3f %7.2fx\n", "qsort shuffled", t_legacy_sort, t_key_sort,
+           t_legacy_sort / t_key_sort);
+    printf("%-22s %12.3f %12.3f %7.2fx\n", "binary search x count", t_legacy_search, t_key_search,
+           t_legacy_search / t_key_search);
+    if (found != 0) {
+        printf("warning: legacy and key searches disagree\n");
+    }
+
+    free(sorted);
+    free(shuffled);
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- fill_sorted -----------------------------------------------------------
+   Purpose: Add BENCH_ROOMS rooms and count entries in sorted order, spread
+            evenly over every (room, type) series with timestamps 0, 10, 20...
+   Params:
+     - rc (out): empty room collection
+     - ec (out): empty entry collection
+     - count (in): number of entries
+   Returns: C_ERR_OK or the first error
+----------------------------------------------------------------------------- */
+static int fill_sorted(RoomCollection *rc, EntryCollection *ec, int count) {
+    int per_series = count / (BENCH_ROOMS * 3);
+    int i, r, t, result;
+    ReadingValue value;
+
+    result = setup_rooms(rc);
+    value.decibels = 40;
+    for (r = 0; r < BENCH_ROOMS && result == C_ERR_OK; r++) {
+        for (t = TYPE_TEMP; t <= TYPE_MOTION && result == C_ERR_OK; t++) {
+            for (i = 0; i < per_series && result == C_ERR_OK; i++) {
+                result = entries_create(ec, rc->rooms[r], t, value, i * 10);
+            }
+        }
+    }
+
+    return result;
+}
+
+/* ---- make_burst ------------------------------------------------------------
+   Purpose: Fill a burst of readings for random rooms and types, with random
+            timestamps below max_timestamp, as a gateway would deliver them.
+----------------------------------------------------------------------------- */
+static void make_burst(SensorReading *burst, int count, int max_timestamp) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        snprintf(burst[i].room_name, MAX_STR, "room-%02d", rand() % BENCH_ROOMS);
+        burst[i].timestamp = rand() % max_timestamp;
+        burst[i].data.type = TYPE_TEMP + rand() % 3;
+        burst[i].data.value.decibels = 55;
+    }
+}
+
+/* ---- bench_batch -----------------------------------------------------------
+   Purpose: Ingest the same bursts of readings into a pre-filled collection
+            one entries_create at a time and with entries_create_batch.
+----------------------------------------------------------------------------- */
+static void bench_batch(void) {
+    const int existing = 200000;
+    const int bursts = 10;
+    const int burst_size = 5000;
+    RoomCollection  rooms_single  = { .size = 0 };
+    EntryCollection single        = { .size = 0 };
+    RoomCollection  rooms_batched = { .size = 0 };
+    EntryCollection batched       = { .size = 0 };
+    SensorReading *burst;
+    double start, t_single = 0, t_batch = 0;
+    int b, i;
+
+    printf("\n== batch: %d bursts of %d readings into %d entries ==\n", bursts, burst_size, existing);
+
+    burst = malloc((size_t)burst_size * sizeof(SensorReading));
+    if (burst == NULL ||
+        fill_sorted(&rooms_single, &single, existing) != C_ERR_OK ||
+        fill_sorted(&rooms_batched, &batched, existing) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+
+    srand(3);
+    for (b = 0; b < bursts; b++) {
+        make_burst(burst, burst_size, existing * 10 / (BENCH_ROOMS * 3));
+
+        start = now_seconds();
+        for (i = 0; i < burst_size; i++) {
+            entries_create(&single, rooms_find(&rooms_single, burst[i].room_name),
+                           burst[i].data.type, burst[i].data.value, burst[i].timestamp);
+        }
+        t_single += now_seconds() - start;
+
+        start = now_seconds();
+        entries_create_batch(&batched, &rooms_batched, burst, burst_size);
+        t_batch += now_seconds() - start;
+    }
+
+    printf("%-22s %14s\n", "path", "usec/reading");
+    printf("%-22s %14.3f\n", "entries_create", t_single * 1e6 / (bursts * burst_size));
+    printf("%-22s %14.3f\n", "entries_create_batch", t_batch * 1e6 / (bursts * burst_size));
+
+    free(burst);
+    entries_clear(&single);
+    entries_clear(&batched);
+    rooms_clear(&rooms_single);
+    rooms_clear(&rooms_batched);
+}
+
+/* ---- bench_append ----------------------------------------------------------
+   Purpose: Ingest a stream where each sensor reports in timestamp order, with
+            a small share of late readings, and report how many inserts took
+            the append fast path and what each costs on average.
+----------------------------------------------------------------------------- */
+static void bench_append(void) {
+    const int count = 2000000;
+    // One reading in late_every arrives up to 50 ticks behind its series
+    const int late_every = 100;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ReadingValue value;
+    double start, elapsed;
+    int i, timestamp;
+
+    printf("\n== append: %d mostly in-order readings, 1 in %d late ==\n", count, late_every);
+
+    if (setup_rooms(&rooms) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+
+    srand(4);
+    value.temperature = 20.0f;
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        timestamp = i;
+        if (i % late_every == 0) {
+            timestamp -= rand() % 50 * BENCH_ROOMS * 3;
+        }
+        entries_create(&entries, rooms.rooms[i % BENCH_ROOMS], TYPE_TEMP + (i / BENCH_ROOMS) % 3,
+                       value, timestamp);
+    }
+    elapsed = now_seconds() - start;
+
+    printf("%-16s %12s %12s %14s %14s\n", "entries", "fast", "slow", "cmp/slow", "usec/insert");
+    printf("%-16d %12lu %12lu %14.1f %14.3f\n", entries.size, entries.fast_appends,
+           entries.slow_inserts,
+           entries.slow_inserts ? (double)entries.comparisons / entries.slow_inserts : 0.0,
+           elapsed * 1e6 / count);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- bench_scan ------------------------------------------------------------
+   Purpose: Sum every room's temperatures, once through the series' value
+            columns and once through their LogEntry rows. Readings arrive
+            interleaved across rooms and types, so a series' rows are spread
+            over the chunks while its columns are contiguous.
+----------------------------------------------------------------------------- */
+static void bench_scan(void) {
+    const int count = 4000000;
+    const int passes = 10;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    const Series *series;
+    ReadingValue value;
+    double start, t_rows, t_columns, sum_rows = 0, sum_columns = 0;
+    int i, p, r;
+
+    printf("\n== scan: sum of all temperatures, %d entries, %d passes ==\n", count, passes);
+
+    if (setup_rooms(&rooms) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        value.temperature = (float)(i % 100) / 4.0f;
+        if (entries_create(&entries, rooms.rooms[i % BENCH_ROOMS], TYPE_TEMP + (i / BENCH_ROOMS) % 3,
+                           value, i) != C_ERR_OK) {
+            printf("setup failed\n");
+            return;
+        }
+    }
+
+    start = now_seconds();
+    for (p = 0; p < passes; p++) {
+        for (r = 0; r < rooms.size; r++) {
+            series = rooms.rooms[r]->series[TYPE_TEMP - 1];
+            for (i = 0; series != NULL && i < series->size; i++) {
+                sum_rows += series->rows[i]->value.temperature;
+            }
+        }
+    }
+    t_rows = now_seconds() - start;
+
+    start = now_seconds();
+    for (p = 0; p < passes; p++) {
+        for (r = 0; r < rooms.size; r++) {
+            series = rooms.rooms[r]->series[TYPE_TEMP - 1];
+            for (i = 0; series != NULL && i < series->size; i++) {
+                sum_columns += series->values.temperature[i];
+            }
+        }
+    }
+    t_columns = now_seconds() - start;
+
+    printf("%-22s %12s %14s\n", "path", "seconds", "nsec/reading");
+    printf("%-22s %12.3f %14.2f\n", "LogEntry rows", t_rows, t_rows * 1e9 / (passes * count / 3.0));
+    printf("%-22s %12.3f %14.2f\n", "series columns", t_columns, t_columns * 1e9 / (passes * count / 3.0));
+    if (sum_rows != sum_columns) {
+        printf("warning: row and column sums disagree\n");
+    }
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- count_reading ---------------------------------------------------------
+   Purpose: RangeCallback that only counts the readings it is given.
+----------------------------------------------------------------------------- */
+static int count_reading(const Room *room, int type, int timestamp, ReadingValue value, void *ctx) {
+    (void)room;
+    (void)type;
+    (void)timestamp;
+    (void)value;
+    (*(long *)ctx)++;
+    return 0;
+}
+
+/* ---- bench_range -----------------------------------------------------------
+   Purpose: Time room_query_range for narrow windows at growing series sizes.
+            With O(log n + k) cost the time per query should barely move
+            while n grows a hundredfold.
+----------------------------------------------------------------------------- */
+static void bench_range(void) {
+    const int sizes[] = { 10000, 100000, 1000000 };
+    const int queries = 200000;
+    // Width of each queried window, in timestamps (readings are 1 apart)
+    const int width = 20;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ReadingValue value;
+    double start, elapsed;
+    long found;
+    int s, i, from;
+
+    printf("\n== range: room_query_range over a %d-timestamp window ==\n", width);
+    printf("%10s %10s %14s %14s\n", "series", "queries", "found/query", "nsec/query");
+
+    if (setup_rooms(&rooms) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+
+    srand(6);
+    value.decibels = 60;
+    for (s = 0; s < 3; s++) {
+        for (i = 0; i < sizes[s]; i++) {
+            entries_create(&entries, rooms.rooms[0], TYPE_DB, value, i);
+        }
+
+        found = 0;
+        start = now_seconds();
+        for (i = 0; i < queries; i++) {
+            from = rand() % sizes[s];
+            room_query_range(rooms.rooms[0], TYPE_DB, from, from + width - 1, count_reading, &found);
+        }
+        elapsed = now_seconds() - start;
+
+        printf("%10d %10d %14.1f %14.1f\n", sizes[s], queries, (double)found / queries,
+               elapsed * 1e9 / queries);
+        entries_clear(&entries);
+    }
+
+    rooms_clear(&rooms);
+}
+
+/* ---- count_bucket ----------------------------------------------------------
+   Purpose: AggregateCallback that adds up the readings of every bucket.
+----------------------------------------------------------------------------- */
+static int count_bucket(const Room *room, int type, const Aggregate *bucket, void *ctx) {
+    (void)room;
+    (void)type;
+    *(long *)ctx += bucket->count;
+    return 0;
+}
+
+/* ---- bench_agg -------------------------------------------------------------
+   Purpose: Time room_aggregate over every (room, type) series for a few
+            bucket widths, reporting the cost per reading scanned.
+----------------------------------------------------------------------------- */
+static void bench_agg(void) {
+    const int count = 4000000;
+    const int widths[] = { 60, 300, 3600 };
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ReadingValue value;
+    double start, elapsed;
+    long readings;
+    int i, w, r, t;
+
+    printf("\n== agg: room_aggregate over all series, %d entries ==\n", count);
+    printf("%10s %12s %14s\n", "width", "readings", "nsec/reading");
+
+    if (setup_rooms(&rooms) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+    memset(&value, 0, sizeof(value));
+    for (i = 0; i < count; i++) {
+        value.decibels = 30 + i % 70;
+        entries_create(&entries, rooms.rooms[i % BENCH_ROOMS], TYPE_TEMP + (i / BENCH_ROOMS) % 3,
+                       value, i);
+    }
+
+    for (w = 0; w < 3; w++) {
+        readings = 0;
+        start = now_seconds();
+        for (r = 0; r < rooms.size; r++) {
+            for (t = TYPE_TEMP; t <= TYPE_MOTION; t++) {
+                room_aggregate(rooms.rooms[r], t, 0, count, widths[w], count_bucket, &readings);
+            }
+        }
+        elapsed = now_seconds() - start;
+
+        printf("%10d %12ld %14.2f\n", widths[w], readings, elapsed * 1e9 / readings);
+    }
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- ingest_stream ---------------------------------------------------------
+   Purpose: Add count in-order readings round-robin over every (room, type)
+            series, with decibel values that rise and fall.
+   Returns: seconds taken
+----------------------------------------------------------------------------- */
+static double ingest_stream(RoomCollection *rc, EntryCollection *ec, int count) {
+    ReadingValue value;
+    double start;
+    int i;
+
+    memset(&value, 0, sizeof(value));
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        value.decibels = 30 + (i * 7) % 61;
+        entries_create(ec, rc->rooms[i % BENCH_ROOMS], TYPE_TEMP + (i / BENCH_ROOMS) % 3, value, i);
+    }
+    return now_seconds() - start;
+}
+
+/* ---- bench_rolling ---------------------------------------------------------
+   Purpose: Measure what rolling statistics add to entries_create, and compare
+            reading them with re-aggregating the same window with
+            room_aggregate, as an alerting loop polling every room would.
+----------------------------------------------------------------------------- */
+static void bench_rolling(void) {
+    const int count = 2000000;
+    const int window = 60000;
+    const int polls = 100;
+    RoomCollection  rooms_plain   = { .size = 0 };
+    EntryCollection plain         = { .size = 0 };
+    RoomCollection  rooms_rolling = { .size = 0 };
+    EntryCollection rolling       = { .size = 0 };
+    Aggregate stats;
+    double start, t_plain, t_rolling, t_read, t_rescan;
+    long readings = 0;
+    int p, r, t;
+
+    printf("\n== rolling: %d readings, window of %d timestamps ==\n", count, window);
+
+    if (setup_rooms(&rooms_plain) != C_ERR_OK || setup_rooms(&rooms_rolling) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+    for (r = 0; r < BENCH_ROOMS; r++) {
+        for (t = TYPE_TEMP; t <= TYPE_MOTION; t++) {
+            room_rolling_configure(rooms_rolling.rooms[r], t, window);
+        }
+    }
+
+    t_plain = ingest_stream(&rooms_plain, &plain, count);
+    t_rolling = ingest_stream(&rooms_rolling, &rolling, count);
+
+    start = now_seconds();
+    for (p = 0; p < polls; p++) {
+        for (r = 0; r < BENCH_ROOMS; r++) {
+            room_rolling(rooms_rolling.rooms[r], TYPE_DB, &stats);
+            readings += stats.count;
+        }
+    }
+    t_read = now_seconds() - start;
+
+    start = now_seconds();
+    for (p = 0; p < polls; p++) {
+        for (r = 0; r < BENCH_ROOMS; r++) {
+            room_aggregate(rooms_plain.rooms[r], TYPE_DB, count - window, count, window,
+                           count_bucket, &readings);
+        }
+    }
+    t_rescan = now_seconds() - start;
+
+    printf("%-30s %14s\n", "operation", "usec");
+    printf("%-30s %14.3f\n", "entries_create, rolling off", t_plain * 1e6 / count);
+    printf("%-30s %14.3f\n", "entries_create, rolling on", t_rolling * 1e6 / count);
+    printf("%-30s %14.3f\n", "room_rolling per room", t_read * 1e6 / (polls * BENCH_ROOMS));
+    printf("%-30s %14.3f\n", "room_aggregate per room", t_rescan * 1e6 / (polls * BENCH_ROOMS));
+
+    entries_clear(&plain);
+    entries_clear(&rolling);
+    rooms_clear(&rooms_plain);
+    rooms_clear(&rooms_rolling);
+}
+
+/* ---- wal_stream ------------------------------------------------------------
+   Purpose: Log count entries through wal_entries_create into a fresh log with
+            the given group size, and time it including the final commit.
+   Params:
+     - wal (out): log to use, or NULL to time entries_create alone
+     - group_records (in): records per commit
+     - count (in): entries to create
+   Returns: elapsed seconds, or -1 if the log could not be opened
+----------------------------------------------------------------------------- */
+static double wal_stream(WriteAheadLog *wal, int group_records, int count) {
+    const char *path = "bench.wal";
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ReadingValue value;
+    double start, elapsed;
+    int i;
+
+    remove(path);
+    if (setup_rooms(&rooms) != C_ERR_OK ||
+        (wal != NULL && wal_open(wal, path, group_records, 1000000) != C_ERR_OK)) {
+        rooms_clear(&rooms);
+        return -1;
+    }
+
+    memset(&value, 0, sizeof(value));
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        value.decibels = 30 + (i * 7) % 61;
+        wal_entries_create(wal, &entries, rooms.rooms[i % BENCH_ROOMS],
+                           TYPE_TEMP + (i / BENCH_ROOMS) % 3, value, i);
+    }
+    if (wal != NULL) {
+        wal_close(wal);
+    }
+    elapsed = now_seconds() - start;
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+    remove(path);
+    return elapsed;
+}
+
+/* ---- bench_wal -------------------------------------------------------------
+   Purpose: Measure what the write-ahead log adds to entries_create at
+            different group commit sizes. A group of 1 fsyncs every record.
+----------------------------------------------------------------------------- */
+static void bench_wal(void) {
+    const int groups[] = { 1, 64, 1024 };
+    // Fewer records for the fsync-per-record case, which is far slower
+    const int counts[] = { 2000, 200000, 200000 };
+    static WriteAheadLog wal;
+    double elapsed;
+    int g;
+
+    printf("\n== wal: entries_create with and without the log ==\n");
+    printf("%-30s %10s %14s\n", "configuration", "entries", "usec/entry");
+
+    elapsed = wal_stream(NULL, 1, counts[1]);
+    printf("%-30s %10d %14.3f\n", "no log", counts[1], elapsed * 1e6 / counts[1]);
+
+    for (g = 0; g < 3; g++) {
+        elapsed = wal_stream(&wal, groups[g], counts[g]);
+        if (elapsed < 0) {
+            printf("cannot open bench.wal\n");
+            return;
+        }
+        printf("group of %-21d %10d %14.3f   (%lu commits)\n", groups[g], counts[g],
+               elapsed * 1e6 / counts[g], wal.commits);
+    }
+}
+
+/* ---- bench_snapshot --------------------------------------------------------
+   Purpose: Compare rebuilding a collection by inserting every reading with
+            saving it as a snapshot and opening that again, and show what
+            the first scan over the mapped columns costs (page faults).
+----------------------------------------------------------------------------- */
+static void bench_snapshot(void) {
+    const int count = 5000000;
+    const char *path = "bench.snap";
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    double start, t_ingest, t_save, t_open, t_scan;
+    long readings = 0;
+    int r;
+
+    printf("\n== snapshot: %d readings ==\n", count);
+
+    if (setup_rooms(&rooms) != C_ERR_OK) {
+        printf("setup failed\n");
+        return;
+    }
+    t_ingest = ingest_stream(&rooms, &entries, count);
+
+    start = now_seconds();
+    if (snapshot_save(path, &rooms, &entries) != C_ERR_OK) {
+        printf("cannot write %s\n", path);
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+        return;
+    }
+    t_save = now_seconds() - start;
+
+    // Time the open on its own, as at startup
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+    start = now_seconds();
+    snapshot_open(path, &rooms, &entries);
+    t_open = now_seconds() - start;
+
+    start = now_seconds();
+    for (r = 0; r < BENCH_ROOMS; r++) {
+        room_query_range(rooms.rooms[r], TYPE_DB, 0, count, count_reading, &readings);
+    }
+    t_scan = now_seconds() - start;
+
+    printf("%-34s %12s\n", "operation", "msec");
+    printf("%-34s %12.3f\n", "insert every reading", t_ingest * 1e3);
+    printf("%-34s %12.3f\n", "snapshot_save", t_save * 1e3);
+    printf("%-34s %12.3f\n", "snapshot_open", t_open * 1e3);
+    printf("%-34s %12.3f   (%ld readings)\n", "first range scan of DB series", t_scan * 1e3, readings);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+    remove(path);
+}
+
+/* ---- write_csv -------------------------------------------------------------
+   Purpose: Write count readings as CSV lines, rooms and types interleaved and
+            timestamps increasing, the way a gateway would log them.
+   Params:
+     - path (in): file to create
+     - count (in): number of lines
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int write_csv(const char *path, int count) {
+    FILE *fp = fopen(path, "w");
+    int i, room, type;
+
+    if (fp == NULL) {
+        return C_ERR_IO;
+    }
+
+    for (i = 0; i < count; i++) {
+        room = i % BENCH_ROOMS;
+        type = TYPE_TEMP + (i / BENCH_ROOMS) % 3;
+        if (type == TYPE_TEMP) {
+            fprintf(fp, "room-%02d,%d,TEMP,%d.%d\n", room, 1600000000 + i, 15 + i % 15, i % 10);
+        }
+        else if (type == TYPE_DB) {
+            fprintf(fp, "room-%02d,%d,DB,%d\n", room, 1600000000 + i, 30 + i % 61);
+        }
+        else {
+            fprintf(fp, "room-%02d,%d,MOTION,%d,%d,%d\n", room, 1600000000 + i, i & 1, (i >> 1) & 1, 0);
+        }
+    }
+
+    return (fclose(fp) == 0) ? C_ERR_OK : C_ERR_IO;
+}
+
+/* ---- scanf_import ----------------------------------------------------------
+   Purpose: Load the same file the way the menu reads a reading: stdio
+            parsing of each line, then one entries_create per reading.
+   Returns: number of readings imported
+----------------------------------------------------------------------------- */
+static int scanf_import(const char *path, RoomCollection *rc, EntryCollection *ec) {
+    FILE *fp = fopen(path, "r");
+    char line[128];
+    char name[MAX_STR];
+    char type_name[8];
+    unsigned int m0, m1, m2;
+    int timestamp, imported = 0;
+    ReadingValue value;
+    Room *room;
+
+    if (fp == NULL) {
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%31[^,],%d,%7[^,],", name, &timestamp, type_name) != 3 ||
+            (room = rooms_find(rc, name)) == NULL) {
+            continue;
+        }
+        memset(&value, 0, sizeof(value));
+        if (strcmp(type_name, "TEMP") == 0) {
+            sscanf(strrchr(line, ',') + 1, "%f", &value.temperature);
+            imported += (entries_create(ec, room, TYPE_TEMP, value, timestamp) == C_ERR_OK);
+        }
+        else if (strcmp(type_name, "DB") == 0) {
+            sscanf(strrchr(line, ',') + 1, "%d", &value.decibels);
+            imported += (entries_create(ec, room, TYPE_DB, value, timestamp) == C_ERR_OK);
+        }
+        else if (sscanf(line, "%*[^,],%*d,%*[^,],%u,%u,%u", &m0, &m1, &m2) == 3) {
+            value.motion[0] = (unsigned char)m0;
+            value.motion[1] = (unsigned char)m1;
+            value.motion[2] = (unsigned char)m2;
+            imported += (entries_create(ec, room, TYPE_MOTION, value, timestamp) == C_ERR_OK);
+        }
+    }
+
+    fclose(fp);
+    return imported;
+}
+
+/* ---- bench_csv -------------------------------------------------------------
+   Purpose: Measure csv_import in lines per second against stdio parsing with
+            one entries_create per line, on a CSV file of 5M readings.
+----------------------------------------------------------------------------- */
+static void bench_csv(void) {
+    const int count = 5000000;
+    const char *path = "bench.csv";
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    CsvImport import;
+    double start, t_import, t_scanf;
+    int result, imported;
+
+    printf("\n== csv: importing %d lines ==\n", count);
+
+    if (write_csv(path, count) != C_ERR_OK) {
+        printf("cannot write %s\n", path);
+        return;
+    }
+
+    memset(&import, 0, sizeof(import));
+    import.rc = &rooms;
+    import.ec = &entries;
+    start = now_seconds();
+    result = csv_import(&import, path);
+    t_import = now_seconds() - start;
+    if (result != C_ERR_OK || import.imported != count) {
+        printf("csv_import failed (%d, %ld imported)\n", result, import.imported);
+    }
+
+    // Same rooms, fresh entries, for the stdio baseline
+    entries_clear(&entries);
+    start = now_seconds();
+    imported = scanf_import(path, &rooms, &entries);
+    t_scanf = now_seconds() - start;
+
+    printf("%-30s %10s %14s\n", "method", "msec", "Mlines/sec");
+    printf("%-30s %10.1f %14.2f\n", "csv_import", t_import * 1e3, count / t_import / 1e6);
+    printf("%-30s %10.1f %14.2f\n", "sscanf + entries_create", t_scanf * 1e3, imported / t_scanf / 1e6);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+    remove(path);
+}
+
+/* ---- export_with_buffer ----------------------------------------------------
+   Purpose: Time csv_export to /dev/null with the given stdio buffering mode.
+   Returns: seconds taken, or -1 if /dev/null cannot be opened
+----------------------------------------------------------------------------- */
+static double export_with_buffer(const EntryCollection *ec, int mode) {
+    FILE *fp = fopen("/dev/null", "w");
+    double start;
+
+    if (fp == NULL) {
+        return -1;
+    }
+
+    setvbuf(fp, NULL, mode, 1 << 16);
+    start = now_seconds();
+    csv_export(ec, fp);
+    fclose(fp);
+    return now_seconds() - start;
+}
+
+/* ---- bench_script ----------------------------------------------------------
+   Purpose: Run add-entry commands through script_run, then compare the
+            block-buffered output script mode uses against line buffering,
+            which is what stdout gets on a terminal.
+----------------------------------------------------------------------------- */
+static void bench_script(void) {
+    const int count = 1000000;
+    const char *path = "bench.script";
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    FILE *fp;
+    double start, t_run, t_full, t_line;
+    int i, failed;
+
+    printf("\n== script: %d add-entry commands ==\n", count);
+
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("cannot write %s\n", path);
+        return;
+    }
+    for (i = 0; i < BENCH_ROOMS; i++) {
+        fprintf(fp, "add-room room-%02d\n", i);
+    }
+    for (i = 0; i < count; i++) {
+        fprintf(fp, "add-entry room-%02d,%d,DB,%d\n", i % BENCH_ROOMS, 1600000000 + i, 30 + i % 61);
+    }
+    fclose(fp);
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("cannot read %s\n", path);
+        return;
+    }
+    start = now_seconds();
+    failed = script_run(fp, path, NULL, &rooms, &entries);
+    t_run = now_seconds() - start;
+    fclose(fp);
+    if (failed != 0 || entries.size != count) {
+        printf("script_run failed (%d failed, %d entries)\n", failed, entries.size);
+    }
+
+    t_full = export_with_buffer(&entries, _IOFBF);
+    t_line = export_with_buffer(&entries, _IOLBF);
+
+    printf("%-30s %10s %14s\n", "step", "msec", "Mlines/sec");
+    printf("%-30s %10.1f %14.2f\n", "script_run add-entry", t_run * 1e3, count / t_run / 1e6);
+    printf("%-30s %10.1f %14.2f\n", "export, 64 KB buffer", t_full * 1e3, count / t_full / 1e6);
+    printf("%-30s %10.1f %14.2f\n", "export, line buffered", t_line * 1e3, count / t_line / 1e6);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+    remove(path);
+}
+
+/* ---- bench_print -----------------------------------------------------------
+   Purpose: Dump every entry to /dev/null with entry_print (stdout redirected)
+            and with render_entry, then the same for room_print and
+            render_room.
+----------------------------------------------------------------------------- */
+static void bench_print(void) {
+    const int count = 1000000;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    static char buffer[RENDER_BUFFER_SIZE];
+    RenderBuffer render;
+    EntryCursor cursor;
+    const LogEntry *entry;
+    ReadingValue value;
+    FILE *fp;
+    double start, t_print, t_render, t_room_print, t_room_render;
+    int i, type, saved, null_fd;
+
+    printf("\n== print: %d entries to /dev/null ==\n", count);
+
+    setup_rooms(&rooms);
+    for (i = 0; i < count; i++) {
+        type = TYPE_TEMP + i % 3;
+        if (type == TYPE_TEMP) {
+            value.temperature = 15.0f + (float)(i % 1500) / 100.0f;
+        }
+        else if (type == TYPE_DB) {
+            value.decibels = 30 + i % 61;
+        }
+        else {
+            value.motion[0] = i & 1;
+            value.motion[1] = (i >> 1) & 1;
+            value.motion[2] = 0;
+        }
+        entries_create(&entries, rooms.rooms[i % BENCH_ROOMS], type, value, 1600000000 + i);
+    }
+
+    fp = fopen("/dev/null", "w");
+    null_fd = open("/dev/null", O_WRONLY);
+    if (fp == NULL || null_fd < 0) {
+        printf("cannot open /dev/null\n");
+        return;
+    }
+
+    // printf path: point stdout at /dev/null for the duration
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    start = now_seconds();
+    entries_cursor_init(&cursor, &entries);
+    while ((entry = entries_cursor_next(&cursor)) != NULL) {
+        entry_print(&rooms, entry);
+    }
+    fflush(stdout);
+    t_print = now_seconds() - start;
+    start = now_seconds();
+    for (i = 0; i < rooms.size; i++) {
+        room_print(rooms.rooms[i]);
+    }
+    fflush(stdout);
+    t_room_print = now_seconds() - start;
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(null_fd);
+
+    start = now_seconds();
+    render_init(&render, fp, buffer, sizeof(buffer));
+    entries_cursor_init(&cursor, &entries);
+    while ((entry = entries_cursor_next(&cursor)) != NULL) {
+        render_entry(&render, &rooms, entry);
+    }
+    render_flush(&render);
+    fflush(fp);
+    t_render = now_seconds() - start;
+    start = now_seconds();
+    for (i = 0; i < rooms.size; i++) {
+        render_room(&render, rooms.rooms[i]);
+    }
+    render_flush(&render);
+    fflush(fp);
+    t_room_render = now_seconds() - start;
+    fclose(fp);
+
+    printf("%-30s %10s %14s\n", "method", "msec", "Mlines/sec");
+    printf("%-30s %10.1f %14.2f\n", "entry_print", t_print * 1e3, count / t_print / 1e6);
+    printf("%-30s %10.1f %14.2f\n", "render_entry", t_render * 1e3, count / t_render / 1e6);
+    printf("%-30s %10.1f %14.2f\n", "room_print", t_room_print * 1e3, count / t_room_print / 1e6);
+    printf("%-30s %10.1f %14.2f\n", "render_room", t_room_render * 1e3, count / t_room_render / 1e6);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- count_motion ----------------------------------------------------------
+   Purpose: RangeCallback that tallies a MotionSummary one reading at a time,
+            the way a caller without room_motion_summary would.
+----------------------------------------------------------------------------- */
+static int count_motion(const Room *room, int type, int timestamp, ReadingValue value, void *ctx) {
+    MotionSummary *summary = ctx;
+
+    (void)room;
+    (void)type;
+    (void)timestamp;
+    summary->readings++;
+    if (value.motion[0]) {
+        summary->left++;
+    }
+    if (value.motion[1]) {
+        summary->forward++;
+    }
+    if (value.motion[2]) {
+        summary->right++;
+    }
+    if (value.motion[0] || value.motion[1] || value.motion[2]) {
+        summary->any++;
+    }
+    return 0;
+}
+
+/* ---- bench_motion ----------------------------------------------------------
+   Purpose: Summarise one room's motion series with room_motion_summary and
+            with a per-reading room_query_range callback, over the whole
+            series and over short ranges.
+----------------------------------------------------------------------------- */
+static void bench_motion(void) {
+    const int count = 10000000;
+    const int queries = 100000;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    MotionSummary fast, slow;
+    ReadingValue value;
+    unsigned int seed = 12345;
+    double start, t_fast, t_slow, t_fast_short, t_slow_short, share;
+    int i, t_from;
+    long checksum = 0;
+
+    printf("\n== motion: %d readings in one room ==\n", count);
+
+    rooms_add(&rooms, "room");
+    for (i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        value.motion[0] = (seed >> 16) % 7 == 0;
+        value.motion[1] = (seed >> 20) % 5 == 0;
+        value.motion[2] = (seed >> 24) % 9 == 0;
+        entries_create(&entries, rooms.rooms[0], TYPE_MOTION, value, i);
+    }
+
+    start = now_seconds();
+    room_motion_summary(rooms.rooms[0], 0, count, &fast);
+    t_fast = now_seconds() - start;
+
+    memset(&slow, 0, sizeof(slow));
+    start = now_seconds();
+    room_query_range(rooms.rooms[0], TYPE_MOTION, 0, count, count_motion, &slow);
+    t_slow = now_seconds() - start;
+    if (memcmp(&fast, &slow, sizeof(fast)) != 0) {
+        printf("summaries differ\n");
+    }
+    share = 100.0 * fast.any / fast.readings;
+
+    // Short ranges: 1000 readings at varying offsets
+    start = now_seconds();
+    for (i = 0; i < queries; i++) {
+        t_from = (int)((i * 7919L) % (count - 1000));
+        room_motion_summary(rooms.rooms[0], t_from, t_from + 999, &fast);
+        checksum += fast.any;
+    }
+    t_fast_short = now_seconds() - start;
+    start = now_seconds();
+    for (i = 0; i < queries; i++) {
+        t_from = (int)((i * 7919L) % (count - 1000));
+        memset(&slow, 0, sizeof(slow));
+        room_query_range(rooms.rooms[0], TYPE_MOTION, t_from, t_from + 999, count_motion, &slow);
+        checksum -= slow.any;
+    }
+    t_slow_short = now_seconds() - start;
+    if (checksum != 0) {
+        printf("short-range summaries differ\n");
+    }
+
+    printf("any motion in %.1f%% of readings; value column %.3f bytes per reading\n",
+           share,
+           (double)MOTION_WORDS(count) * sizeof(unsigned long long) / count);
+    printf("%-34s %12s %12s\n", "method", "full (ms)", "1000 (us)");
+    printf("%-34s %12.2f %12.3f\n", "room_motion_summary", t_fast * 1e3, t_fast_short / queries * 1e6);
+    printf("%-34s %12.2f %12.3f\n", "room_query_range + callback", t_slow * 1e3, t_slow_short / queries * 1e6);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- bench_footprint -------------------------------------------------------
+   Purpose: Memory-footprint report for 10M entries: the entry layouts side
+            by side, the bytes the collection actually holds, and the time
+            of one pass over every stored entry in the pointer layout and in
+            the packed one.
+----------------------------------------------------------------------------- */
+static void bench_footprint(void) {
+    const int count = 10000000;
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    PointerLogEntry *old_entries;
+    const LogEntry *entry;
+    const Series *series;
+    const EntryPartition *part;
+    ReadingValue value;
+    size_t chunk_bytes = 0, column_bytes = 0, row_bytes = 0;
+    double start, t_old, t_new, sum_old = 0, sum_new = 0;
+    int i, c, p, used;
+
+    printf("\n== footprint: %d entries ==\n", count);
+    printf("%-30s %8s %12s %10s\n", "entry layout", "bytes", "MB at 10M", "per 64 B");
+    printf("%-30s %8zu %12.1f %10.2f\n", "Reading + Room* + timestamp", sizeof(PointerLogEntry),
+           (double)sizeof(PointerLogEntry) * count / 1e6, 64.0 / sizeof(PointerLogEntry));
+    printf("%-30s %8zu %12.1f %10.2f\n", "  + 8-byte sort key", sizeof(KeyedLogEntry),
+           (double)sizeof(KeyedLogEntry) * count / 1e6, 64.0 / sizeof(KeyedLogEntry));
+    printf("%-30s %8zu %12.1f %10.2f\n", "packed LogEntry", sizeof(LogEntry),
+           (double)sizeof(LogEntry) * count / 1e6, 64.0 / sizeof(LogEntry));
+
+    setup_rooms(&rooms);
+    old_entries = malloc((size_t)count * sizeof(PointerLogEntry));
+    if (old_entries == NULL) {
+        printf("out of memory\n");
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        value.temperature = 15.0f + (float)(i % 1500) / 100.0f;
+        entries_create(&entries, rooms.rooms[i % BENCH_ROOMS], TYPE_TEMP, value, i);
+        old_entries[i].data.type = TYPE_TEMP;
+        old_entries[i].data.value = value;
+        old_entries[i].room = rooms.rooms[i % BENCH_ROOMS];
+        old_entries[i].timestamp = i;
+    }
+
+    for (p = 0; p < entries.num_partitions; p++) {
+        for (c = 0; c < entries.partitions[p].num_chunks; c++) {
+            chunk_bytes += (size_t)ENTRY_CHUNK_SLOTS(c) * sizeof(LogEntry);
+        }
+    }
+    for (i = 0; i < entries.num_series; i++) {
+        series = entries.series[i];
+        column_bytes += (size_t)series->capacity * (sizeof(int) + sizeof(float));
+        row_bytes += (size_t)series->capacity * sizeof(LogEntry *);
+    }
+    printf("\ncollection with 10M temperature readings:\n");
+    printf("  %-28s %10.1f MB\n", "entry chunks", chunk_bytes / 1e6);
+    printf("  %-28s %10.1f MB\n", "series rows (LogEntry *)", row_bytes / 1e6);
+    printf("  %-28s %10.1f MB\n", "series columns", column_bytes / 1e6);
+    printf("  %-28s %10.1f MB (%.1f bytes per reading; %.1f with 24-byte entries)\n", "total",
+           (chunk_bytes + row_bytes + column_bytes) / 1e6,
+           (double)(chunk_bytes + row_bytes + column_bytes) / count,
+           (double)((size_t)count * sizeof(PointerLogEntry) + row_bytes + column_bytes) / count);
+
+    // One pass over every stored entry, in storage order
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        if (old_entries[i].data.type == TYPE_TEMP && old_entries[i].room != NULL) {
+            sum_old += old_entries[i].data.value.temperature;
+        }
+    }
+    t_old = now_seconds() - start;
+
+    start = now_seconds();
+    for (p = 0; p < entries.num_partitions; p++) {
+        part = &entries.partitions[p];
+        for (c = 0; c < part->num_chunks; c++) {
+            used = (c == part->num_chunks - 1) ? part->tail : ENTRY_CHUNK_SLOTS(c);
+            for (i = 0; i < used; i++) {
+                entry = &part->chunks[c][i];
+                if (entry->type == TYPE_TEMP && (int)entry->room < rooms.size) {
+                    sum_new += entry->value.temperature;
+                }
+            }
+        }
+    }
+    t_new = now_seconds() - start;
+    if (sum_old != sum_new) {
+        printf("warning: scans disagree\n");
+    }
+
+    printf("\n%-30s %10s %12s\n", "scan every entry", "msec", "ns/entry");
+    printf("%-30s %10.1f %12.2f\n", "24-byte pointer layout", t_old * 1e3, t_old * 1e9 / count);
+    printf("%-30s %10.1f %12.2f\n", "12-byte packed layout", t_new * 1e3, t_new * 1e9 / count);
+
+    free(old_entries);
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- fill_sensors ----------------------------------------------------------
+   Purpose: Add per_series readings to every (room, type) series the way
+            sensors report them: once a minute with the odd second of
+            jitter, temperatures and noise levels that wander a little from
+            one reading to the next, and motion now and then.
+----------------------------------------------------------------------------- */
+static void fill_sensors(RoomCollection *rc, EntryCollection *ec, int per_series) {
+    ReadingValue value;
+    unsigned int seed = 4242;
+    int i, r, timestamp;
+    int tenths[BENCH_ROOMS], decibels[BENCH_ROOMS];
+
+    for (r = 0; r < BENCH_ROOMS; r++) {
+        tenths[r] = 200 + r;
+        decibels[r] = 40 + r;
+    }
+    for (i = 0; i < per_series; i++) {
+        for (r = 0; r < BENCH_ROOMS; r++) {
+            seed = seed * 1103515245u + 12345u;
+            timestamp = i * 60 + (((seed >> 8) % 50 == 0) ? (int)((seed >> 14) % 3) : 0);
+
+            tenths[r] += (int)((seed >> 16) % 3) - 1;
+            memset(&value, 0, sizeof(value));
+            value.temperature = (float)tenths[r] / 10.0f;
+            entries_create(ec, rc->rooms[r], TYPE_TEMP, value, timestamp);
+
+            decibels[r] += (int)((seed >> 20) % 5) - 2;
+            memset(&value, 0, sizeof(value));
+            value.decibels = decibels[r];
+            entries_create(ec, rc->rooms[r], TYPE_DB, value, timestamp);
+
+            memset(&value, 0, sizeof(value));
+            value.motion[1] = ((seed >> 24) % 8 == 0);
+            entries_create(ec, rc->rooms[r], TYPE_MOTION, value, timestamp);
+        }
+    }
+}
+
+/* ---- sealed_bytes ----------------------------------------------------------
+   Purpose: Bytes of the sealed blocks of one type, headers included.
+----------------------------------------------------------------------------- */
+static size_t sealed_bytes(const EntryCollection *ec, int type) {
+    const Series *series;
+    size_t bytes = 0;
+    int i, b;
+
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        for (b = 0; series->type == type && b < series->num_blocks; b++) {
+            bytes += sizeof(SeriesBlock) + series->blocks[b]->bytes;
+        }
+    }
+    return bytes;
+}
+
+/* ---- time_queries ----------------------------------------------------------
+   Purpose: Run one-hour range queries at random times over random series.
+   Returns: seconds taken
+----------------------------------------------------------------------------- */
+static double time_queries(const RoomCollection *rc, int per_series, int queries, long *found) {
+    double start = now_seconds();
+    int i, from;
+
+    srand(19);
+    for (i = 0; i < queries; i++) {
+        from = (rand() % per_series) * 60;
+        room_query_range(rc->rooms[rand() % rc->size], TYPE_TEMP + rand() % 3, from, from + 3599,
+                         count_reading, found);
+    }
+    return now_seconds() - start;
+}
+
+/* ---- time_aggregates -------------------------------------------------------
+   Purpose: Aggregate every series per hour over its whole range.
+   Returns: seconds taken
+----------------------------------------------------------------------------- */
+static double time_aggregates(const RoomCollection *rc, int per_series, long *readings) {
+    double start = now_seconds();
+    int r, t;
+
+    for (r = 0; r < rc->size; r++) {
+        for (t = TYPE_TEMP; t <= TYPE_MOTION; t++) {
+            room_aggregate(rc->rooms[r], t, 0, per_series * 60, 3600, count_bucket, readings);
+        }
+    }
+    return now_seconds() - start;
+}
+
+/* ---- bench_compress --------------------------------------------------------
+   Purpose: Compare the memory, range query and aggregation cost of sensor
+            data in open series and after entries_compress has sealed it.
+----------------------------------------------------------------------------- */
+static void bench_compress(void) {
+    const int per_series = 200000;
+    const int queries = 200000;
+    const char *type_names[] = { "", "TEMP", "DB", "MOTION" };
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    size_t open_bytes, sealed_total;
+    double start, t_compress, q_open, q_sealed, a_open, a_sealed;
+    long found_open = 0, found_sealed = 0, agg_open = 0, agg_sealed = 0;
+    int sealed, t;
+
+    printf("\n== compress: %d series of %d readings ==\n", BENCH_ROOMS * NUM_TYPES, per_series);
+
+    setup_rooms(&rooms);
+    fill_sensors(&rooms, &entries, per_series);
+
+    open_bytes = entries_memory(&entries);
+    q_open = time_queries(&rooms, per_series, queries, &found_open);
+    a_open = time_aggregates(&rooms, per_series, &agg_open);
+
+    start = now_seconds();
+    sealed = entries_compress(&entries);
+    t_compress = now_seconds() - start;
+
+    sealed_total = entries_memory(&entries);
+    q_sealed = time_queries(&rooms, per_series, queries, &found_sealed);
+    a_sealed = time_aggregates(&rooms, per_series, &agg_sealed);
+    if (found_open != found_sealed || agg_open != agg_sealed) {
+        printf("warning: results differ after compressing\n");
+    }
+
+    printf("sealed %d of %d readings in %.1f ms\n", sealed, entries.size, t_compress * 1e3);
+    for (t = TYPE_TEMP; t <= TYPE_MOTION; t++) {
+        printf("  %-8s %8.2f bytes per sealed reading\n", type_names[t],
+               (double)sealed_bytes(&entries, t) / (sealed / NUM_TYPES));
+    }
+    printf("%-24s %12s %14s %16s\n", "", "memory (MB)", "1h query (ns)", "agg (ns/reading)");
+    printf("%-24s %12.1f %14.1f %16.2f\n", "open series", open_bytes / 1e6,
+           q_open * 1e9 / queries, a_open * 1e9 / agg_open);
+    printf("%-24s %12.1f %14.1f %16.2f\n", "sealed blocks", sealed_total / 1e6,
+           q_sealed * 1e9 / queries, a_sealed * 1e9 / agg_sealed);
+    printf("memory reduction %.1fx\n", (double)open_bytes / sealed_total);
+
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- shift_survivors -------------------------------------------------------
+   Purpose: Time what dropping the readings before cut costs when the
+            survivors have to be moved to the front of their columns: the
+            timestamp, value and row columns of every series are copied.
+   Returns: seconds taken
+----------------------------------------------------------------------------- */
+static double shift_survivors(const EntryCollection *ec, int cut, void *scratch) {
+    const Series *series;
+    double start = now_seconds();
+    int i, first;
+
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        for (first = 0; first < series->size && series->timestamps[first] < cut; first++) {
+        }
+        memmove(scratch, series->timestamps + first, (size_t)(series->size - first) * sizeof(int));
+        memmove(scratch, series->rows + first, (size_t)(series->size - first) * sizeof(LogEntry *));
+        if (series->type != TYPE_MOTION) {
+            memmove(scratch, (const int *)series->values.raw + first,
+                    (size_t)(series->size - first) * sizeof(int));
+        }
+    }
+    return now_seconds() - start;
+}
+
+/* ---- bench_retention -------------------------------------------------------
+   Purpose: Drop the oldest day of sensor data with retention_drop_before
+            from histories of different lengths, next to moving the
+            surviving readings to the front of their columns.
+----------------------------------------------------------------------------- */
+static void bench_retention(void) {
+    const int days[] = { 7, 28, 84 };
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    void *scratch;
+    double start, t_drop, t_shift;
+    int d, per_series, partitions, dropped;
+
+    printf("\n== retention: drop the oldest day of %d series, one reading a minute ==\n",
+           BENCH_ROOMS * NUM_TYPES);
+    printf("%-8s %12s %12s %10s %14s %16s\n", "history", "readings", "dropped", "partitions",
+           "drop (us)", "shift (us)");
+
+    scratch = malloc((size_t)days[2] * 1440 * sizeof(LogEntry *));
+    if (scratch == NULL) {
+        printf("out of memory\n");
+        return;
+    }
+
+    for (d = 0; d < 3; d++) {
+        per_series = days[d] * 1440;
+        setup_rooms(&rooms);
+        fill_sensors(&rooms, &entries, per_series);
+
+        t_shift = shift_survivors(&entries, 86400, scratch);
+        partitions = entries.num_partitions;
+        start = now_seconds();
+        dropped = retention_drop_before(&entries, 86400);
+        t_drop = now_seconds() - start;
+
+        printf("%4d days %12d %12d %4d -> %-4d %14.1f %16.1f\n", days[d], entries.size + dropped,
+               dropped, partitions, entries.num_partitions, t_drop * 1e6, t_shift * 1e6);
+
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+    }
+    free(scratch);
+}
+
+#define BENCH_REPLAY  1000000
+
+/* ---- replay_stream ---------------------------------------------------------
+   Purpose: Ingest 10^6 readings round-robin over every series, one per
+            series per second, where late_percent of them are replayed up to
+            four hours behind their series, and run a one-minute range query
+            on the series just written after every 100 readings.
+   Params:
+     - rc (in/out): rooms from setup_rooms
+     - ec (in/out): empty entry collection to fill
+     - late_percent (in): share of late readings, 0-100
+     - settle (in): non-zero to settle the series before each query, which
+                    is what a query did before reads merged the late runs
+     - found (out): readings the queries returned
+   Returns: seconds taken
+----------------------------------------------------------------------------- */
+static double replay_stream(RoomCollection *rc, EntryCollection *ec, int late_percent,
+                            int settle, long *found) {
+    const int count = BENCH_REPLAY;
+    ReadingValue value;
+    Room *room;
+    // Readings counted by the callback; the same as the queries return
+    long counted = 0;
+    double start;
+    int i, type, timestamp;
+
+    srand(22);
+    value.decibels = 40;
+    *found = 0;
+    start = now_seconds();
+    for (i = 0; i < count; i++) {
+        room = rc->rooms[i % BENCH_ROOMS];
+        type = TYPE_TEMP + (i / BENCH_ROOMS) % 3;
+        timestamp = i / (BENCH_ROOMS * 3);
+        if (rand() % 100 < late_percent) {
+            timestamp -= rand() % (4 * 3600);
+        }
+        entries_create(ec, room, type, value, timestamp);
+
+        if (i % 100 == 99) {
+            if (settle) {
+                series_settle(room->series[type - 1]);
+            }
+            *found += room_query_range(room, type, timestamp - 60, timestamp, count_reading,
+                                       &counted);
+        }
+    }
+    return now_seconds() - start;
+}
+
+/* ---- bench_lsm -------------------------------------------------------------
+   Purpose: Show that ingest cost no longer depends on how out of order the
+            readings arrive, and what range queries cost while late readings
+            are pending: merged from the sorted runs on the fly, against
+            settling the series into its columns first.
+----------------------------------------------------------------------------- */
+static void bench_lsm(void) {
+    const int late[] = { 0, 1, 10, 50 };
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    double merged, settled;
+    long found_merged, found_settled;
+    int l, i, runs;
+
+    printf("\n== lsm: 10^6 readings, some replayed up to 4 hours late, a range query per 100 ==\n");
+    printf("%8s %10s %8s %16s %16s %10s\n", "late %", "slow", "runs", "merged usec/rd",
+           "settled usec/rd", "found");
+
+    for (l = 0; l < 4; l++) {
+        setup_rooms(&rooms);
+        merged = replay_stream(&rooms, &entries, late[l], 0, &found_merged);
+        runs = 0;
+        for (i = 0; i < entries.num_series; i++) {
+            runs += entries.series[i]->num_runs;
+        }
+        printf("%8d %10lu %8d", late[l], entries.slow_inserts, runs);
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+
+        setup_rooms(&rooms);
+        settled = replay_stream(&rooms, &entries, late[l], 1, &found_settled);
+        printf(" %16.3f %16.3f %10ld%s\n", merged * 1e6 / BENCH_REPLAY,
+               settled * 1e6 / BENCH_REPLAY, found_merged,
+               found_merged == found_settled ? "" : " MISMATCH");
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+    }
+}
+
+/* ---- bench_validate --------------------------------------------------------
+   Purpose: Show that entries_validate runs in time linear in the number of
+            entries, both over plain columns and over sealed blocks.
+----------------------------------------------------------------------------- */
+static void bench_validate(void) {
+    const int counts[] = { 100000, 1000000, 10000000 };
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ValidateReport report;
+    double start, plain, sealed;
+    int c, result;
+
+    printf("\n== validate: full consistency check over sorted entries ==\n");
+    printf("%10s %16s %16s %8s\n", "entries", "columns ns/ent", "sealed ns/ent", "result");
+
+    for (c = 0; c < 3; c++) {
+        if (fill_sorted(&rooms, &entries, counts[c]) != C_ERR_OK) {
+            printf("%10d  out of memory\n", counts[c]);
+            entries_clear(&entries);
+            rooms_clear(&rooms);
+            continue;
+        }
+        start = now_seconds();
+        result = entries_validate(&rooms, &entries, VALIDATE_ALL, &report);
+        plain = now_seconds() - start;
+
+        entries_compress(&entries);
+        start = now_seconds();
+        if (result == C_ERR_OK) {
+            result = entries_validate(&rooms, &entries, VALIDATE_ALL, &report);
+        }
+        sealed = now_seconds() - start;
+
+        printf("%10d %16.1f %16.1f %8s\n", entries.size, plain * 1e9 / entries.size,
+               sealed * 1e9 / entries.size, result == C_ERR_OK ? "ok" : "FAILED");
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+    }
+}
+
+/* ---- bench_profile ---------------------------------------------------------
+   Purpose: Replay 10^6 readings, 10% of them late, then settle every series,
+            and print the ingest probes' counters. Built without
+            -DSENSOR_PROFILE it only times the replay, so running both builds
+            shows what the probes cost.
+----------------------------------------------------------------------------- */
+static void bench_profile(void) {
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ProfileCounter counters[PROFILE_POINTS];
+    double elapsed, start;
+    long found;
+    int i, enabled;
+
+    printf("\n== profile: 10^6 readings, 10%% late, then every series settled ==\n");
+    profile_reset();
+    setup_rooms(&rooms);
+    elapsed = replay_stream(&rooms, &entries, 10, 0, &found);
+    start = now_seconds();
+    for (i = 0; i < entries.num_series; i++) {
+        series_settle(entries.series[i]);
+    }
+    elapsed += now_seconds() - start;
+    enabled = profile_read(counters);
+    printf("%.3f usec per reading, probes %s\n", elapsed * 1e6 / BENCH_REPLAY,
+           enabled ? "on" : "off (build with -DSENSOR_PROFILE to count)");
+    if (enabled) {
+        profile_dump(stdout);
+    }
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+}
+
+/* ---- bench_latency ---------------------------------------------------------
+   Purpose: Show the tail latency of entries_create and of the range
+            queries while 0-50% of 10^6 readings arrive late: the memtable
+            spills and settles that averages hide. Needs -DSENSOR_PROFILE.
+----------------------------------------------------------------------------- */
+static void bench_latency(void) {
+    const int late[] = { 0, 1, 10, 50 };
+    const int ops[] = { LATENCY_CREATE, LATENCY_QUERY };
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    ProfileCounter counters[PROFILE_POINTS];
+    LatencySummary summary;
+    long found;
+    int l, o;
+
+    printf("\n== latency: 10^6 readings, some replayed up to 4 hours late, a range query per 100 ==\n");
+    if (!profile_read(counters)) {
+        printf("skipped: build with -DSENSOR_PROFILE\n");
+        return;
+    }
+    printf("%8s %-18s %10s %10s %10s %10s %12s %10s\n", "late %", "operation", "p50 ns",
+           "p99 ns", "p99.9 ns", "max ns", "mean ns", "count");
+
+    for (l = 0; l < 4; l++) {
+        latency_reset();
+        setup_rooms(&rooms);
+        replay_stream(&rooms, &entries, late[l], 0, &found);
+        for (o = 0; o < 2; o++) {
+            latency_summary(ops[o], &summary);
+            printf("%8d %-18s %10llu %10llu %10llu %10llu %12.1f %10llu\n", late[l], summary.name,
+                   summary.p50, summary.p99, summary.p999, summary.max, summary.mean,
+                   summary.count);
+        }
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+    }
+}
@@ -0,0 +1,475 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "defs.h"
+
+// Helper function declarations
+static const char* parse_int(const char *p, const char *end, int *out);
+static const char* parse_float(const char *p, const char *end, float *out);
+static const char* parse_type(const char *p, const char *end, int *type);
+static int flush_batch(CsvImport *import);
+static int import_line(CsvImport *import, const char *line, const char *end);
+
+/* Powers of ten for the float parser's fraction digits */
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+/* ---- parse_int -------------------------------------------------------------
+   Purpose: Parse an optionally signed decimal int. No locale, no whitespace
+            skipping, no other bases.
+   Params:
+     - p (in): first character
+     - end (in): end of the line
+     - out (out): the value
+   Returns: pointer past the last digit, or NULL if there are no digits or the
+            value does not fit in an int
+----------------------------------------------------------------------------- */
+static const char* parse_int(const char *p, const char *end, int *out) {
+    long long value = 0;
+    int negative = 0;
+    const char *digits;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    digits = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        if (value > 2147483648LL) {
+            return NULL;
+        }
+        p++;
+    }
+
+    if (p == digits || (!negative && value > 2147483647LL)) {
+        return NULL;
+    }
+
+    *out = (int)(negative ? -value : value);
+    return p;
+}
+
+/* ---- parse_float -----------------------------------------------------------
+   Purpose: Parse a decimal number such as -12.5 or 3e2 into a float. Up to
+            18 significant digits are used; more are read but ignored.
+   Params:
+     - p (in): first character
+     - end (in): end of the line
+     - out (out): the value
+   Returns: pointer past the number, or NULL if it has no digits or an
+            exponent out of range
+----------------------------------------------------------------------------- */
+static const char* parse_float(const char *p, const char *end, float *out) {
+    // Significant digits so far and how many of them follow the point
+    unsigned long long mantissa = 0;
+    int significant = 0;
+    int scale = 0;
+    int exponent = 0;
+    int negative = 0;
+    int any_digits = 0;
+    double value;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (significant < 18) {
+            mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+            significant += (mantissa != 0);
+        }
+        else {
+            scale--;
+        }
+        any_digits = 1;
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (significant < 18) {
+                mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+                significant += (mantissa != 0);
+                scale++;
+            }
+            any_digits = 1;
+            p++;
+        }
+    }
+
+    if (!any_digits) {
+        return NULL;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p = parse_int(p + 1, end, &exponent);
+        if (p == NULL || exponent < -60 || exponent > 60) {
+            return NULL;
+        }
+    }
+
+    // Apply the exponent in steps the table covers
+    value = (double)mantissa;
+    exponent -= scale;
+    while (exponent > 18) {
+        value *= 1e18;
+        exponent -= 18;
+    }
+    while (exponent < -18) {
+        value /= 1e18;
+        exponent += 18;
+    }
+    value = (exponent >= 0) ? value * pow10_table[exponent] : value / pow10_table[-exponent];
+
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+/* ---- parse_type ------------------------------------------------------------
+   Purpose: Parse a type field: 1, 2, 3 or TEMP, DB, MOTION.
+   Returns: pointer past the field, or NULL if it is not a type
+----------------------------------------------------------------------------- */
+static const char* parse_type(const char *p, const char *end, int *type) {
+    if (end - p >= 1 && *p >= '1' && *p <= '3') {
+        *type = *p - '0';
+        return p + 1;
+    }
+    if (end - p >= 4 && memcmp(p, "TEMP", 4) == 0) {
+        *type = TYPE_TEMP;
+        return p + 4;
+    }
+    if (end - p >= 2 && memcmp(p, "DB", 2) == 0) {
+        *type = TYPE_DB;
+        return p + 2;
+    }
+    if (end - p >= 6 && memcmp(p, "MOTION", 6) == 0) {
+        *type = TYPE_MOTION;
+        return p + 6;
+    }
+    return NULL;
+}
+
+/* ---- csv_parse_line --------------------------------------------------------
+   Purpose: Parse one line of the form room,timestamp,type,value. A motion
+            value is three fields, each 0 or 1.
+   Params:
+     - line (in): first character of the line
+     - end (in): end of the line (no newline; a trailing '\r' is allowed)
+     - reading (out): the parsed reading
+   Returns: C_ERR_OK, C_ERR_INVALID
+----------------------------------------------------------------------------- */
+int csv_parse_line(const char *line, const char *end, SensorReading *reading) {
+    const char *p;
+    const char *comma;
+    int motion, i;
+
+    if (end > line && end[-1] == '\r') {
+        end--;
+    }
+
+    comma = memchr(line, ',', (size_t)(end - line));
+    if (comma == NULL || comma == line || comma - line >= MAX_STR) {
+        return C_ERR_INVALID;
+    }
+    memcpy(reading->room_name, line, (size_t)(comma - line));
+    reading->room_name[comma - line] = '\0';
+
+    p = parse_int(comma + 1, end, &reading->timestamp);
+    if (p == NULL || p == end || *p != ',') {
+        return C_ERR_INVALID;
+    }
+
+    p = parse_type(p + 1, end, &reading->data.type);
+    if (p == NULL || p == end || *p != ',') {
+        return C_ERR_INVALID;
+    }
+    p++;
+
+    memset(&reading->data.value, 0, sizeof(reading->data.value));
+    if (reading->data.type == TYPE_TEMP) {
+        p = parse_float(p, end, &reading->data.value.temperature);
+    }
+    else if (reading->data.type == TYPE_DB) {
+        p = parse_int(p, end, &reading->data.value.decibels);
+    }
+    else {
+        for (i = 0; i < 3 && p != NULL; i++) {
+            if (i > 0) {
+                p = (p < end && *p == ',') ? p + 1 : NULL;
+            }
+            if (p != NULL) {
+                p = parse_int(p, end, &motion);
+            }
+            if (p != NULL && (motion == 0 || motion == 1)) {
+                reading->data.value.motion[i] = (unsigned char)motion;
+            }
+            else {
+                p = NULL;
+            }
+        }
+    }
+
+    return (p == end) ? C_ERR_OK : C_ERR_INVALID;
+}
+
+/* ---- csv_parse_type --------------------------------------------------------
+   Purpose: Parse a whole field as a type: 1, 2, 3 or TEMP, DB, MOTION.
+   Params:
+     - field (in): C-string to parse
+   Returns: TYPE_TEMP|TYPE_DB|TYPE_MOTION, or C_ERR_INVALID
+----------------------------------------------------------------------------- */
+int csv_parse_type(const char *field) {
+    const char *end = field + strlen(field);
+    int type;
+
+    if (parse_type(field, end, &type) != end) {
+        return C_ERR_INVALID;
+    }
+    return type;
+}
+
+/* ---- csv_write_reading -----------------------------------------------------
+   Purpose: Write one reading as a CSV line that csv_import reads back. Floats
+            are written with 9 significant digits, enough to read back the
+            same float.
+   Params:
+     - fp (in/out): stream to write to
+     - room_name, timestamp, type, value (in): the reading
+   Returns: C_ERR_OK, C_ERR_INVALID for an unknown type, C_ERR_IO
+----------------------------------------------------------------------------- */
+int csv_write_reading(FILE *fp, const char *room_name, int timestamp, int type, ReadingValue value) {
+    int written;
+
+    if (type == TYPE_TEMP) {
+        written = fprintf(fp, "%s,%d,TEMP,%.9g\n", room_name, timestamp, value.temperature);
+    }
+    else if (type == TYPE_DB) {
+        written = fprintf(fp, "%s,%d,DB,%d\n", room_name, timestamp, value.decibels);
+    }
+    else if (type == TYPE_MOTION) {
+        written = fprintf(fp, "%s,%d,MOTION,%d,%d,%d\n", room_name, timestamp,
+                          value.motion[0], value.motion[1], value.motion[2]);
+    }
+    else {
+        return C_ERR_INVALID;
+    }
+
+    return (written < 0) ? C_ERR_IO : C_ERR_OK;
+}
+
+/* ---- csv_export ------------------------------------------------------------
+   Purpose: Write every entry, in sorted order, as CSV lines. The series are
+            read front to back through a SeriesReader, which merges in the
+            late readings, in directory order, which is the sorted entry
+            order. The series are not changed.
+   Params:
+     - ec (in): entries to write
+     - fp (in/out): stream to write to
+   Returns: number of lines written, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int csv_export(const EntryCollection *ec, FILE *fp) {
+    const Series *series;
+    SeriesReader reader;
+    ReadingValue value;
+    int s, timestamp;
+    int count = 0;
+
+    if (ec == NULL || fp == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    for (s = 0; s < ec->num_series; s++) {
+        series = ec->series[s];
+        series_reader_init(&reader, series, INT_MIN);
+        while (series_reader_next(&reader, &timestamp, &value)) {
+            if (csv_write_reading(fp, series->room->name, timestamp, series->type,
+                                  value) != C_ERR_OK) {
+                return C_ERR_IO;
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* ---- flush_batch -----------------------------------------------------------
+   Purpose: Insert the readings collected so far as one batch. A batch that
+            names a room that does not exist yet changes nothing, so the
+            missing rooms are added and the batch is tried again; rooms are
+            only looked up here, not per line.
+   Params:
+     - import (in/out): import in progress
+   Returns: C_ERR_OK or the error from adding a room or the batch insert
+----------------------------------------------------------------------------- */
+static int flush_batch(CsvImport *import) {
+    int i;
+    int result;
+
+    if (import->pending == 0) {
+        return C_ERR_OK;
+    }
+
+    result = wal_entries_create_batch(import->wal, import->ec, import->rc,
+                                      import->batch, import->pending);
+    if (result == C_ERR_NOT_FOUND) {
+        for (i = 0; i < import->pending; i++) {
+            if (rooms_find(import->rc, import->batch[i].room_name) != NULL) {
+                continue;
+            }
+            result = wal_rooms_add(import->wal, import->rc, import->batch[i].room_name);
+            if (result != C_ERR_OK) {
+                import->pending = 0;
+                return result;
+            }
+            import->rooms_added++;
+        }
+        result = wal_entries_create_batch(import->wal, import->ec, import->rc,
+                                          import->batch, import->pending);
+    }
+    if (result == C_ERR_OK) {
+        import->imported += import->pending;
+    }
+    import->pending = 0;
+    return result;
+}
+
+/* ---- import_line -----------------------------------------------------------
+   Purpose: Handle one line: skip blank and comment lines, parse the rest and
+            queue the reading. A first line that does not parse is taken as a
+            column header.
+   Params:
+     - import (in/out): import in progress
+     - line, end (in): the line without its newline
+   Returns: C_ERR_OK, or an error that stops the import
+----------------------------------------------------------------------------- */
+static int import_line(CsvImport *import, const char *line, const char *end) {
+    SensorReading *reading = &import->batch[import->pending];
+
+    import->lines++;
+    if (line == end || *line == '#' || (end - line == 1 && *line == '\r')) {
+        return C_ERR_OK;
+    }
+
+    if (csv_parse_line(line, end, reading) != C_ERR_OK) {
+        if (import->lines > 1) {
+            import->rejected++;
+            if (import->first_rejected == 0) {
+                import->first_rejected = import->lines;
+            }
+        }
+        return C_ERR_OK;
+    }
+
+    import->pending++;
+    return (import->pending == CSV_BATCH_SIZE) ? flush_batch(import) : C_ERR_OK;
+}
+
+/* ---- csv_import ------------------------------------------------------------
+   Purpose: Bulk-load readings from a CSV file. The file is read in large
+            blocks and each line is parsed in place with the parsers above
+            (no stdio, no locale); readings are inserted CSV_BATCH_SIZE at a
+            time with entries_create_batch. Rooms that do not exist yet are
+            added. Lines that do not parse are counted and skipped.
+   Params:
+     - import (in/out): wal, rc and ec set by the caller (wal may be NULL);
+                        the counters are filled in
+     - path (in): file to read
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO, C_ERR_NO_MEMORY, or the first
+            error from adding a room or a batch (readings before it stay)
+----------------------------------------------------------------------------- */
+int csv_import(CsvImport *import, const char *path) {
+    char *buffer;
+    char *line;
+    char *newline;
+    // Bytes in buffer, and whether the rest of an overlong line is being skipped
+    size_t filled = 0;
+    int skipping = 0;
+    int at_end = 0;
+    ssize_t got;
+    int fd;
+    int result = C_ERR_OK;
+
+    if (import == NULL || path == NULL || import->rc == NULL || import->ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    import->lines = 0;
+    import->imported = 0;
+    import->rejected = 0;
+    import->first_rejected = 0;
+    import->rooms_added = 0;
+    import->pending = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return C_ERR_IO;
+    }
+
+    buffer = malloc(CSV_READ_SIZE);
+    import->batch = malloc(CSV_BATCH_SIZE * sizeof(SensorReading));
+    if (buffer == NULL || import->batch == NULL) {
+        result = C_ERR_NO_MEMORY;
+    }
+
+    while (result == C_ERR_OK && !at_end) {
+        got = read(fd, buffer + filled, CSV_READ_SIZE - filled);
+        if (got < 0) {
+            if (errno != EINTR) {
+                result = C_ERR_IO;
+            }
+            continue;
+        }
+        at_end = (got == 0);
+        filled += (size_t)got;
+
+        // Every complete line in the buffer
+        line = buffer;
+        while (result == C_ERR_OK &&
+               (newline = memchr(line, '\n', filled - (size_t)(line - buffer))) != NULL) {
+            if (!skipping) {
+                result = import_line(import, line, newline);
+            }
+            skipping = 0;
+            line = newline + 1;
+        }
+
+        // The last line may have no newline
+        if (result == C_ERR_OK && at_end && line < buffer + filled && !skipping) {
+            result = import_line(import, line, buffer + filled);
+            line = buffer + filled;
+        }
+
+        // Keep a partial line for the next read; one that fills the whole
+        // buffer is far too long to be a reading
+        filled -= (size_t)(line - buffer);
+        memmove(buffer, line, filled);
+        if (filled == CSV_READ_SIZE) {
+            if (!skipping) {
+                import->lines++;
+                import->rejected++;
+                if (import->first_rejected == 0) {
+                    import->first_rejected = import->lines;
+                }
+            }
+            skipping = 1;
+            filled = 0;
+        }
+    }
+
+    if (result == C_ERR_OK) {
+        result = flush_batch(import);
+    }
+
+    close(fd);
+    free(buffer);
+    free(import->batch);
+    import->batch = NULL;
+    return result;
+}
@@ -2,10 +2,21 @@
 #define DEFS_H
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #define MAX_ARR   16
 #define MAX_STR   32
+#define MAX_PATH_STR  256    /* file names given to the log and snapshots */
+
+#define ENTRY_CHUNK_SIZE  4096   /* most LogEntry slots in one storage chunk */
+#define ENTRY_CHUNK_FIRST    8   /* slots in a partition's first chunk */
+#define ENTRY_PARTITION_WIDTH  3600   /* default timestamps per partition (an hour) */
+
+/* Slots in chunk k of a partition: the chunks double from ENTRY_CHUNK_FIRST
+   up to ENTRY_CHUNK_SIZE, so a sparsely used partition stays small */
+#define ENTRY_CHUNK_SLOTS(k)  ((k) < 9 ? ENTRY_CHUNK_FIRST << (k) : ENTRY_CHUNK_SIZE)
 
 #define C_ERR_OK          0
 #define C_ERR_NULL_PTR   -1
@@ -13,15 +24,21 @@
 #define C_ERR_NOT_FOUND  -3
 #define C_ERR_DUPLICATE  -4
 #define C_ERR_INVALID    -5
+#define C_ERR_NO_MEMORY  -6
+#define C_ERR_IO         -7
 #define C_ERR_NOT_IMPLEMENTED -99 // No function should return this by the end of your assignment
 
 /* NOTE: Enumerated Data Types might be better for this, but we have not discussed these. */
 #define TYPE_TEMP    1
 #define TYPE_DB      2
 #define TYPE_MOTION  3
+#define NUM_TYPES    3
 
 typedef struct Room     Room;
 typedef struct LogEntry LogEntry;
+typedef struct Series Series;
+typedef struct SeriesBlock SeriesBlock;
+typedef struct RollingStats RollingStats;
 
 typedef union {
     float         temperature;   /* °C */
@@ -34,30 +51,413 @@ typedef struct {
     ReadingValue value;
 } Reading;
 
-/* One log entry belongs to a room and has a timestamp */
+/* Packed sort key: room id (24 bits) | type (8 bits) | timestamp (32 bits,
+   sign bit flipped so negative timestamps sort first), the widths of the
+   LogEntry fields. Comparing two keys as unsigned integers gives the
+   room -> type -> timestamp order. entry_cmp compares the keys of entries
+   of one room, and the rooms' positions in name order otherwise. */
+#define ENTRY_ROOM_BITS       24
+#define ENTRY_KEY_ROOM_SHIFT  40
+#define ENTRY_KEY_TYPE_SHIFT  32
+#define ENTRY_KEY(room_id, type, timestamp)                                  \
+    (((unsigned long long)(room_id) << ENTRY_KEY_ROOM_SHIFT) |               \
+     ((unsigned long long)(type) << ENTRY_KEY_TYPE_SHIFT) |                  \
+     (unsigned long long)((unsigned int)(timestamp) ^ 0x80000000u))
+
+/* One log entry, packed into 12 bytes: the room is stored as its id (its
+   position in RoomCollection.rooms, which never changes) instead of a
+   pointer, next to a one-byte type tag, so five entries fit in a 64-byte
+   cache line and the readings of one series can be ordered from their own
+   fields (ENTRY_KEY_OF). Adding a room never rewrites an entry. entry_room
+   looks the room up. rooms_add refuses a room whose id would not fit. */
+#define ENTRY_MAX_ROOMS  (1 << ENTRY_ROOM_BITS)
 struct LogEntry {
-    Reading  data;
-    Room    *room;
-    int      timestamp;
+    unsigned int room : ENTRY_ROOM_BITS;  /* Room.seq */
+    unsigned int type : 8;       /* TYPE_* */
+    int          timestamp;
+    ReadingValue value;
+};
+
+#define ENTRY_KEY_OF(e)  ENTRY_KEY((e)->room, (e)->type, (e)->timestamp)
+
+/* Motion values are stored as bits: one plane per direction (left,
+   forward, right), interleaved per 64 readings, so reading i is bit i % 64
+   of word MOTION_PLANES * (i / 64) + direction. Bits past the last reading
+   are zero. */
+#define MOTION_PLANES    3
+#define MOTION_WORDS(n)  (MOTION_PLANES * (((size_t)(n) + 63) / 64))
+
+/* A B+tree of LogEntry pointers keyed by timestamp, holding the readings of
+   one series that arrived older than its newest (see Series.late). Every
+   node is BTREE_NODE_BYTES, four cache lines, and aligned to a line; inner
+   nodes hold only keys and child pointers, and the leaves are linked in key
+   order so they can be read front to back without the inner nodes. Equal
+   keys keep the order they were inserted in. */
+#define BTREE_NODE_BYTES  256
+#define BTREE_LEAF_KEYS    20    /* readings per leaf */
+#define BTREE_FANOUT       21    /* children per inner node */
+#define BTREE_MAX_HEIGHT   16    /* inner levels; 21^16 is far past INT_MAX readings */
+
+typedef struct BTreeLeaf BTreeLeaf;
+struct BTreeLeaf {
+    int        count;
+    int        keys[BTREE_LEAF_KEYS];      /* ascending */
+    LogEntry  *entries[BTREE_LEAF_KEYS];
+    BTreeLeaf *next;
+};
+
+typedef struct {
+    int        count;                      /* children */
+    int        keys[BTREE_FANOUT - 1];     /* keys[i] is the first key under children[i + 1] */
+    void      *children[BTREE_FANOUT];     /* leaves at height 1, else inner nodes */
+} BTreeInner;
+
+typedef struct {
+    void      *root;         /* a leaf while height is 0, NULL when empty */
+    BTreeLeaf *first;        /* leftmost leaf */
+    int        height;       /* inner levels above the leaves */
+    int        count;        /* entries held */
+    int        nodes;
+} BTree;
+
+/* Late readings of a series are kept LSM-style. The B+tree is the
+   memtable; when it holds LSM_MEMTABLE_KEYS readings it is frozen into an
+   immutable sorted run, and the new run is merged with the one before it
+   while that one is at most LSM_RUN_RATIO times its size, so run sizes fall
+   by more than that factor from the oldest to the newest and a reading is
+   merged O(log) times. Runs and memtable go into the columns once the runs
+   hold as many readings as the columns, or when a batch, compression,
+   retention or a snapshot needs the columns whole (series_settle). Readers
+   never settle: SeriesReader merges them on the fly. */
+#define LSM_MEMTABLE_KEYS  1024
+#define LSM_RUN_RATIO      2
+#define LSM_MAX_RUNS       24    /* 1024 << 21 is past INT_MAX readings */
+
+/* A frozen memtable, or several merged: late readings of one series in
+   timestamp order, equal timestamps in arrival order. Never changed. */
+typedef struct {
+    int        count;
+    int       *timestamps;
+    LogEntry **entries;
+} SortedRun;
+
+/* The readings of one (room, type) pair stored column-wise and sorted by
+   timestamp: timestamps[i], the i-th value column element and rows[i] all
+   describe the same reading. Scans over one room's readings only touch the
+   columns. Series are owned by the EntryCollection; a room holds handles to
+   its own. After entries_compress the oldest readings may instead be sealed
+   in blocks, so a series holds sealed + size readings: the blocks' first,
+   then the columns', which are never older than the last sealed one.
+   SeriesReader reads both. retention_drop_before drops readings from the
+   front without moving the rest: the timestamp, row and temperature or
+   decibel columns then start offset elements into their allocations, and
+   reading i's motion bits are bit offset + i of the planes, until the
+   columns next grow. A reading older than the newest in the columns is not
+   shifted in: it waits in the late memtable or a sorted run (see
+   LSM_MEMTABLE_KEYS), and series_settle merges all of them into the
+   columns in one pass. Late readings are never older than the last sealed
+   one. */
+struct Series {
+    Room      *room;
+    int        type;
+    int       *timestamps;
+    union {
+        float         *temperature;      /* TYPE_TEMP */
+        int           *decibels;         /* TYPE_DB */
+        unsigned long long *motion;      /* TYPE_MOTION, MOTION_WORDS(capacity) bitplane words */
+        void          *raw;
+    } values;
+    LogEntry **rows;         /* the stored entry of each reading, for the row views */
+    int        size;
+    int        capacity;
+    int        mapped;       /* columns are read-only in a snapshot mapping and rows is
+                                NULL; copied to owned storage on the first change */
+    SeriesBlock **blocks;    /* sealed readings, oldest first */
+    int        num_blocks;
+    int        sealed;       /* readings in blocks */
+    int        offset;       /* readings dropped from the front of the columns */
+    BTree      late;         /* memtable of out-of-order readings not yet in the columns */
+    SortedRun *runs;         /* frozen memtables, oldest first; LSM_MAX_RUNS slots */
+    int        num_runs;
+    int        run_readings; /* readings in runs */
 };
 
-/* One room has a name and a collection of pointers to its log entries */
+/* An immutable, compressed run of up to SERIES_BLOCK_SIZE readings of one
+   series. Timestamps are a bit stream of delta-of-deltas, which is one bit
+   per reading for a sensor reporting at a steady interval. Values come
+   first in data: temperatures as a bit stream of XORs with the previous
+   value (Gorilla coding), decibels as zig-zag varint deltas and motion as
+   the usual bitplanes, which line up because the block size is a multiple
+   of 64. Blocks are decoded front to back, so first and last are all a
+   search can use. */
+#define SERIES_BLOCK_SIZE  1024
+struct SeriesBlock {
+    int          count;
+    int          first;          /* first and last timestamp */
+    int          last;
+    unsigned int value_bytes;    /* where the timestamp stream starts in data */
+    unsigned int bytes;          /* used bytes of data */
+    unsigned long long data[];
+};
+
+/* Bits of a block stream, most significant first */
+typedef struct {
+    const unsigned char *next;
+    const unsigned char *end;
+    unsigned long long   bits;
+    int                  count;  /* unread bits held in bits */
+} BitReader;
+
+/* Reads a series in timestamp order from a starting timestamp, decoding the
+   sealed blocks as it goes and then reading the columns, merged with the
+   late runs and memtable. It holds the next reading (timestamp, value)
+   while ready is set. The series must not change while it is read. */
+typedef struct {
+    const Series *series;
+    int          block;          /* block being decoded, num_blocks in the columns */
+    int          index;          /* readings decoded from that block */
+    int          pos;            /* next column position */
+    int          run_pos[LSM_MAX_RUNS];  /* next reading of each run */
+    const BTreeLeaf *leaf;       /* next memtable reading: leaf and slot, */
+    int          slot;           /* leaf NULL at the end */
+    BitReader    times;
+    BitReader    temps;          /* TYPE_TEMP */
+    const unsigned char *varint; /* next decibel delta, TYPE_DB */
+    long long    delta;          /* last timestamp delta */
+    int          leading;        /* zero bits before and after the */
+    int          trailing;       /* last XOR window, TYPE_TEMP */
+    int          ready;
+    int          timestamp;
+    ReadingValue value;
+    const LogEntry *entry;       /* stored entry of the reading; NULL if sealed or mapped */
+} SeriesReader;
+
+/* One room has a name and one series of readings per reading type */
 struct Room {
-    char      name[MAX_STR];
-    LogEntry* entries[MAX_ARR];
-    int       size;
+    char       name[MAX_STR];
+    unsigned int hash;       /* hash of name, cached for the room index */
+    int        id;           /* position in name order, see RoomCollection.sorted */
+    int        seq;          /* position in RoomCollection.rooms, never changes */
+    Series    *series[NUM_TYPES];  /* indexed by type - 1, NULL until the first entry */
+    RollingStats *rolling[NUM_TYPES];  /* indexed by type - 1, NULL unless configured */
+    int        size;         /* entries across all series */
 };
 
+/* Ring buffer of series positions, used as a double-ended queue */
 typedef struct {
-    Room rooms[MAX_ARR];
+    int *items;
+    int  head;
     int  size;
+    int  capacity;
+} IndexDeque;
+
+/* Statistics over the readings of one series in the last 'window' timestamps,
+   (newest - window, newest], updated by entries_create. The readings in the
+   window are series positions head .. size-1; min_q and max_q are monotonic
+   deques of those positions whose fronts are the window's min and max. */
+struct RollingStats {
+    int        window;
+    int        head;
+    int        count;
+    double     sum;
+    IndexDeque min_q;        /* values increase from front to back */
+    IndexDeque max_q;        /* values decrease from front to back */
+};
+
+/* Rooms are allocated one at a time so a Room* stays valid as the collection
+   grows. index is an open-addressing hash table (linear probing, at most half
+   full) holding positions in rooms, with -1 marking an empty slot. sorted
+   holds the same rooms in name order; a room's id is its position there and
+   is renumbered when a name that sorts before it is added, while entries
+   refer to the room by its seq, its position in rooms. */
+typedef struct {
+    Room **rooms;            /* in the order they were added */
+    Room **sorted;           /* in name order, sorted[r->id] == r */
+    int    size;
+    int    capacity;
+    int   *index;
+    int    index_cap;        /* power of two */
 } RoomCollection;
 
+/* One reading as delivered by a gateway, naming the room it belongs to */
+typedef struct {
+    char    room_name[MAX_STR];
+    int     timestamp;
+    Reading data;
+} SensorReading;
+
+/* The storage of the entries whose timestamps fall in one time partition,
+   [start, start + width). Its chunks are never moved once allocated and
+   hold ENTRY_CHUNK_SLOTS(k) entries each, so dropping the partition is one
+   free per chunk. */
+typedef struct {
+    long long  start;        /* a multiple of the partition width */
+    LogEntry **chunks;
+    int        num_chunks;
+    int        chunk_cap;
+    int        tail;         /* slots used in the last chunk */
+    int        slots;        /* slots used in all of them */
+} EntryPartition;
+
+/* Entries are stored by time partition (see EntryPartition), so a LogEntry
+   keeps its address until entries_compress drops the entries of the
+   readings it seals and packs the rest into fresh chunks, or
+   retention_drop_before frees its partition. Partitions are kept in the
+   order they were first used; partition_index is an open-addressing hash
+   table (linear probing, at most half full, like the room index) from a
+   partition's start to its position, with -1 marking an empty slot, so
+   readings spread over many partitions do not shift the directory. The
+   sorted order is kept per (room, type) series: series is a directory
+   ordered by room id then type, and reading the series in that order gives
+   the full room -> type -> timestamp order (see EntryCursor). */
 typedef struct {
-    LogEntry entries[MAX_ARR];
-    int      size;
+    EntryPartition *partitions;  /* in the order they were first used */
+    int        num_partitions;
+    int        partition_cap;
+    int       *partition_index;
+    int        partition_index_cap;  /* power of two */
+    int        partition_width;  /* 0 for ENTRY_PARTITION_WIDTH; only set while empty */
+    int        last_partition;   /* where the last entry went, checked first */
+    Series   **series;
+    int        num_series;
+    int        series_cap;
+    int        size;
+    int        slots;        /* LogEntry slots used; mapped series have none */
+    void      *mapping;      /* snapshot the mapped series point into, or NULL */
+    size_t     mapping_size;
+    unsigned long comparisons;   /* key comparisons made while locating insert positions */
+    unsigned long fast_appends;  /* entries that went straight onto the end of their series */
+    unsigned long slow_inserts;  /* out-of-order entries, put in a late memtable */
 } EntryCollection;
 
+/* Called by room_query_range for each reading in range, in timestamp order.
+   A non-zero return stops the query. */
+typedef int (*RangeCallback)(const Room *room, int type, int timestamp,
+                             ReadingValue value, void *ctx);
+
+/* Summary of the readings in one time bucket. For motion, each reading
+   counts as the number of directions (0-3) that saw movement. */
+typedef struct {
+    long long start;         /* first timestamp of the bucket */
+    int       count;
+    double    sum;
+    double    min;
+    double    max;
+    double    mean;
+} Aggregate;
+
+/* Motion readings in a time range counted by direction. any / readings is
+   the share of readings that saw movement. */
+typedef struct {
+    int readings;
+    int any;                 /* readings with movement in at least one direction */
+    int left;
+    int forward;
+    int right;
+} MotionSummary;
+
+/* Called by room_aggregate for each non-empty bucket, in time order.
+   A non-zero return stops the pass. */
+typedef int (*AggregateCallback)(const Room *room, int type, const Aggregate *bucket,
+                                 void *ctx);
+
+/* Walks every entry of an EntryCollection in sorted order. Mapped series
+   and sealed readings have no stored entries, so they are returned in row,
+   which is only valid until the next call; so are the readings of a series
+   with late ones, which come merged through the reader. */
+typedef struct {
+    const EntryCollection *ec;
+    int series;
+    int pos;
+    LogEntry row;
+    SeriesReader reader;     /* over the sealed or late readings of the current series */
+} EntryCursor;
+
+/* Invariants entries_validate checks */
+#define VALIDATE_ORDER  1    /* rooms, series and readings in room -> type -> timestamp order */
+#define VALIDATE_ROOMS  2    /* each stored entry in exactly one series, pointing back to it,
+                                and the room and collection sizes add up */
+#define VALIDATE_ALL    (VALIDATE_ORDER | VALIDATE_ROOMS)
+
+/* The first violation entries_validate found. room and type name the
+   series it is in (-1 and 0 for one outside any series), and position the
+   reading in that series, sealed ones first (-1 if not about a reading). */
+typedef struct {
+    int       check;         /* VALIDATE_ORDER or VALIDATE_ROOMS, 0 if none was found */
+    int       room;          /* Room.id */
+    int       type;
+    long long position;
+    char      message[160];
+} ValidateReport;
+
+/* Probes on the ingest path, counted only in builds with -DSENSOR_PROFILE;
+   otherwise they compile to nothing. Cycles are read with rdtsc (clock
+   nanoseconds off x86) and include the probes called inside, so
+   entries_create's cycles cover everything below it. */
+#define PROFILE_CREATE   0    /* entries_create, per reading stored */
+#define PROFILE_BATCH    1    /* entries_create_batch; moved = readings */
+#define PROFILE_APPEND   2    /* the entries_create calls that appended (fast path) */
+#define PROFILE_LOCATE   3    /* btree_insert of a late reading into the memtable */
+#define PROFILE_FREEZE   4    /* memtable_freeze; moved = readings copied to the run */
+#define PROFILE_MERGE    5    /* run_merge; moved = readings in the merged run */
+#define PROFILE_SETTLE   6    /* series_settle with late readings to merge */
+#define PROFILE_SHIFT    7    /* shift_entries_right; moved = column readings moved */
+#define PROFILE_CMP      8    /* entry_cmp */
+#define PROFILE_POINTS   9
+#define PROFILE_DEFAULT_PATH  "profile.csv"
+
+typedef struct {
+    const char        *name;         /* function the probe sits in */
+    unsigned long long calls;
+    unsigned long long moved;        /* readings or entries moved */
+    unsigned long long comparisons;  /* key comparisons */
+    unsigned long long cycles;
+} ProfileCounter;
+
+/* Operations whose latency is recorded, also only with -DSENSOR_PROFILE, in
+   fixed-size log-linear histograms of nanoseconds: a bucket per value below
+   2^LATENCY_SUB_BITS, then 2^LATENCY_SUB_BITS buckets per power of two, so
+   a percentile is within 1/128 of the true value. Longer times count as
+   2^LATENCY_MAX_BITS - 1 ns (about 18 minutes). Only calls that succeed
+   are recorded. */
+#define LATENCY_ROOMS_ADD  0    /* rooms_add */
+#define LATENCY_CREATE     1    /* entries_create */
+#define LATENCY_QUERY      2    /* room_query_range, callbacks included */
+#define LATENCY_AGGREGATE  3    /* room_aggregate, callbacks included */
+#define LATENCY_PRINT      4    /* room_print or render_room, one room */
+#define LATENCY_OPS        5
+#define LATENCY_SUB_BITS   7
+#define LATENCY_MAX_BITS   40
+#define LATENCY_BUCKETS    ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+#define LATENCY_DEFAULT_PATH  "latency.csv"
+
+/* Percentiles of one operation's histogram, in nanoseconds; each one is the
+   top of its bucket, capped at max */
+typedef struct {
+    const char        *name;         /* function measured */
+    unsigned long long count;
+    unsigned long long min;
+    unsigned long long p50;
+    unsigned long long p90;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+    double             mean;
+} LatencySummary;
+
+/* Formats entry table rows into a caller-owned buffer and writes each full
+   block to fp with one fwrite. The text is byte-identical to entry_print and
+   room_print. Call render_flush before writing to fp any other way. */
+#define RENDER_BUFFER_SIZE  65536
+#define RENDER_MAX_LINE     128    /* longest row or header, with room for a
+                                      %.2f of the largest float */
+typedef struct {
+    FILE   *fp;
+    char   *buffer;
+    size_t  capacity;
+    size_t  used;
+} RenderBuffer;
+
 
 int rooms_add(RoomCollection *rc, const char *room_name);
 int entries_create(EntryCollection *ec,
@@ -65,16 +465,202 @@ int entries_create(EntryCollection *ec,
                 int              type,
                 ReadingValue     value,
                 int              timestamp);
+int entries_create_batch(EntryCollection *ec, RoomCollection *rc,
+                         const SensorReading *readings, int count);
 
 Room* rooms_find(RoomCollection *rc, const char *room_name);
 int room_print(const Room *r);
-int entry_print(const LogEntry *e);
-int entry_cmp(const LogEntry *a, const LogEntry *b);
+int room_query_range(const Room *room, int type, int t_from, int t_to,
+                     RangeCallback callback, void *ctx);
+int room_aggregate(const Room *room, int type, int t_from, int t_to, int width,
+                   AggregateCallback callback, void *ctx);
+int room_rolling_configure(Room *room, int type, int window);
+int room_rolling(const Room *room, int type, Aggregate *out);
+int room_motion_summary(const Room *room, int t_from, int t_to, MotionSummary *out);
+int entry_print(const RoomCollection *rc, const LogEntry *e);
+Room* entry_room(const RoomCollection *rc, const LogEntry *e);
+int reading_print(const char *room_name, int timestamp, int type, ReadingValue value);
+int render_init(RenderBuffer *rb, FILE *fp, char *buffer, size_t capacity);
+int render_text(RenderBuffer *rb, const char *text);
+int render_reading(RenderBuffer *rb, const char *room_name, int timestamp, int type,
+                   ReadingValue value);
+int render_entry(RenderBuffer *rb, const RoomCollection *rc, const LogEntry *e);
+int render_room(RenderBuffer *rb, const Room *r);
+int render_flush(RenderBuffer *rb);
+int entry_cmp(const RoomCollection *rc, const LogEntry *a, const LogEntry *b);
+int rooms_clear(RoomCollection *rc);
+int entries_clear(EntryCollection *ec);
+int entries_cursor_init(EntryCursor *cursor, const EntryCollection *ec);
+LogEntry* entries_cursor_next(EntryCursor *cursor);
+int entries_validate(const RoomCollection *rc, const EntryCollection *ec, int checks,
+                     ValidateReport *report);
+ReadingValue series_value(const Series *series, int i);
+int entries_map_series(EntryCollection *ec, Room *room, int type,
+                       const int *timestamps, const void *values, int size);
+int series_reader_init(SeriesReader *reader, const Series *series, int t_from);
+int series_reader_next(SeriesReader *reader, int *timestamp, ReadingValue *value);
+int series_decode(const Series *series, int *timestamps, void *values, int late);
+int series_settle(Series *series);
+int entries_compress(EntryCollection *ec);
+int retention_drop_before(EntryCollection *ec, int timestamp);
+size_t entries_memory(const EntryCollection *ec);
+int profile_read(ProfileCounter *counters);
+void profile_reset(void);
+int profile_dump(FILE *fp);
+int latency_summary(int op, LatencySummary *summary);
+void latency_reset(void);
+int latency_dump(FILE *fp, int buckets);
+
+
+/* =========================================
+   Write-ahead log (wal.c)
+   =========================================
+   Every rooms_add, entries_create and retention_drop_before made through
+   wal_rooms_add, wal_entries_create and wal_retention_drop_before is appended to a log file as a compact binary record;
+   wal_replay rebuilds the collections from it on startup. Records are
+   buffered and made durable together (group commit): the buffer is written
+   and fsync'ed once group_records records are pending, or when a record or
+   wal_poll finds the oldest pending record older than group_ms; the menu
+   also commits before it waits for input. A crash loses at most the records
+   of one commit window.
+
+   Record layout (little-endian), each followed by a 32-bit FNV-1a checksum
+   of the kind byte and payload:
+     WAL_RECORD_ROOM   name length (1 byte), name bytes
+     WAL_RECORD_ENTRY  room seq (4), type (1), timestamp (4), value (4)
+     WAL_RECORD_CLEAR  no payload; both collections are emptied
+     WAL_RECORD_RETENTION  timestamp (4); retention_drop_before is applied
+     WAL_RECORD_SNAPSHOT  path length (1), path; the collections are replaced
+                       by the snapshot at path (written by wal_checkpoint,
+                       which starts a new log with this record)
+   ========================================= */
+#define WAL_DEFAULT_PATH     "sensors.wal"
+#define WAL_BUFFER_SIZE      65536
+#define WAL_GROUP_RECORDS    64     /* default records per commit */
+#define WAL_GROUP_MS         50     /* default longest wait before a commit */
+
+#define WAL_RECORD_ROOM      'R'
+#define WAL_RECORD_ENTRY     'E'
+#define WAL_RECORD_CLEAR     'C'
+#define WAL_RECORD_SNAPSHOT  'S'
+#define WAL_RECORD_RETENTION 'D'
+
+typedef struct {
+    int           fd;
+    char          path[MAX_PATH_STR];
+    int           group_records;
+    int           group_ms;
+    int           pending;          /* records not yet fsync'ed */
+    double        pending_since;    /* monotonic time of the oldest pending record */
+    int           used;             /* bytes in buffer */
+    unsigned char buffer[WAL_BUFFER_SIZE];
+    unsigned long records;          /* records appended since wal_open */
+    unsigned long commits;          /* fsyncs since wal_open */
+    unsigned long replayed;         /* records applied by wal_replay */
+} WriteAheadLog;
+
+int wal_open(WriteAheadLog *wal, const char *path, int group_records, int group_ms);
+int wal_replay(WriteAheadLog *wal, RoomCollection *rc, EntryCollection *ec);
+int wal_rooms_add(WriteAheadLog *wal, RoomCollection *rc, const char *room_name);
+int wal_entries_create(WriteAheadLog *wal, EntryCollection *ec, Room *room,
+                       int type, ReadingValue value, int timestamp);
+int wal_entries_create_batch(WriteAheadLog *wal, EntryCollection *ec, RoomCollection *rc,
+                             const SensorReading *readings, int count);
+int wal_retention_drop_before(WriteAheadLog *wal, EntryCollection *ec, int timestamp);
+int wal_log_snapshot(WriteAheadLog *wal, const RoomCollection *rc, const EntryCollection *ec);
+int wal_poll(WriteAheadLog *wal);
+int wal_checkpoint(WriteAheadLog *wal, const char *snapshot_path);
+int wal_commit(WriteAheadLog *wal);
+int wal_close(WriteAheadLog *wal);
+
+
+/* =========================================
+   Snapshots (snapshot.c)
+   =========================================
+   A snapshot is the collections' series columns written out as they are in
+   memory (sealed readings decoded back into them), with every reference
+   stored as a file offset. snapshot_open maps
+   the file and points the series straight at their columns, so opening
+   costs one pass over the rooms and series, not over the readings. Mapped
+   series are copied into owned storage only when they first change. If
+   the file cannot be opened the collections are left as they were.
+
+   Layout (native byte order and alignment; the header records both):
+     header       magic "SSNP", version, byte order mark, counts, offsets
+     room table   one name per room, in RoomCollection.rooms order
+     series table room (index into the room table), type, size and the
+                  offsets of the timestamp and value columns, ordered by
+                  room name then type
+     columns      each column starts on an 8-byte boundary; motion columns
+                  are MOTION_WORDS(size) bitplane words (version 2)
+   ========================================= */
+#define SNAPSHOT_DEFAULT_PATH  "sensors.snap"
+#define SNAPSHOT_VERSION       2
+
+int snapshot_save(const char *path, const RoomCollection *rc, const EntryCollection *ec);
+int snapshot_open(const char *path, RoomCollection *rc, EntryCollection *ec);
+
+
+/* =========================================
+   CSV import and export (csv.c)
+   =========================================
+   Bulk loading of lines of the form
+
+     room,timestamp,type,value
+
+   where type is 1, 2, 3 or TEMP, DB, MOTION and a motion value is three
+   fields of 0 or 1 (e.g. "Hall,1000,MOTION,1,0,1"). Blank lines and lines
+   starting with '#' are skipped. The file is read in CSV_READ_SIZE blocks
+   and parsed in place without stdio; readings go in through
+   entries_create_batch, CSV_BATCH_SIZE at a time. csv_export writes the
+   same format.
+   ========================================= */
+#define CSV_DEFAULT_PATH  "readings.csv"
+#define CSV_READ_SIZE     (1 << 20)
+#define CSV_BATCH_SIZE    65536
+
+typedef struct {
+    WriteAheadLog   *wal;           /* log for new rooms and readings, or NULL */
+    RoomCollection  *rc;
+    EntryCollection *ec;
+    long           lines;           /* lines read, including skipped ones */
+    long           imported;
+    long           rejected;        /* lines that did not parse */
+    long           first_rejected;  /* line number of the first of them, 0 if none */
+    int            rooms_added;
+    SensorReading *batch;           /* readings waiting for the next batch insert */
+    int            pending;
+} CsvImport;
+
+int csv_import(CsvImport *import, const char *path);
+int csv_parse_line(const char *line, const char *end, SensorReading *reading);
+int csv_parse_type(const char *field);
+int csv_write_reading(FILE *fp, const char *room_name, int timestamp, int type, ReadingValue value);
+int csv_export(const EntryCollection *ec, FILE *fp);
+
+
+/* =========================================
+   Script mode (script.c)
+   =========================================
+   Runs commands from a file or stdin without the menu: one command per
+   line, a word followed by comma-separated arguments (see README). Results
+   are written to stdout as CSV lines, errors to stderr with the line number.
+   ========================================= */
+#define SCRIPT_MAX_LINE   1024
+
+int script_run(FILE *in, const char *name, WriteAheadLog *wal,
+               RoomCollection *rc, EntryCollection *ec);
 
 
 /* =========================================
    Loader (provided as an object file)
    =========================================
+   loader.o was compiled against the original fixed-size collections, so it
+   reads and writes the Loader* mirror types below. loader_import copies its
+   output into the real collections and loader_export builds a fixed-size copy
+   for the loader tests (C_ERR_FULL_ARRAY if it does not fit in MAX_ARR). The
+   menu tests use entries_validate, which has no size limit.
+
    load_sample: Override the contents of the collections with sample data.
     - rc (out): room collection
     - ec (out): entry collection
@@ -90,8 +676,37 @@ int entry_cmp(const LogEntry *a, const LogEntry *b);
     - verbose (in): if non-zero, print out errors as we find them
     - Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID (invalid means there is a problem with the room/entry linkage)
    ========================================= */
-int load_sample(RoomCollection *rc, EntryCollection *ec);
-int loader_test_order(const EntryCollection *ec, int verbose);
-int loader_test_rooms(const EntryCollection *ec, const RoomCollection *rc, int verbose);
+typedef struct LoaderRoom LoaderRoom;
+
+typedef struct {
+    Reading     data;
+    LoaderRoom *room;
+    int         timestamp;
+} LoaderEntry;
+
+struct LoaderRoom {
+    char         name[MAX_STR];
+    LoaderEntry* entries[MAX_ARR];
+    int          size;
+};
+
+typedef struct {
+    LoaderRoom rooms[MAX_ARR];
+    int        size;
+} LoaderRoomCollection;
+
+typedef struct {
+    LoaderEntry entries[MAX_ARR];
+    int         size;
+} LoaderEntryCollection;
+
+int load_sample(LoaderRoomCollection *rc, LoaderEntryCollection *ec);
+int loader_test_order(const LoaderEntryCollection *ec, int verbose);
+int loader_test_rooms(const LoaderEntryCollection *ec, const LoaderRoomCollection *rc, int verbose);
+
+int loader_import(RoomCollection *rc, EntryCollection *ec,
+                  const LoaderRoomCollection *lrc, const LoaderEntryCollection *lec);
+int loader_export(const RoomCollection *rc, const EntryCollection *ec,
+                  LoaderRoomCollection *lrc, LoaderEntryCollection *lec);
 
 #endif /* DEFS_H */
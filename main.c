@@ -4,22 +4,70 @@
 static void print_menu(int* choice);
 
 /* Helper function declarations */
-static void handle_load_sample(RoomCollection *rooms, EntryCollection *entries);
-static void handle_print_entries(const EntryCollection *entries);
+static void handle_load_sample(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries);
+static void handle_print_entries(const RoomCollection *rooms, const EntryCollection *entries);
 static void handle_print_rooms(const RoomCollection *rooms);
-static void handle_add_room(RoomCollection *rooms);
-static void handle_add_entry(RoomCollection *rooms, EntryCollection *entries);
-static void handle_test_order(const EntryCollection *entries);
+static void handle_add_room(WriteAheadLog *wal, RoomCollection *rooms);
+static void handle_add_entry(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries);
+static void handle_test_order(const RoomCollection *rooms, const EntryCollection *entries);
 static void handle_test_rooms(const EntryCollection *entries, const RoomCollection *rooms);
+static void handle_ingest_stats(const EntryCollection *entries, const WriteAheadLog *wal);
+static WriteAheadLog *open_log(WriteAheadLog *wal, const char *path, FILE *out,
+                               RoomCollection *rooms, EntryCollection *entries);
+static int run_script(const char *script_path, const char *log_path);
+static void handle_query_range(RoomCollection *rooms);
+static int print_range_reading(const Room *room, int type, int timestamp,
+                               ReadingValue value, void *ctx);
+static void handle_aggregate(const RoomCollection *rooms);
+static int print_bucket(const Room *room, int type, const Aggregate *bucket, void *ctx);
+static void handle_rolling(RoomCollection *rooms);
+static void handle_save_snapshot(WriteAheadLog *wal, const RoomCollection *rooms,
+                                 const EntryCollection *entries);
+static void handle_open_snapshot(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries);
+static void handle_import_csv(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries);
+static void handle_motion(RoomCollection *rooms);
+static void handle_compress(EntryCollection *entries);
+static void handle_retention(WriteAheadLog *wal, EntryCollection *entries);
+static void handle_profile(void);
+static void handle_latency(void);
+static void commit_before_input(void);
+static void read_path(char *path, const char *fallback);
 static void read_room_name(char *room_name);
 static int read_entry_data(int *timestamp, int *type, ReadingValue *value);
 
-int main(void) {
+// Log that commit_before_input makes durable; NULL until main opens it
+static WriteAheadLog *input_log = NULL;
+
+int main(int argc, char *argv[]) {
     RoomCollection  rooms   = { .size = 0 };
     EntryCollection entries = { .size = 0 };
-
+    // Log every change goes to; NULL if it could not be opened
+    static WriteAheadLog log_file;
+    WriteAheadLog *wal;
+    const char *log_path = WAL_DEFAULT_PATH;
+    const char *script_path = NULL;
     // Stores user's menu selection
     int choice;
+    int i;
+
+    // Command line: [--script FILE] [LOG]
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script_path = argv[++i];
+        }
+        else {
+            log_path = argv[i];
+        }
+    }
+
+    // Run the commands without the menu
+    if (script_path != NULL) {
+        return run_script(script_path, log_path);
+    }
+
+    // Restore the previous session from the log
+    wal = open_log(&log_file, log_path, stdout, &rooms, &entries);
+    input_log = wal;
     
     // Main menu loop which runs forever until user chooses to exit
     while (1) {
@@ -30,15 +78,20 @@ int main(void) {
         // User wants to exit
         if (choice == 0) {
             printf("Exiting program.\n");
+            if (wal != NULL && wal_close(wal) != C_ERR_OK) {
+                printf("Warning: Could not write the log; recent changes may be lost.\n");
+            }
+            entries_clear(&entries);
+            rooms_clear(&rooms);
             break;
         }
         else if (choice == 1) {
             // Pass addresses of both collections so they can be modified
-            handle_load_sample(&rooms, &entries);
+            handle_load_sample(wal, &rooms, &entries);
         }
         else if (choice == 2) {
             // Print all entries in sorted order
-            handle_print_entries(&entries);
+            handle_print_entries(&rooms, &entries);
         }
         else if (choice == 3) {
             // Print all rooms with their entries
@@ -46,20 +99,73 @@ int main(void) {
         }
         else if (choice == 4) {
             // Add a new room
-            handle_add_room(&rooms);
+            handle_add_room(wal, &rooms);
         }
         else if (choice == 5) {
             // Add a new entry to an existing room
-            handle_add_entry(&rooms, &entries);
+            handle_add_entry(wal, &rooms, &entries);
         }
         else if (choice == 6) {
             // Test if entries are in correct sorted order
-            handle_test_order(&entries);
+            handle_test_order(&rooms, &entries);
         }
         else if (choice == 7) {
             // Test if room entry pointers are correct
             handle_test_rooms(&entries, &rooms);
         }
+        else if (choice == 8) {
+            // Show how entries have been placed so far
+            handle_ingest_stats(&entries, wal);
+        }
+        else if (choice == 9) {
+            // Print one room's readings of one type between two timestamps
+            handle_query_range(&rooms);
+        }
+        else if (choice == 10) {
+            // Summarise every room's readings of one type per time bucket
+            handle_aggregate(&rooms);
+        }
+        else if (choice == 11) {
+            // Set up or read a room's rolling statistics
+            handle_rolling(&rooms);
+        }
+        else if (choice == 12) {
+            // Write everything to a snapshot file
+            handle_save_snapshot(wal, &rooms, &entries);
+        }
+        else if (choice == 13) {
+            // Replace everything with the contents of a snapshot file
+            handle_open_snapshot(wal, &rooms, &entries);
+        }
+        else if (choice == 14) {
+            // Bulk-load readings from a CSV file
+            handle_import_csv(wal, &rooms, &entries);
+        }
+        else if (choice == 15) {
+            // Count a room's motion readings by direction
+            handle_motion(&rooms);
+        }
+        else if (choice == 16) {
+            // Seal old readings into compressed blocks
+            handle_compress(&entries);
+        }
+        else if (choice == 17) {
+            // Free the time partitions older than a timestamp
+            handle_retention(wal, &entries);
+        }
+        else if (choice == 18) {
+            // Show where ingest has spent its time
+            handle_profile();
+        }
+        else if (choice == 19) {
+            // Show the tail latency of each operation
+            handle_latency();
+        }
+
+        // Commit records that have waited out the group commit window
+        if (wal != NULL) {
+            wal_poll(wal);
+        }
     }
     
     return 0;
@@ -68,7 +174,7 @@ int main(void) {
 void print_menu(int* choice) {
   int c = -1;
   int rc = 0;
-  const int num_options = 7;
+  const int num_options = 19;
 
   printf("\nMAIN MENU\n");
   printf("  (1) Load sample data\n");
@@ -78,8 +184,21 @@ void print_menu(int* choice) {
   printf("  (5) Add entry\n");
   printf("  (6) Test order\n");
   printf("  (7) Test room entries\n");
+  printf("  (8) Ingest statistics\n");
+  printf("  (9) Query time range\n");
+  printf("  (10) Aggregate readings\n");
+  printf("  (11) Rolling statistics\n");
+  printf("  (12) Save snapshot\n");
+  printf("  (13) Open snapshot\n");
+  printf("  (14) Import CSV\n");
+  printf("  (15) Motion occupancy\n");
+  printf("  (16) Compress history\n");
+  printf("  (17) Drop old readings\n");
+  printf("  (18) Ingest profile\n");
+  printf("  (19) Latency histograms\n");
   printf("  (0) Exit\n\n");
 
+  commit_before_input();
   do {
     printf("Please enter a valid selection: ");
     // Check if they entered a non-integer
@@ -92,17 +211,30 @@ void print_menu(int* choice) {
 
 /* ---- handle_load_sample ---------------------------------------------------
    Purpose: Load pre-defined sample data into collections using loader.o.
+            The loader fills its own fixed-size layout, which is then
+            imported into the real collections.
+            The loaded contents are written to the log as one snapshot.
    Params:
+     - wal (in/out): log to record the snapshot in, or NULL
      - rooms (out): room collection to populate
      - entries (out): entry collection to populate
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void handle_load_sample(RoomCollection *rooms, EntryCollection *entries) {
+static void handle_load_sample(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries) {
+    // Fixed-size collections in the layout loader.o was built against
+    LoaderRoomCollection  sample_rooms   = { .size = 0 };
+    LoaderEntryCollection sample_entries = { .size = 0 };
     // Store the return code from load_sample
     int result;
 
     // Call the load_sample function from loader.o
-    result = load_sample(rooms, entries);
+    result = load_sample(&sample_rooms, &sample_entries);
+    if (result == C_ERR_OK) {
+        result = loader_import(rooms, entries, &sample_rooms, &sample_entries);
+    }
+    if (result == C_ERR_OK && wal != NULL) {
+        result = wal_log_snapshot(wal, rooms, entries);
+    }
 
     // Check if loading was successful 
     if (result == C_ERR_OK) {
@@ -114,14 +246,20 @@ static void handle_load_sample(RoomCollection *rooms, EntryCollection *entries)
 }
 
 /* ---- handle_print_entries -------------------------------------------------
-   Purpose: Print all entries in sorted order with column headers.
+   Purpose: Print all entries in sorted order with column headers. Rows are
+            rendered in blocks rather than printed one at a time.
    Params:
+     - rooms (in): room collection the entries' rooms are in
      - entries (in): entry collection to print
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void handle_print_entries(const EntryCollection *entries) {
-    // Loop counter
-    int i;
+static void handle_print_entries(const RoomCollection *rooms, const EntryCollection *entries) {
+    // Walks the entries in sorted order
+    EntryCursor cursor;
+    const LogEntry *entry;
+    // Rows waiting to be written to stdout
+    static char buffer[RENDER_BUFFER_SIZE];
+    RenderBuffer render;
     
     printf("\nAll Entries (sorted):\n");
 
@@ -130,11 +268,13 @@ static void handle_print_entries(const EntryCollection *entries) {
         printf("%-15s %10s  %-10s  %s\n", "ROOM", "TIMESTAMP", "TYPE", "VALUE");
         printf("--------------- ----------  ----------  ---------------\n");
 
-        // Loop through all entries and print each one
-        for (i = 0; i < entries->size; i++) {
-            // Get address of entry at position i and pass to entry_print
-            entry_print(&entries->entries[i]);
+        // Loop through all entries and render each one
+        render_init(&render, stdout, buffer, sizeof(buffer));
+        entries_cursor_init(&cursor, entries);
+        while ((entry = entries_cursor_next(&cursor)) != NULL) {
+            render_entry(&render, rooms, entry);
         }
+        render_flush(&render);
     }
     else {
         // No entries exist
@@ -143,7 +283,7 @@ static void handle_print_entries(const EntryCollection *entries) {
 }
 
 /* ---- handle_print_rooms ---------------------------------------------------
-   Purpose: Print all rooms with their entries by calling room_print for each.
+   Purpose: Print all rooms with their entries by calling render_room for each.
    Params:
      - rooms (in): room collection to print
    Returns: Nothing (void)
@@ -151,16 +291,21 @@ static void handle_print_entries(const EntryCollection *entries) {
 static void handle_print_rooms(const RoomCollection *rooms) {
     // Loop counter
     int i;
+    // Rows waiting to be written to stdout
+    static char buffer[RENDER_BUFFER_SIZE];
+    RenderBuffer render;
     
     printf("\nAll Rooms:\n");
 
     // Check if there are any rooms to print 
     if (rooms->size > 0) {
         // Loop through all rooms 
+        render_init(&render, stdout, buffer, sizeof(buffer));
         for (i = 0; i < rooms->size; i++) {
-            // Print each room with its entries
-            room_print(&rooms->rooms[i]);
+            // Render each room with its entries
+            render_room(&render, rooms->rooms[i]);
         }
+        render_flush(&render);
     }
     else {
         // No entries exist
@@ -172,10 +317,11 @@ static void handle_print_rooms(const RoomCollection *rooms) {
    Purpose: Prompt user for room name and add it to the collection.
             Displays appropriate success or error messages.
    Params:
+     - wal (in/out): log to record the room in, or NULL
      - rooms (in/out): room collection to add to
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void handle_add_room(RoomCollection *rooms) {
+static void handle_add_room(WriteAheadLog *wal, RoomCollection *rooms) {
     // Buffer to store the room name
     char room_name[MAX_STR];
     // Store return code from rooms_add
@@ -185,7 +331,7 @@ static void handle_add_room(RoomCollection *rooms) {
     printf("Enter room name: ");
     read_room_name(room_name);
     
-    result = rooms_add(rooms, room_name);
+    result = wal_rooms_add(wal, rooms, room_name);
     
     // Check result and display appropriate message
     if (result == C_ERR_OK) {
@@ -195,9 +341,13 @@ static void handle_add_room(RoomCollection *rooms) {
         // Room already exists
         printf("Error: Room '%s' already exists.\n", room_name);
     }
-    else if (result == C_ERR_FULL_ARRAY) {
-        // Array is full
-        printf("Error: Cannot add more rooms (maximum %d reached).\n", MAX_ARR);
+    else if (result == C_ERR_NO_MEMORY) {
+        // Storage could not grow
+        printf("Error: Cannot add more rooms (out of memory).\n");
+    }
+    else if (result == C_ERR_IO) {
+        // Added, but the log write failed
+        printf("Warning: Room '%s' added but could not be logged.\n", room_name);
     }
     else {
         printf("Error adding room.\n");
@@ -208,11 +358,12 @@ static void handle_add_room(RoomCollection *rooms) {
    Purpose: Prompt user for entry data (room, timestamp, type, value) and
             create a new entry in the specified room.
    Params:
+     - wal (in/out): log to record the entry in, or NULL
      - rooms (in): room collection to find room in
      - entries (in/out): entry collection to add entry to
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void handle_add_entry(RoomCollection *rooms, EntryCollection *entries) {
+static void handle_add_entry(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries) {
     // Buffer to store room name 
     char room_name[MAX_STR];
     // Pointer to the room we'll add entry to
@@ -243,69 +394,725 @@ static void handle_add_entry(RoomCollection *rooms, EntryCollection *entries) {
     }
     
     // Create the entry
-    result = entries_create(entries, room, type, value, timestamp);
+    result = wal_entries_create(wal, entries, room, type, value, timestamp);
     
     // Check result and display appropriate message 
     if (result == C_ERR_OK) {
         printf("Entry added successfully.\n");
     }
-    else if (result == C_ERR_FULL_ARRAY) {
-        // No more space in arrays
-        printf("Error: Cannot add more entries (maximum reached).\n");
+    else if (result == C_ERR_NO_MEMORY) {
+        // Storage could not grow
+        printf("Error: Cannot add more entries (out of memory).\n");
     }
     else if (result == C_ERR_INVALID) {
         // Invalid type or other validation error
         printf("Error: Invalid entry data.\n");
     }
+    else if (result == C_ERR_IO) {
+        // Added, but the log write failed
+        printf("Warning: Entry added but could not be logged.\n");
+    }
     else {
         printf("Error adding entry.\n");
     }
 }
 
 /* ---- handle_test_order ----------------------------------------------------
-   Purpose: Verify that entries are in correct sorted order using loader test.
+   Purpose: Verify that rooms, series and entries are in sorted order with
+            entries_validate, and show the first entry out of order.
    Params:
+     - rooms (in): room collection the entries point into
      - entries (in): entry collection to test
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void handle_test_order(const EntryCollection *entries) {
+static void handle_test_order(const RoomCollection *rooms, const EntryCollection *entries) {
+    ValidateReport report;
     // Store return code from test
     int result;
-    
-    // Call the test function from loader.o
-    result = loader_test_order(entries, 1);
+
+    result = entries_validate(rooms, entries, VALIDATE_ORDER, &report);
 
     // Display Result
     if (result == C_ERR_OK) {
         printf("Order test PASSED.\n");
     }
+    else if (result == C_ERR_INVALID) {
+        printf("Order test FAILED: %s\n", report.message);
+    }
     else {
-        printf("Order test FAILED.\n");
+        printf("Order test could not run (out of memory).\n");
     }
 }
 
 /* ---- handle_test_rooms ----------------------------------------------------
-   Purpose: Verify that room-entry linkages are correct and unique using
-            loader test.
+   Purpose: Verify that room-entry linkages are correct and unique with
+            entries_validate, and show the first broken one.
    Params:
      - entries (in): entry collection to test
      - rooms (in): room collection to test
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
 static void handle_test_rooms(const EntryCollection *entries, const RoomCollection *rooms) {
+    ValidateReport report;
     // Store return code from test
     int result;
-    
-    // Call the test function from loader.o
-    // This verifies each entry appears exactly once in global array
-    result = loader_test_rooms(entries, rooms, 1);
+
+    // Each stored entry must be in exactly one room's series and point back to it
+    result = entries_validate(rooms, entries, VALIDATE_ROOMS, &report);
 
     // Display Result
     if (result == C_ERR_OK) {
         printf("Room entries test PASSED.\n");
     }
+    else if (result == C_ERR_INVALID) {
+        printf("Room entries test FAILED: %s\n", report.message);
+    }
     else {
-        printf("Room entries test FAILED.\n");
+        printf("Room entries test could not run (out of memory).\n");
+    }
+}
+
+/* ---- handle_ingest_stats ------------------------------------------------
+   Purpose: Show how many entries took the append fast path versus the
+            late memtable slow path, the comparisons the slow path made and
+            the memory the entries take, plus the write-ahead log's record
+            and commit counts.
+   Params:
+     - entries (in): entry collection to report on
+     - wal (in): open log, or NULL
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_ingest_stats(const EntryCollection *entries, const WriteAheadLog *wal) {
+    printf("\nIngest statistics:\n");
+    printf("  Entries:          %d\n", entries->size);
+    printf("  Series:           %d\n", entries->num_series);
+    printf("  Fast appends:     %lu\n", entries->fast_appends);
+    printf("  Slow inserts:     %lu\n", entries->slow_inserts);
+    printf("  Key comparisons:  %lu\n", entries->comparisons);
+    printf("  Entry memory:     %zu bytes\n", entries_memory(entries));
+    printf("  Time partitions:  %d\n", entries->num_partitions);
+    if (wal != NULL) {
+        printf("  Log records:      %lu\n", wal->records);
+        printf("  Log commits:      %lu\n", wal->commits);
+        printf("  Records replayed: %lu\n", wal->replayed);
+    }
+}
+
+/* ---- open_log -------------------------------------------------------------
+   Purpose: Open the write-ahead log and replay it into the empty collections.
+            The program keeps running without a log if it cannot be opened.
+   Params:
+     - wal (out): log to open
+     - path (in): log file name
+     - out (in): stream for the restore and warning messages
+     - rooms (in/out): room collection to restore
+     - entries (in/out): entry collection to restore
+   Returns: wal, or NULL if logging is off
+----------------------------------------------------------------------------- */
+static WriteAheadLog *open_log(WriteAheadLog *wal, const char *path, FILE *out,
+                               RoomCollection *rooms, EntryCollection *entries) {
+    int result = wal_open(wal, path, WAL_GROUP_RECORDS, WAL_GROUP_MS);
+
+    if (result == C_ERR_OK) {
+        result = wal_replay(wal, rooms, entries);
+        if (result != C_ERR_OK) {
+            wal_close(wal);
+        }
+    }
+
+    if (result != C_ERR_OK) {
+        fprintf(out, "Warning: Cannot use log '%s'; changes will not be saved.\n", path);
+        return NULL;
+    }
+
+    if (wal->replayed > 0) {
+        fprintf(out, "Restored %lu record(s) from '%s'.\n", wal->replayed, path);
+    }
+    return wal;
+}
+
+/* ---- run_script -------------------------------------------------------------
+   Purpose: Script mode. Restore the log, run the commands of a script with
+            script_run and close the log. Command output is block-buffered;
+            messages go to stderr so stdout holds only results.
+   Params:
+     - script_path (in): script file name, or "-" for stdin
+     - log_path (in): log file name
+   Returns: exit status, 0 if every command succeeded
+----------------------------------------------------------------------------- */
+static int run_script(const char *script_path, const char *log_path) {
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    static WriteAheadLog log_file;
+    WriteAheadLog *wal;
+    FILE *in = stdin;
+    int failed;
+
+    if (strcmp(script_path, "-") != 0) {
+        in = fopen(script_path, "r");
+        if (in == NULL) {
+            fprintf(stderr, "Error: Cannot open script '%s'.\n", script_path);
+            return 1;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    wal = open_log(&log_file, log_path, stderr, &rooms, &entries);
+    failed = script_run(in, (in == stdin) ? "<stdin>" : script_path, wal, &rooms, &entries);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (wal != NULL && wal_close(wal) != C_ERR_OK) {
+        fprintf(stderr, "Warning: Could not write the log; recent changes may be lost.\n");
+        failed++;
+    }
+    entries_clear(&entries);
+    rooms_clear(&rooms);
+    fflush(stdout);
+
+    return (failed == 0) ? 0 : 1;
+}
+
+/* ---- handle_query_range -------------------------------------------------
+   Purpose: Prompt for a room, a type and a timestamp range, then print the
+            matching readings using room_query_range.
+   Params:
+     - rooms (in): room collection to find the room in
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_query_range(RoomCollection *rooms) {
+    char room_name[MAX_STR];
+    Room *room;
+    int type, t_from, t_to;
+    // Number of readings printed, or an error code
+    int result;
+
+    printf("Enter room name: ");
+    read_room_name(room_name);
+
+    room = rooms_find(rooms, room_name);
+    if (room == NULL) {
+        printf("Error: Room '%s' not found.\n", room_name);
+        return;
+    }
+
+    printf("Enter type (1=TEMP, 2=DB, 3=MOTION): ");
+    if (scanf("%d", &type) != 1) {
+        type = 0;
+    }
+    while (getchar() != '\n');
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        printf("Error: Invalid type.\n");
+        return;
+    }
+
+    printf("Enter start and end timestamps: ");
+    if (scanf("%d %d", &t_from, &t_to) != 2) {
+        while (getchar() != '\n');
+        printf("Error: Invalid timestamps.\n");
+        return;
+    }
+    while (getchar() != '\n');
+
+    printf("\n%-15s %10s  %-10s  %s\n", "ROOM", "TIMESTAMP", "TYPE", "VALUE");
+    printf("--------------- ----------  ----------  ---------------\n");
+
+    result = room_query_range(room, type, t_from, t_to, print_range_reading, NULL);
+    if (result == 0) {
+        printf("  (No entries in range)\n");
+    }
+    else if (result > 0) {
+        printf("%d reading(s) in range.\n", result);
+    }
+}
+
+/* ---- print_range_reading --------------------------------------------------
+   Purpose: RangeCallback that prints each reading of a range query.
+   Params:
+     - room, type, timestamp, value (in): the reading
+     - ctx (in): unused
+   Returns: 0 to keep the query going
+----------------------------------------------------------------------------- */
+static int print_range_reading(const Room *room, int type, int timestamp,
+                               ReadingValue value, void *ctx) {
+    (void)ctx;
+    reading_print(room->name, timestamp, type, value);
+    return 0;
+}
+
+/* ---- handle_aggregate ---------------------------------------------------
+   Purpose: Prompt for a type, a bucket width and a timestamp range, then print
+            count, min, max and mean per bucket for every room, in name order.
+   Params:
+     - rooms (in): room collection to aggregate
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_aggregate(const RoomCollection *rooms) {
+    // Loop counter over rooms
+    int i;
+    int type, width, t_from, t_to;
+    // Buckets printed across all rooms
+    int total = 0;
+    int result;
+
+    commit_before_input();
+    printf("Enter type (1=TEMP, 2=DB, 3=MOTION): ");
+    if (scanf("%d", &type) != 1) {
+        type = 0;
+    }
+    while (getchar() != '\n');
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        printf("Error: Invalid type.\n");
+        return;
+    }
+
+    printf("Enter bucket width: ");
+    if (scanf("%d", &width) != 1) {
+        width = 0;
+    }
+    while (getchar() != '\n');
+    if (width <= 0) {
+        printf("Error: Bucket width must be positive.\n");
+        return;
+    }
+
+    printf("Enter start and end timestamps: ");
+    if (scanf("%d %d", &t_from, &t_to) != 2) {
+        while (getchar() != '\n');
+        printf("Error: Invalid timestamps.\n");
+        return;
+    }
+    while (getchar() != '\n');
+
+    printf("\n%-15s %12s  %6s  %10s  %10s  %10s\n", "ROOM", "BUCKET", "COUNT", "MIN", "MAX", "MEAN");
+    printf("--------------- ------------  ------  ----------  ----------  ----------\n");
+
+    for (i = 0; i < rooms->size; i++) {
+        result = room_aggregate(rooms->sorted[i], type, t_from, t_to, width, print_bucket, NULL);
+        if (result > 0) {
+            total += result;
+        }
+    }
+
+    if (total == 0) {
+        printf("  (No entries in range)\n");
+    }
+}
+
+/* ---- print_bucket ---------------------------------------------------------
+   Purpose: AggregateCallback that prints one bucket as a table row.
+   Params:
+     - room, type, bucket (in): the bucket and the series it summarises
+     - ctx (in): unused
+   Returns: 0 to keep the pass going
+----------------------------------------------------------------------------- */
+static int print_bucket(const Room *room, int type, const Aggregate *bucket, void *ctx) {
+    (void)type;
+    (void)ctx;
+    printf("%-15s %12lld  %6d  %10.2f  %10.2f  %10.2f\n", room->name, bucket->start,
+           bucket->count, bucket->min, bucket->max, bucket->mean);
+    return 0;
+}
+
+/* ---- handle_rolling -----------------------------------------------------
+   Purpose: Prompt for a room, a type and a window, (re)configure the room's
+            rolling statistics if the window is positive, then print them.
+   Params:
+     - rooms (in/out): room collection to find the room in
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_rolling(RoomCollection *rooms) {
+    char room_name[MAX_STR];
+    Room *room;
+    int type, window;
+    Aggregate stats;
+    int result;
+
+    printf("Enter room name: ");
+    read_room_name(room_name);
+
+    room = rooms_find(rooms, room_name);
+    if (room == NULL) {
+        printf("Error: Room '%s' not found.\n", room_name);
+        return;
+    }
+
+    printf("Enter type (1=TEMP, 2=DB, 3=MOTION): ");
+    if (scanf("%d", &type) != 1) {
+        type = 0;
+    }
+    while (getchar() != '\n');
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        printf("Error: Invalid type.\n");
+        return;
+    }
+
+    printf("Enter window (0 keeps the current one): ");
+    if (scanf("%d", &window) != 1) {
+        window = 0;
+    }
+    while (getchar() != '\n');
+
+    result = (window > 0) ? room_rolling_configure(room, type, window) : C_ERR_OK;
+    if (result == C_ERR_INVALID) {
+        printf("Error: The window reaches compressed readings; choose a shorter one.\n");
+        return;
+    }
+    if (result != C_ERR_OK) {
+        printf("Error: Cannot track rolling statistics (out of memory).\n");
+        return;
+    }
+
+    result = room_rolling(room, type, &stats);
+    if (result == C_ERR_NOT_FOUND) {
+        printf("Rolling statistics are off for this room and type; enter a window to start them.\n");
+    }
+    else if (result == C_ERR_OK && stats.count == 0) {
+        printf("No readings in the window.\n");
+    }
+    else if (result == C_ERR_OK) {
+        printf("\nLast window from %lld: count=%d min=%.2f max=%.2f mean=%.2f sum=%.2f\n",
+               stats.start, stats.count, stats.min, stats.max, stats.mean, stats.sum);
+    }
+}
+
+/* ---- handle_save_snapshot -----------------------------------------------
+   Purpose: Prompt for a file name and save both collections as a snapshot.
+            The log is then restarted from the snapshot (a checkpoint), so
+            the next startup maps it instead of replaying every record.
+   Params:
+     - wal (in/out): log to checkpoint, or NULL
+     - rooms (in): rooms to save
+     - entries (in): entries to save
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_save_snapshot(WriteAheadLog *wal, const RoomCollection *rooms,
+                                 const EntryCollection *entries) {
+    char path[MAX_PATH_STR];
+    int result;
+
+    printf("Enter snapshot file (blank for %s): ", SNAPSHOT_DEFAULT_PATH);
+    read_path(path, SNAPSHOT_DEFAULT_PATH);
+
+    result = snapshot_save(path, rooms, entries);
+    if (result != C_ERR_OK) {
+        printf("Error: Cannot write snapshot '%s'.\n", path);
+        return;
+    }
+
+    printf("Saved %d room(s) and %d entries to '%s'.\n", rooms->size, entries->size, path);
+    if (wal != NULL && wal_checkpoint(wal, path) != C_ERR_OK) {
+        printf("Warning: Could not restart the log from the snapshot.\n");
+    }
+}
+
+/* ---- handle_open_snapshot -----------------------------------------------
+   Purpose: Prompt for a file name and replace both collections with the
+            snapshot's contents, mapped in place. The log is restarted from
+            the snapshot.
+   Params:
+     - wal (in/out): log to checkpoint, or NULL
+     - rooms (in/out): room collection to replace
+     - entries (in/out): entry collection to replace
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_open_snapshot(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries) {
+    char path[MAX_PATH_STR];
+    int result;
+
+    printf("Enter snapshot file (blank for %s): ", SNAPSHOT_DEFAULT_PATH);
+    read_path(path, SNAPSHOT_DEFAULT_PATH);
+
+    result = snapshot_open(path, rooms, entries);
+    if (result == C_ERR_OK) {
+        printf("Opened %d room(s) and %d entries from '%s'.\n", rooms->size, entries->size, path);
+        if (wal != NULL && wal_checkpoint(wal, path) != C_ERR_OK) {
+            printf("Warning: Could not restart the log from the snapshot.\n");
+        }
+        return;
+    }
+
+    if (result == C_ERR_INVALID) {
+        printf("Error: '%s' is not a usable snapshot.\n", path);
+    }
+    else if (result == C_ERR_NO_MEMORY) {
+        printf("Error: Cannot open snapshot (out of memory).\n");
+    }
+    else {
+        printf("Error: Cannot read snapshot '%s'.\n", path);
+    }
+    printf("The collections are unchanged.\n");
+}
+
+/* ---- handle_import_csv --------------------------------------------------
+   Purpose: Prompt for a CSV file and bulk-load its readings with csv_import,
+            then report how many lines were imported and rejected.
+   Params:
+     - wal (in/out): log to record the new rooms and readings in, or NULL
+     - rooms (in/out): room collection, new rooms are added
+     - entries (in/out): entry collection to add to
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_import_csv(WriteAheadLog *wal, RoomCollection *rooms, EntryCollection *entries) {
+    char path[MAX_PATH_STR];
+    CsvImport import;
+    int result;
+
+    printf("Enter CSV file (blank for %s): ", CSV_DEFAULT_PATH);
+    read_path(path, CSV_DEFAULT_PATH);
+
+    memset(&import, 0, sizeof(import));
+    import.wal = wal;
+    import.rc = rooms;
+    import.ec = entries;
+    result = csv_import(&import, path);
+
+    if (result == C_ERR_IO && import.lines == 0) {
+        printf("Error: Cannot read '%s'.\n", path);
+        return;
+    }
+
+    printf("Imported %ld reading(s) from %ld line(s), %d new room(s).\n",
+           import.imported, import.lines, import.rooms_added);
+    if (import.rejected > 0) {
+        printf("Skipped %ld line(s) that did not parse, the first at line %ld.\n",
+               import.rejected, import.first_rejected);
+    }
+    if (result == C_ERR_NO_MEMORY) {
+        printf("Error: Import stopped (out of memory).\n");
+    }
+    else if (result == C_ERR_IO) {
+        printf("Warning: Import stopped; the file or the log could not be accessed.\n");
+    }
+    else if (result != C_ERR_OK) {
+        printf("Error: Import stopped.\n");
+    }
+}
+
+/* ---- handle_motion ---------------------------------------------------------
+   Purpose: Prompt for a room and a timestamp range, then print how many of
+            its motion readings saw movement, overall and per direction,
+            using room_motion_summary.
+   Params:
+     - rooms (in): room collection to find the room in
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_motion(RoomCollection *rooms) {
+    char room_name[MAX_STR];
+    Room *room;
+    int t_from, t_to;
+    MotionSummary summary;
+
+    printf("Enter room name: ");
+    read_room_name(room_name);
+
+    room = rooms_find(rooms, room_name);
+    if (room == NULL) {
+        printf("Error: Room '%s' not found.\n", room_name);
+        return;
+    }
+
+    printf("Enter start and end timestamps: ");
+    if (scanf("%d %d", &t_from, &t_to) != 2) {
+        while (getchar() != '\n');
+        printf("Error: Invalid timestamps.\n");
+        return;
+    }
+    while (getchar() != '\n');
+
+    if (room_motion_summary(room, t_from, t_to, &summary) != C_ERR_OK) {
+        printf("Error: Cannot merge late readings (out of memory).\n");
+        return;
+    }
+    if (summary.readings == 0) {
+        printf("No motion readings in range.\n");
+        return;
+    }
+
+    printf("\nMotion readings: %d, with movement: %d (%.1f%%)\n", summary.readings, summary.any,
+           100.0 * summary.any / summary.readings);
+    printf("  left=%d forward=%d right=%d\n", summary.left, summary.forward, summary.right);
+}
+
+/* ---- handle_compress -------------------------------------------------------
+   Purpose: Seal the history of every series into compressed blocks with
+            entries_compress and report the entry memory before and after.
+            Nothing is logged: the readings themselves do not change.
+   Params:
+     - entries (in/out): entry collection to compress
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_compress(EntryCollection *entries) {
+    size_t before = entries_memory(entries);
+    int sealed = entries_compress(entries);
+
+    if (sealed < 0) {
+        printf("Error: Cannot compress every series (out of memory).\n");
+        return;
+    }
+
+    printf("\nSealed %d readings; entry memory %zu -> %zu bytes.\n", sealed, before,
+           entries_memory(entries));
+}
+
+/* ---- handle_retention ------------------------------------------------------
+   Purpose: Ask for a timestamp and drop every time partition that ends at
+            or before it with wal_retention_drop_before.
+   Params:
+     - wal (in/out): open log, or NULL
+     - entries (in/out): entry collection to trim
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_retention(WriteAheadLog *wal, EntryCollection *entries) {
+    int timestamp;
+    int partitions = entries->num_partitions;
+    int dropped;
+
+    commit_before_input();
+    printf("Drop readings in partitions that end at or before timestamp: ");
+    if (scanf("%d", &timestamp) != 1) {
+        while (getchar() != '\n');
+        printf("Error: Invalid timestamp.\n");
+        return;
+    }
+    while (getchar() != '\n');
+
+    dropped = wal_retention_drop_before(wal, entries, timestamp);
+    if (dropped == C_ERR_NO_MEMORY) {
+        printf("Error: Cannot drop every series' readings (out of memory).\n");
+        return;
+    }
+    if (dropped == C_ERR_IO) {
+        printf("Warning: Readings dropped but the drop could not be logged.\n");
+        return;
+    }
+
+    printf("\nDropped %d readings; time partitions %d -> %d.\n", dropped, partitions,
+           entries->num_partitions);
+}
+
+/* ---- handle_profile --------------------------------------------------------
+   Purpose: Print the ingest probes' counters (see PROFILE_CREATE) and
+            write them as CSV to a file for other tools.
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_profile(void) {
+    ProfileCounter counters[PROFILE_POINTS];
+    char path[MAX_PATH_STR];
+    FILE *fp;
+    int i, result;
+
+    if (!profile_read(counters)) {
+        printf("Profiling is off in this build; rebuild with -DSENSOR_PROFILE.\n");
+        return;
+    }
+
+    printf("\n%-22s %12s %12s %12s %16s %12s\n", "Point", "Calls", "Moved", "Compares",
+           "Cycles", "Cycles/call");
+    for (i = 0; i < PROFILE_POINTS; i++) {
+        printf("%-22s %12llu %12llu %12llu %16llu %12.1f\n", counters[i].name,
+               counters[i].calls, counters[i].moved, counters[i].comparisons,
+               counters[i].cycles,
+               counters[i].calls > 0 ? (double)counters[i].cycles / counters[i].calls : 0.0);
+    }
+
+    printf("\nEnter dump file (blank for %s): ", PROFILE_DEFAULT_PATH);
+    read_path(path, PROFILE_DEFAULT_PATH);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("Error: Cannot write '%s'.\n", path);
+        return;
+    }
+    result = profile_dump(fp);
+    if (fclose(fp) != 0 || result != C_ERR_OK) {
+        printf("Error: Cannot write '%s'.\n", path);
+        return;
+    }
+    printf("Wrote the counters to '%s'.\n", path);
+}
+
+/* ---- handle_latency --------------------------------------------------------
+   Purpose: Print the percentiles of each operation's latency histogram,
+            write them as CSV to a file and, if asked, empty the histograms
+            so the next report covers a fresh interval.
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void handle_latency(void) {
+    ProfileCounter counters[PROFILE_POINTS];
+    LatencySummary summary;
+    char path[MAX_PATH_STR];
+    FILE *fp;
+    int op, result, reset;
+
+    if (!profile_read(counters)) {
+        printf("Profiling is off in this build; rebuild with -DSENSOR_PROFILE.\n");
+        return;
+    }
+
+    printf("\n%-18s %10s %10s %10s %10s %10s %12s  (ns)\n", "Operation", "Count", "p50",
+           "p99", "p99.9", "Max", "Mean");
+    for (op = 0; op < LATENCY_OPS; op++) {
+        latency_summary(op, &summary);
+        printf("%-18s %10llu %10llu %10llu %10llu %10llu %12.1f\n", summary.name,
+               summary.count, summary.p50, summary.p99, summary.p999, summary.max, summary.mean);
+    }
+
+    printf("\nEnter dump file (blank for %s): ", LATENCY_DEFAULT_PATH);
+    read_path(path, LATENCY_DEFAULT_PATH);
+    fp = fopen(path, "w");
+    result = (fp == NULL) ? C_ERR_IO : latency_dump(fp, 0);
+    if (fp != NULL && fclose(fp) != 0) {
+        result = C_ERR_IO;
+    }
+    if (result != C_ERR_OK) {
+        printf("Error: Cannot write '%s'.\n", path);
+        return;
+    }
+    printf("Wrote the percentiles to '%s'.\n", path);
+
+    printf("Reset the histograms (1 = yes, 0 = no): ");
+    commit_before_input();
+    if (scanf("%d", &reset) != 1) {
+        reset = 0;
+    }
+    while (getchar() != '\n');
+    if (reset == 1) {
+        latency_reset();
+        printf("Histograms reset.\n");
+    }
+}
+
+/* ---- commit_before_input ---------------------------------------------------
+   Purpose: Commit the log's pending records before blocking on user input.
+            Group commit otherwise waits for a later append or for the menu
+            loop to come round again, so a session left idle at a prompt
+            would hold changes that a crash loses however long it waits.
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void commit_before_input(void) {
+    if (input_log != NULL && wal_commit(input_log) != C_ERR_OK) {
+        printf("Warning: Could not write the log; recent changes may be lost.\n");
+    }
+}
+
+/* ---- read_path ------------------------------------------------------------
+   Purpose: Read a file name from user input, using a default for an empty
+            line.
+   Params:
+     - path (out): buffer to store the name (must be at least MAX_PATH_STR)
+     - fallback (in): name to use if the line is empty
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void read_path(char *path, const char *fallback) {
+    commit_before_input();
+    path[0] = '\0';
+    // Reads up to 255 characters, stopping at newline
+    scanf("%255[^\n]", path);
+    while (getchar() != '\n');
+
+    if (path[0] == '\0') {
+        strcpy(path, fallback);
     }
 }
 
@@ -317,6 +1124,7 @@ static void handle_test_rooms(const EntryCollection *entries, const RoomCollecti
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
 static void read_room_name(char *room_name) {
+    commit_before_input();
     // Reads up to 31 characters, stopping at newline
     scanf("%31[^\n]", room_name);
 
@@ -334,6 +1142,7 @@ static void read_room_name(char *room_name) {
    Returns: C_ERR_OK if successful, C_ERR_INVALID if type is invalid
 ----------------------------------------------------------------------------- */
 static int read_entry_data(int *timestamp, int *type, ReadingValue *value) {
+    commit_before_input();
     // Read timestamp
     printf("Enter timestamp: ");
     // Read integer into address pointed to by timestamp
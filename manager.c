@@ -1,57 +1,371 @@
+#include <math.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <time.h>
+#if defined(SENSOR_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
 #include "defs.h"
 
+/* Bits being appended to a block stream, most significant first */
+typedef struct {
+    unsigned char     *out;
+    size_t             used;     /* whole bytes written to out */
+    unsigned long long bits;
+    int                count;    /* bits held in bits, fewer than 8 between calls */
+} BitWriter;
+
+/* State of an entries_validate pass */
+typedef struct {
+    int             checks;          /* VALIDATE_* */
+    const Series   *series;          /* series being checked */
+    long long       position;        /* readings checked in it so far */
+    int             previous;        /* timestamp of the reading before */
+    long long       referenced;      /* stored entries seen, in every series */
+    const LogEntry **group;          /* stored entries with the current timestamp */
+    int             group_size;
+    int             group_cap;
+    ValidateReport *report;
+} Validation;
+
+/* Latency histogram of one operation (see LATENCY_ROOMS_ADD) */
+typedef struct {
+    unsigned long long count;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long sum;
+    unsigned long long buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+/* Room for one block while it is encoded: at most 44 bits per XOR'ed
+   temperature or a 5-byte varint per decibel delta, plus at most 68 bits
+   per timestamp */
+#define BLOCK_SCRATCH_BYTES  (SERIES_BLOCK_SIZE * 16 + 64)
+
+/* Ingest probes (see PROFILE_CREATE). PROFILE_DECLARE and PROFILE_CLOCK
+   declare a local, so they come last among a function's declarations.
+   PROFILE_AGAIN ends a second probe at the moment the last PROFILE_STOP
+   read, saving a counter read on the fast path. Without SENSOR_PROFILE all
+   of them expand to nothing. */
+static ProfileCounter profile_counters[PROFILE_POINTS] = {
+    { .name = "entries_create" },
+    { .name = "entries_create_batch" },
+    { .name = "entries_create/append" },
+    { .name = "btree_insert" },
+    { .name = "memtable_freeze" },
+    { .name = "run_merge" },
+    { .name = "series_settle" },
+    { .name = "shift_entries_right" },
+    { .name = "entry_cmp" },
+};
+
+#ifdef SENSOR_PROFILE
+static unsigned long long profile_now;   /* counter read by the last PROFILE_STOP */
+#define PROFILE_DECLARE(var, value)     unsigned long long var = (value)
+#define PROFILE_CLOCK(var)              PROFILE_DECLARE(var, profile_cycles())
+#define PROFILE_COUNT(point, field, n)  (profile_counters[point].field += (unsigned long long)(n))
+#define PROFILE_AGAIN(point, started)   (profile_counters[point].calls++, \
+                                         profile_counters[point].cycles += profile_now - (started))
+#define PROFILE_STOP(point, started)    (profile_now = profile_cycles(), PROFILE_AGAIN(point, started))
+#else
+#define PROFILE_DECLARE(var, value)
+#define PROFILE_CLOCK(var)
+#define PROFILE_COUNT(point, field, n)  ((void)0)
+#define PROFILE_AGAIN(point, started)   ((void)0)
+#define PROFILE_STOP(point, started)    ((void)0)
+#endif
+
+/* Latency histograms, recorded like the probes above: LATENCY_START
+   declares the start time, LATENCY_STOP records the time since then. They
+   stay empty (and untouched) without SENSOR_PROFILE. */
+static const char *latency_names[LATENCY_OPS] = {
+    "rooms_add", "entries_create", "room_query_range", "room_aggregate", "room_print"
+};
+static LatencyHistogram latency_histograms[LATENCY_OPS];
+
+#ifdef SENSOR_PROFILE
+#define LATENCY_START(var)         PROFILE_DECLARE(var, latency_now())
+#define LATENCY_STOP(op, started)  latency_record(&latency_histograms[op], latency_now() - (started))
+#else
+#define LATENCY_START(var)
+#define LATENCY_STOP(op, started)  ((void)0)
+#endif
+
 // Helper function declarations
-static int find_insertion_position(const EntryCollection *ec, const LogEntry *new_entry);
-static void retarget_room_pointer(LogEntry *dst, LogEntry *src);
-static void shift_entries_right(EntryCollection *ec, int insert_pos);
-static void insert_pointer_in_room(Room *room, LogEntry *entry);
+#ifdef SENSOR_PROFILE
+static unsigned long long profile_cycles(void);
+static unsigned long long latency_now(void);
+static void latency_record(LatencyHistogram *h, unsigned long long nanoseconds);
+static int latency_bucket(unsigned long long nanoseconds);
+#endif
+static unsigned long long latency_bucket_top(int bucket);
+static unsigned long long latency_at(const LatencyHistogram *h, int per_mille);
+static int lower_bound(const int *timestamps, int size, int timestamp,
+                       unsigned long *comparisons);
+static int upper_bound(const int *timestamps, int size, int timestamp,
+                       unsigned long *comparisons);
+static void shift_entries_right(Series *series, int insert_pos, int end, int count);
+static void motion_shift_right(unsigned long long *words, int insert_pos, int end, int count);
+static void motion_shift_left(unsigned long long *words, int count, int size);
+static void* btree_node_alloc(void);
+static void btree_free_node(void *node, int height);
+static void btree_clear(BTree *tree);
+static void btree_leaf_insert(BTreeLeaf *leaf, int pos, int key, LogEntry *entry);
+static void btree_inner_insert(BTreeInner *inner, int pos, int key, void *child);
+static int btree_insert(BTree *tree, int key, LogEntry *entry, unsigned long *comparisons);
+static void btree_seek(const BTree *tree, int key, const BTreeLeaf **leaf, int *slot);
+static void run_free(SortedRun *run);
+static int run_merge(SortedRun *out, const SortedRun *older, const SortedRun *newer);
+static int memtable_freeze(Series *series);
+static int runs_compact(Series *series, int all);
+static void memtable_spill(Series *series);
+static int entries_settle(const EntryCollection *ec);
+static size_t series_values_bytes(int type, int count);
+static void motion_normalize(ReadingValue *value);
+static int motion_popcount(unsigned long long word);
+static void series_rebase(Series *series);
+static int series_reserve(Series *series, int needed);
+static void series_store(Series *series, int pos, int timestamp, ReadingValue value);
+static Series* get_series(EntryCollection *ec, Room *room, int type);
+static int series_thaw(EntryCollection *ec, Series *series);
+static double series_number(const Series *series, int i);
+static double reading_number(int type, ReadingValue value);
+static void bits_put(BitWriter *w, unsigned long long value, int n);
+static size_t bits_finish(BitWriter *w);
+static void bits_open(BitReader *r, const unsigned char *start, const unsigned char *end);
+static unsigned int bits_get(BitReader *r, int n);
+static void put_dod(BitWriter *w, long long dod);
+static long long get_dod(BitReader *r);
+static unsigned char* put_varint(unsigned char *p, long long delta);
+static long long get_varint(const unsigned char **p);
+static SeriesBlock* block_encode(const Series *series, int pos, int count, unsigned char *scratch);
+static void block_range(const SeriesBlock *block, int t_from, int t_to, int *first, int *last);
+static int first_block(const Series *series, int t_from);
+static int sealed_last(const Series *series);
+static void block_start(SeriesReader *reader);
+static void reader_advance(SeriesReader *reader);
+static void reader_merge_late(SeriesReader *reader);
+static void late_reader_init(SeriesReader *reader, const Series *series, int t_from);
+static int validate_fail(Validation *v, int check, long long position, const char *format, ...);
+static int pointer_cmp(const void *a, const void *b);
+static int validate_group(Validation *v);
+static int validate_reading(Validation *v, int timestamp, const LogEntry *e);
+static int validate_series(Validation *v, const Series *series);
+static int validate_rooms(Validation *v, const RoomCollection *rc, const EntryCollection *ec);
+static void series_shrink(Series *series);
+static int series_seal(Series *series, int blocks, unsigned char *scratch);
+static int series_unseal(EntryCollection *ec, Series *series);
+static int entries_repack(EntryCollection *ec);
+static void series_free_columns(Series *series);
+static void series_free(Series *series);
+static int block_trim(Series *series, int b, int cut, unsigned char *scratch);
+static int series_drop_front(EntryCollection *ec, Series *series, int cut, unsigned char *scratch);
+static int series_drop_late(EntryCollection *ec, Series *series, int cut);
+static void motion_count(const unsigned long long *words, int first, int last,
+                         MotionSummary *out);
+static int deque_reserve(IndexDeque *dq, int needed);
+static void rolling_push(RollingStats *stats, const Series *series, int pos);
+static void rolling_evict(RollingStats *stats, const Series *series);
+static int rolling_window_start(const Series *series, int window);
+static void rolling_rebuild(RollingStats *stats, const Series *series);
+static int rolling_reserve(Room *room, int type, int extra);
+static void rolling_after_insert(Room *room, const Series *series, int pos, int appended);
+static long long partition_start(const EntryCollection *ec, int timestamp);
+static unsigned int partition_hash(long long start);
+static void partition_index_fill(EntryCollection *ec);
+static int find_partition(EntryCollection *ec, int timestamp, int create);
+static int partition_reserve(EntryPartition *part, int slots);
+static void partition_free(EntryPartition *part);
+static LogEntry* allocate_entry_slot(EntryCollection *ec, int timestamp);
+static void release_entry_slot(EntryCollection *ec, int timestamp);
+static void sort_entries_by_key(LogEntry **array, LogEntry **scratch, int size);
+static void merge_sorted_tail(LogEntry **dst, int size, LogEntry *const *add, int count,
+                              unsigned long *comparisons);
+static int insert_batch(EntryCollection *ec, RoomCollection *rc,
+                        const SensorReading *readings, int count,
+                        Room **owners, LogEntry **batch, LogEntry **scratch,
+                        int *per_series, int *starts);
+static unsigned int room_name_hash(const char *name);
+static int room_index_lookup(const RoomCollection *rc, const char *name, unsigned int hash);
+static int room_index_grow(RoomCollection *rc);
+static int room_name_rank(const RoomCollection *rc, const char *name);
+static void renumber_rooms(RoomCollection *rc, int from);
+static int render_reserve(RenderBuffer *rb);
+static char* put_padded(char *p, const char *text, int width);
+static char* put_int(char *p, int value, int width);
+static char* put_fixed2(char *p, float number);
 
 /* ---- entry comparator -------------------------------------------
    Order: room name ASC, then type ASC by #define value, then timestamp ASC
-   Returns <0 if a<b, >0 if a>b, 0 if equal.
+   Entries of one room are ordered by their packed keys (see ENTRY_KEY_OF),
+   built from their own fields with nothing dereferenced. Only entries of
+   different rooms look the rooms up in rc, and then their positions in
+   name order decide.
+   Returns <0 if a<b, >0 if a>b, 0 if equal (or if rc does not hold both
+   entries' rooms).
 ----------------------------------------------------------------------------- */
-int entry_cmp(const LogEntry *a, const LogEntry *b) {
-    // Store result of room name comparison
-    int room_cmp; 
-      
+int entry_cmp(const RoomCollection *rc, const LogEntry *a, const LogEntry *b) {
+    // Packed keys, or the rooms' name ranks when the rooms differ
+    unsigned long long key_a, key_b;
+    int order;
+    PROFILE_CLOCK(started);
+
     // Checks for empty pointers to prevent crashes
-    if (a == NULL || b == NULL) {
+    if (rc == NULL || a == NULL || b == NULL ||
+        (int)a->room >= rc->size || (int)b->room >= rc->size) {
         return 0;
     }
     
-    // Check for empty room pointers to make sure the entries have valid rooms
-    if (a->room == NULL || b->room == NULL) {
-        return 0;
+    if (a->room == b->room) {
+        key_a = ENTRY_KEY_OF(a);
+        key_b = ENTRY_KEY_OF(b);
     }
-    
-    /* First, compare room names in an ascending alphabetically order by using
-       strncmp compares strings and returns negative if a < b, positive if a > b, 0 if equal */
-    room_cmp = strncmp(a->room->name, b->room->name, MAX_STR);
-    
-    if (room_cmp != 0) {
-        // If rooms are different, then return the comparison result
-        return room_cmp;
+    else {
+        key_a = (unsigned long long)rc->rooms[a->room]->id;
+        key_b = (unsigned long long)rc->rooms[b->room]->id;
     }
-    
-    // If rooms are the same, then compare types in an ascending by numeric value
-    if (a->data.type < b->data.type) {
+    order = (key_a > key_b) - (key_a < key_b);
+    PROFILE_COUNT(PROFILE_CMP, comparisons, 1);
+    PROFILE_STOP(PROFILE_CMP, started);
+    return order;
+}
+
+/* ---- room_name_hash --------------------------------------------------------
+   Purpose: FNV-1a hash of a room name (at most MAX_STR characters).
+   Params:
+     - name (in): C-string room name
+   Returns: 32-bit hash value
+----------------------------------------------------------------------------- */
+static unsigned int room_name_hash(const char *name) {
+    // FNV-1a offset basis
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < MAX_STR && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* ---- room_index_lookup -----------------------------------------------------
+   Purpose: Probe the open-addressing index for a room name.
+   Params:
+     - rc (in): room collection
+     - name (in): C-string room name
+     - hash (in): room_name_hash(name)
+   Returns: position of the room in rc->rooms, or -1 if not found
+----------------------------------------------------------------------------- */
+static int room_index_lookup(const RoomCollection *rc, const char *name, unsigned int hash) {
+    // Current slot, wrapped with the power-of-two mask
+    unsigned int mask;
+    unsigned int slot;
+    int pos;
+
+    if (rc->index_cap == 0) {
         return -1;
     }
-    if (a->data.type > b->data.type) {
-        return 1;
+
+    mask = (unsigned int)rc->index_cap - 1;
+
+    // Linear probing: stop at the first empty slot
+    for (slot = hash & mask; rc->index[slot] >= 0; slot = (slot + 1) & mask) {
+        pos = rc->index[slot];
+        if (rc->rooms[pos]->hash == hash &&
+            strncmp(rc->rooms[pos]->name, name, MAX_STR) == 0) {
+            return pos;
+        }
     }
-    
-    // If the types are the same, then compare timestamps in a ascending order
-    if (a->timestamp < b->timestamp) {
-        return -1;
+
+    return -1;
+}
+
+/* ---- room_index_grow -------------------------------------------------------
+   Purpose: Double the index (or create it) and re-insert every room, keeping
+            the load factor at or below one half.
+   Params:
+     - rc (in/out): room collection
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int room_index_grow(RoomCollection *rc) {
+    int new_cap = (rc->index_cap > 0) ? rc->index_cap * 2 : 2 * MAX_ARR;
+    unsigned int mask = (unsigned int)new_cap - 1;
+    unsigned int slot;
+    int *index;
+    int i;
+
+    index = malloc((size_t)new_cap * sizeof(int));
+    if (index == NULL) {
+        return C_ERR_NO_MEMORY;
     }
-    if (a->timestamp > b->timestamp) {
-        return 1;
+
+    // -1 marks an empty slot
+    for (i = 0; i < new_cap; i++) {
+        index[i] = -1;
+    }
+
+    for (i = 0; i < rc->size; i++) {
+        slot = rc->rooms[i]->hash & mask;
+        while (index[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        index[slot] = i;
+    }
+
+    free(rc->index);
+    rc->index = index;
+    rc->index_cap = new_cap;
+
+    return C_ERR_OK;
+}
+
+/* ---- room_name_rank --------------------------------------------------------
+   Purpose: Binary search the name-ordered room array for the position a new
+            name would take.
+   Params:
+     - rc (in): room collection
+     - name (in): C-string room name (not already in rc)
+   Returns: number of rooms whose name sorts before name
+----------------------------------------------------------------------------- */
+static int room_name_rank(const RoomCollection *rc, const char *name) {
+    // Search window [low, high)
+    int low = 0;
+    int high = rc->size;
+    int mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (strncmp(rc->sorted[mid]->name, name, MAX_STR) < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/* ---- renumber_rooms --------------------------------------------------------
+   Purpose: Give every room from position 'from' of the name-ordered array
+            its new rank (its position). Entries hold the stable room id
+            (Room.seq), so none of them is touched. Only rooms after an
+            inserted name move, and relative order never changes, so the
+            series directory stays sorted.
+   Params:
+     - rc (in/out): room collection
+     - from (in): first position whose rank may have changed
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void renumber_rooms(RoomCollection *rc, int from) {
+    // Loop counter
+    int i;
+
+    for (i = from; i < rc->size; i++) {
+        rc->sorted[i]->id = i;
     }
-    
-    // If all fields are equal
-    return 0;
-    
 }
 
 /* ---- rooms_find ------------------------------------------------------------
@@ -62,334 +376,5109 @@ int entry_cmp(const LogEntry *a, const LogEntry *b) {
    Returns: pointer to room or NULL if not found or on error
 ----------------------------------------------------------------------------- */
 Room* rooms_find(RoomCollection *rc, const char *room_name) {
-    // Loop counter for iterating through rooms
-    int i;
+    // Position of the room in rc->rooms
+    int pos;
       
     // Checks for empty pointers to prevent crashes
     if (rc == NULL || room_name == NULL) {
         return NULL;
     }
     
-    // Search through all rooms in the collection
-    // Start at index 0, go until we reach the current size
-    for (i = 0; i < rc->size; i++) {
-        // Compare current room's name with the name we're searching for
-        if (strncmp(rc->rooms[i].name, room_name, MAX_STR) == 0) {
-            // If found, then return a pointer to this room
-            return &rc->rooms[i];
-        }
+    // Expected O(1): hash the name and probe the index
+    pos = room_index_lookup(rc, room_name, room_name_hash(room_name));
+    if (pos < 0) {
+        return NULL;
     }
-    
-    // Room not found
-    return NULL;
-    
+
+    return rc->rooms[pos];
 }
 
 /* ---- rooms_add -------------------------------------------------------------
-   Purpose: Add a room if it does not already exist.
+   Purpose: Add a room if it does not already exist. O(rooms): the rooms
+            after it in name order move up one place and take the next
+            rank (see renumber_rooms); no entry is touched.
    Params:
      - rc (in/out): room collection
      - room_name (in): C-string room name
-   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_DUPLICATE, C_ERR_FULL_ARRAY
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_DUPLICATE, C_ERR_NO_MEMORY,
+            C_ERR_FULL_ARRAY once there are ENTRY_MAX_ROOMS rooms (the
+            largest id a LogEntry can hold)
 ----------------------------------------------------------------------------- */
 int rooms_add(RoomCollection *rc, const char *room_name) {
     // The pointer to the new room that we'll create
     Room *new_room;
+    // The name as it will be stored (truncated to MAX_STR - 1 characters)
+    char name[MAX_STR];
+    // Name hash, shared by the duplicate check and the index insert
+    unsigned int hash;
+    unsigned int mask;
+    unsigned int slot;
+    Room **grown;
+    int new_capacity;
+    // Position of the new room in name order, which becomes its id
+    int rank;
+    LATENCY_START(started);
       
     // Checks for empty pointers to prevent crashes
     if (rc == NULL || room_name == NULL) {
         return C_ERR_NULL_PTR;
     }
     
-    // Check if array is full
-    if (rc->size >= MAX_ARR) {
-        return C_ERR_FULL_ARRAY;
-    }
-    
+    // Copy the room name uing stncpy 
+    strncpy(name, room_name, MAX_STR - 1);
+    // Add null terminator at the end to ensure string is valid
+    name[MAX_STR - 1] = '\0';
+
     // Check if room already exists
-    if (rooms_find(rc, room_name) != NULL) {
+    hash = room_name_hash(name);
+    if (room_index_lookup(rc, name, hash) >= 0) {
         return C_ERR_DUPLICATE;
     }
+
+    // The new room's id is its seq, rc->size; a larger one would be cut to
+    // ENTRY_ROOM_BITS in its entries and name another room
+    if (rc->size >= ENTRY_MAX_ROOMS) {
+        return C_ERR_FULL_ARRAY;
+    }
+
+    // Make space in the room array and keep the index at most half full
+    if (rc->size == rc->capacity) {
+        new_capacity = (rc->capacity > 0) ? rc->capacity * 2 : MAX_ARR;
+        grown = realloc(rc->rooms, (size_t)new_capacity * sizeof(Room *));
+        if (grown == NULL) {
+            return C_ERR_NO_MEMORY;
+        }
+        rc->rooms = grown;
+
+        grown = realloc(rc->sorted, (size_t)new_capacity * sizeof(Room *));
+        if (grown == NULL) {
+            return C_ERR_NO_MEMORY;
+        }
+        rc->sorted = grown;
+        rc->capacity = new_capacity;
+    }
+    if (2 * (rc->size + 1) > rc->index_cap && room_index_grow(rc) != C_ERR_OK) {
+        return C_ERR_NO_MEMORY;
+    }
     
-    // Add the new room at the end
-    new_room = &rc->rooms[rc->size];
+    // Each room is allocated on its own so entries can keep pointing at it
+    new_room = malloc(sizeof(Room));
+    if (new_room == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
     
-    // Copy the room name uing stncpy 
-    strncpy(new_room->name, room_name, MAX_STR - 1);
-    // Add null terminator at the end to ensure string is valid
-    new_room->name[MAX_STR - 1] = '\0';
+    memcpy(new_room->name, name, MAX_STR);
+    new_room->hash = hash;
     
-    // Initialize the room's entry collection
+    // The room's series are created by the EntryCollection on first insert
+    memset(new_room->series, 0, sizeof(new_room->series));
+    memset(new_room->rolling, 0, sizeof(new_room->rolling));
     new_room->size = 0;
+
+    // Claim the first free slot on the probe path
+    mask = (unsigned int)rc->index_cap - 1;
+    slot = hash & mask;
+    while (rc->index[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    rc->index[slot] = rc->size;
     
-    // Increment the collection size
+    // Add the new room at the end
+    new_room->seq = rc->size;
+    rc->rooms[rc->size] = new_room;
+
+    // Slot it into name order; rooms after it get the next rank
+    rank = room_name_rank(rc, name);
+    memmove(&rc->sorted[rank + 1], &rc->sorted[rank],
+            (size_t)(rc->size - rank) * sizeof(Room *));
+    rc->sorted[rank] = new_room;
+    new_room->id = -1;
     rc->size++;
+    renumber_rooms(rc, rank);
+    LATENCY_STOP(LATENCY_ROOMS_ADD, started);
     
     return C_ERR_OK;
 
 }
 
-/* ---- find_insertion_position ----------------------------------------------
-   Purpose: Find the correct sorted position for a new entry in the collection.
+/* ---- lower_bound -----------------------------------------------------------
+   Purpose: Binary search a sorted timestamp column for the first element
+            not less than timestamp.
    Params:
-     - ec (in): entry collection to search
-     - new_entry (in): entry to find position for
-   Returns: Index where new_entry should be inserted to maintain sorted order
+     - timestamps (in): sorted timestamp column
+     - size (in): number of elements in timestamps
+     - timestamp (in): timestamp to search for
+     - comparisons (in/out): incremented once per comparison
+   Returns: Index in [0, size] of the first element >= timestamp
 ----------------------------------------------------------------------------- */
-static int find_insertion_position(const EntryCollection *ec, const LogEntry *new_entry) {
-    // Loop counter
-    int i;
-    
-    // Loop through all existing entries
-    for (i = 0; i < ec->size; i++) {
-        // Compare new_entry with entry at position i
-        // If new_entry comes before current entry, then it's a negative result
-        if (entry_cmp(new_entry, &ec->entries[i]) < 0) {
-            return i;
+static int lower_bound(const int *timestamps, int size, int timestamp,
+                       unsigned long *comparisons) {
+    // Search window [low, high)
+    int low = 0;
+    int high = size;
+    int mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        (*comparisons)++;
+
+        if (timestamps[mid] < timestamp) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
         }
     }
 
-    // Return the position of the current size
-    return ec->size;
-
+    return low;
 }
 
-/* ---- retarget_room_pointer ------------------------------------------------
-   Purpose: Update a room's pointer after an entry has been shifted in memory.
-            After copying an entry from src to dst during array shift, this
-            function finds and updates the pointer in the room's entries array.
+/* ---- upper_bound -----------------------------------------------------------
+   Purpose: Binary search a sorted timestamp column for the first element
+            greater than timestamp. Equal timestamps stay in front of the new
+            one, so readings with the same time keep their arrival order.
    Params:
-     - dst (in): destination entry (new location after shift)
-     - src (in): source entry (old location before shift)
-   Returns: Nothing (void)
+     - timestamps (in): sorted timestamp column
+     - size (in): number of elements in timestamps
+     - timestamp (in): timestamp to find position for
+     - comparisons (in/out): incremented once per comparison
+   Returns: Index in [0, size] where timestamp should be inserted
 ----------------------------------------------------------------------------- */
-static void retarget_room_pointer(LogEntry *dst, LogEntry *src) {
-    // Loop counter
-    int j;
-    
-    // Go through all pointers in the room's entry array
-    // We need to find which pointer was pointing to the old location
-    for (j = 0; j < dst->room->size; j++) {
-        // Check if this pointer points to the old location
-        if (dst->room->entries[j] == src) {
-            // Update it to point to the new location
-            dst->room->entries[j] = dst;
-            break;
+static int upper_bound(const int *timestamps, int size, int timestamp,
+                       unsigned long *comparisons) {
+    // Search window [low, high)
+    int low = 0;
+    int high = size;
+    int mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        (*comparisons)++;
+
+        // Timestamp sorts before timestamps[mid], so the answer is at or left of mid
+        if (timestamp < timestamps[mid]) {
+            high = mid;
+        }
+        else {
+            low = mid + 1;
         }
     }
 
+    return low;
 }
 
 /* ---- shift_entries_right --------------------------------------------------
-   Purpose: Shift all entries from insert_pos to the end one position right,
-            retargeting room pointers for each shifted entry to maintain
-            pointer validity.
+   Purpose: Shift column positions insert_pos .. end - 1 of a series count
+            positions right, opening a gap for count readings in front of
+            them. The entries themselves stay in their chunks, so nothing
+            else has to be updated.
    Params:
-     - ec (in/out): entry collection to shift
-     - insert_pos (in): position where new entry will be inserted
+     - series (in/out): series to shift (capacity must be >= end + count)
+     - insert_pos (in): first position that moves
+     - end (in): end of the positions that move; what lies past them is
+                 overwritten only where they land
+     - count (in): positions to move by
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void shift_entries_right(EntryCollection *ec, int insert_pos) {
-    // Loop counter
-    int i;
-    
-    // Start from the end and work backwards to avoid overwriting data
-    for (i = ec->size; i > insert_pos; i--) {
-        // Copy entry from position i-1 to position i
-        ec->entries[i] = ec->entries[i - 1];
+static void shift_entries_right(Series *series, int insert_pos, int end, int count) {
+    // Number of elements that move; temperatures and decibels are both 4 bytes wide
+    size_t moved = (size_t)(end - insert_pos);
+    unsigned char *values = series->values.raw;
+    PROFILE_CLOCK(started);
 
-        // The entry moved from &ec->entries[i-1] to &ec->entries[i]
-        // Any room that was pointing to the old address must now point to new address
-        retarget_room_pointer(&ec->entries[i], &ec->entries[i - 1]);
+    if (moved == 0) {
+        return;
     }
 
+    memmove(&series->timestamps[insert_pos + count], &series->timestamps[insert_pos],
+            moved * sizeof(int));
+    if (series->type == TYPE_MOTION) {
+        motion_shift_right(series->values.motion, series->offset + insert_pos,
+                           series->offset + end, count);
+    }
+    else {
+        memmove(values + (size_t)(insert_pos + count) * sizeof(int),
+                values + (size_t)insert_pos * sizeof(int), moved * sizeof(int));
+    }
+    memmove(&series->rows[insert_pos + count], &series->rows[insert_pos],
+            moved * sizeof(LogEntry *));
+    PROFILE_COUNT(PROFILE_SHIFT, moved, moved);
+    PROFILE_STOP(PROFILE_SHIFT, started);
 }
 
-/* ---- insert_pointer_in_room -----------------------------------------------
-   Purpose: Insert a pointer to an entry into a room's sorted pointer array.
-            Finds the correct sorted position and shifts existing pointers
-            to make space.
+/* ---- motion_shift_right ----------------------------------------------------
+   Purpose: Shift the bits of readings insert_pos .. end - 1 count readings
+            up in each motion plane. Each word group is assembled from the
+            (at most two) old words its bits come from, highest group
+            first, so no group is read after it has been written. Bits
+            below the moved ones and above them keep their value, except
+            for the gap left behind, which is stale until series_store
+            writes it.
    Params:
-     - room (in/out): room to insert pointer into
-     - entry (in): pointer to entry to insert
+     - words (in/out): motion bitplanes with room for end + count readings
+     - insert_pos (in): first reading that moves
+     - end (in): end of the readings that move
+     - count (in): readings to move by, > 0
    Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-static void insert_pointer_in_room(Room *room, LogEntry *entry) {
-    // The position where pointer should be inserted
-    int insert_pos;
-    // Loop counter
-    int i;
-    
-    // Find insertion position
-    insert_pos = room->size;
-
-    // Search through existing pointers to find correct sorted position
-    for (i = 0; i < room->size; i++) {
+static void motion_shift_right(unsigned long long *words, int insert_pos, int end, int count) {
+    // Word groups the moved bits land in
+    int first = (insert_pos + count) / 64;
+    int last = (end + count - 1) / 64;
+    // Bits of the first and last group outside the moved ones
+    unsigned long long low = (1ULL << ((insert_pos + count) % 64)) - 1;
+    unsigned long long high = ~0ULL << ((end + count - 1) % 64) << 1;
+    unsigned long long keep, moved;
+    // Old bit position that lands on bit 0 of a group
+    long long src;
+    int g, d, group, bit;
 
-        // If our entry comes before the entry at position i
-        if (entry_cmp(entry, room->entries[i]) < 0) {
-            insert_pos = i;
-            break;
+    for (d = 0; d < MOTION_PLANES; d++) {
+        for (g = last; g >= first; g--) {
+            src = 64LL * g - count;
+            if (src >= 0) {
+                group = (int)(src / 64);
+                bit = (int)(src % 64);
+                moved = words[MOTION_PLANES * group + d] >> bit;
+                if (bit > 0 && (group + 1) * 64 < end) {
+                    moved |= words[MOTION_PLANES * (group + 1) + d] << (64 - bit);
+                }
+            }
+            else {
+                moved = (src > -64) ? words[d] << -src : 0;
+            }
+            keep = ((g == first) ? low : 0) | ((g == last) ? high : 0);
+            words[MOTION_PLANES * g + d] = (words[MOTION_PLANES * g + d] & keep) | (moved & ~keep);
         }
     }
-    
-    // Shift pointers right to make space
-    for (i = room->size; i > insert_pos; i--) {
-        room->entries[i] = room->entries[i - 1];
-    }
-    
-    // Insert new pointer at the correct position
-    room->entries[insert_pos] = entry;
-
-    // Increment room's entry count
-    room->size++;
 }
 
-/* ---- entries_create -----------------------------------------------------------
-   Purpose: Create a log entry and place it in the global entries (sorted),
-            and attach a pointer to it in the owning room (append or sorted, either works)
+/* ---- motion_shift_left -----------------------------------------------------
+   Purpose: Shift the bits of every motion plane down by count readings,
+            dropping the first count readings. The word groups that empty
+            are cleared, so bits past the new end read as zero.
    Params:
-     - ec (in/out): entry collection (owns LogEntry storage)
-     - room (in/out): room to attach entry to (must already exist)
-     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
-     - value (in): union payload for reading
-     - timestamp (in): simple int timestamp
-   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_FULL_ARRAY, C_ERR_INVALID
+     - words (in/out): motion bitplanes
+     - count (in): readings to drop, at most size
+     - size (in): readings in the series
+   Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-int entries_create(EntryCollection *ec, Room *room, int type, ReadingValue value, int timestamp) {
-    // The new entry we'll create
-    LogEntry new_entry;
-    // Where to insert it in sorted order
-    int insert_pos;
-    
-    // Check for empty pointers
-    if (ec == NULL || room == NULL) {
-        return C_ERR_NULL_PTR;
-    }
-    
-    // Validate type
-    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
-        return C_ERR_INVALID;
-    }
-    
-    // Check capacity
-    if (ec->size >= MAX_ARR || room->size >= MAX_ARR) {
-        return C_ERR_FULL_ARRAY;
+static void motion_shift_left(unsigned long long *words, int count, int size) {
+    // Word groups in use, and the whole groups and bits the readings move by
+    int groups = (size + 63) / 64;
+    int skip = count / 64;
+    int bits = count % 64;
+    int g, d;
+    unsigned long long low, high;
+
+    for (d = 0; d < MOTION_PLANES; d++) {
+        for (g = 0; g + skip < groups; g++) {
+            low = words[MOTION_PLANES * (g + skip) + d];
+            high = (g + skip + 1 < groups) ? words[MOTION_PLANES * (g + skip + 1) + d] : 0;
+            words[MOTION_PLANES * g + d] = (bits == 0) ? low : (low >> bits) | (high << (64 - bits));
+        }
     }
-    
-    // Create the new entry
-    new_entry.data.type = type;
-    new_entry.data.value = value;
-    new_entry.room = room;
-    new_entry.timestamp = timestamp;
-    
-    // Find where to insert in sorted order
-    insert_pos = find_insertion_position(ec, &new_entry);
+    memset(words + MOTION_PLANES * (groups - skip), 0,
+           (size_t)MOTION_PLANES * (size_t)skip * sizeof(unsigned long long));
+}
 
-    // Shift existing entries to make space and retarget pointers
-    shift_entries_right(ec, insert_pos);
-    
-    // Insert the new entry at the correct position
-    ec->entries[insert_pos] = new_entry;
-    ec->size++;
-    
-    // Insert pointer in room's array
-    // Pass the address of the entry we just inserted
-    insert_pointer_in_room(room, &ec->entries[insert_pos]);
-    
-    return C_ERR_OK;    
+/* ---- btree_node_alloc ------------------------------------------------------
+   Purpose: Allocate one zeroed B+tree node, leaf or inner, aligned to a
+            cache line so it spans exactly BTREE_NODE_BYTES / 64 lines.
+   Returns: the node, or NULL if out of memory
+----------------------------------------------------------------------------- */
+static void* btree_node_alloc(void) {
+    void *node = aligned_alloc(64, BTREE_NODE_BYTES);
+
+    if (node != NULL) {
+        memset(node, 0, BTREE_NODE_BYTES);
+    }
+    return node;
 }
 
-/* ---- entry_print -----------------------------------------------------------
-   Purpose: Print one entry in a formatted row.
+/* ---- btree_free_node -------------------------------------------------------
+   Purpose: Free a B+tree node and everything below it.
    Params:
-     - e (in): entry to print
-   Returns: C_ERR_OK, C_ERR_NULL_PTR if e is NULL, C_ERR_INVALID if room is NULL
+     - node (in/out): node to free
+     - height (in): inner levels from node down to the leaves, 0 for a leaf
+   Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-int entry_print(const LogEntry *e) {
-    // Loop counter
+static void btree_free_node(void *node, int height) {
+    BTreeInner *inner = node;
     int i;
-    
-    // Check for empty entry
-    if (e == NULL) {
-        return C_ERR_NULL_PTR;
+
+    if (height > 0) {
+        for (i = 0; i < inner->count; i++) {
+            btree_free_node(inner->children[i], height - 1);
+        }
     }
-    
-    // Check for emoty room
-    if (e->room == NULL) {
-        return C_ERR_INVALID;
+    free(node);
+}
+
+/* ---- btree_clear -----------------------------------------------------------
+   Purpose: Free every node of a B+tree and leave it empty. The entries it
+            points to are not touched.
+   Params:
+     - tree (in/out): tree to empty
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void btree_clear(BTree *tree) {
+    if (tree->root != NULL) {
+        btree_free_node(tree->root, tree->height);
     }
-    
-    // Print room name and timestamp
-    printf("%-15s %10d  ", e->room->name, e->timestamp);
-    
-    // Print type and value based on type
-    if (e->data.type == TYPE_TEMP) {
-        printf("%-10s  %.2f°C\n", "TEMP", e->data.value.temperature);
+    memset(tree, 0, sizeof(*tree));
+}
+
+/* ---- btree_leaf_insert -----------------------------------------------------
+   Purpose: Put a key and its entry at position pos of a leaf with room.
+----------------------------------------------------------------------------- */
+static void btree_leaf_insert(BTreeLeaf *leaf, int pos, int key, LogEntry *entry) {
+    memmove(&leaf->keys[pos + 1], &leaf->keys[pos], (size_t)(leaf->count - pos) * sizeof(int));
+    memmove(&leaf->entries[pos + 1], &leaf->entries[pos],
+            (size_t)(leaf->count - pos) * sizeof(LogEntry *));
+    leaf->keys[pos] = key;
+    leaf->entries[pos] = entry;
+    leaf->count++;
+}
+
+/* ---- btree_inner_insert ----------------------------------------------------
+   Purpose: Add the right half of a split child of an inner node with room:
+            child goes after children[pos] and key, its first key, before it.
+----------------------------------------------------------------------------- */
+static void btree_inner_insert(BTreeInner *inner, int pos, int key, void *child) {
+    memmove(&inner->keys[pos + 1], &inner->keys[pos],
+            (size_t)(inner->count - 1 - pos) * sizeof(int));
+    memmove(&inner->children[pos + 2], &inner->children[pos + 1],
+            (size_t)(inner->count - 1 - pos) * sizeof(void *));
+    inner->keys[pos] = key;
+    inner->children[pos + 1] = child;
+    inner->count++;
+}
+
+/* ---- btree_insert ----------------------------------------------------------
+   Purpose: Insert an entry after every entry with a key <= key. The search
+            goes down one path of upper_bound steps; a full leaf splits in
+            two and hands its new sibling up, which may split the inner
+            nodes above it in turn and finally the root. Every node a split
+            needs is allocated first, so a failure changes nothing. An
+            insert at the far right end (late readings replayed in order)
+            leaves the full nodes full and starts new ones instead of
+            splitting them in half.
+   Params:
+     - tree (in/out): tree to insert into
+     - key (in): timestamp of the entry
+     - entry (in): entry to store
+     - comparisons (in/out): incremented once per key compared
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int btree_insert(BTree *tree, int key, LogEntry *entry, unsigned long *comparisons) {
+    // Inner nodes on the way down and the child taken in each, the leaf's
+    // parent first
+    BTreeInner *path[BTREE_MAX_HEIGHT];
+    int slot[BTREE_MAX_HEIGHT];
+    // Nodes the splits need, and how many of them are used so far
+    void *spare[BTREE_MAX_HEIGHT + 1];
+    int needed = 0;
+    int used;
+    // Set while every step went to the last child
+    int rightmost = 1;
+    // A split's new right node and the key that separates it
+    void *right;
+    int separator;
+    // An overfull inner node laid out before it is split
+    int keys[BTREE_FANOUT];
+    void *children[BTREE_FANOUT + 1];
+    BTreeLeaf *leaf;
+    BTreeLeaf *new_leaf;
+    BTreeInner *inner;
+    BTreeInner *new_inner;
+    void *node;
+    int level, pos, half;
+
+    if (tree->root == NULL) {
+        tree->root = btree_node_alloc();
+        if (tree->root == NULL) {
+            return C_ERR_NO_MEMORY;
+        }
+        tree->first = tree->root;
+        tree->height = 0;
+        tree->nodes = 1;
     }
-    else if (e->data.type == TYPE_DB) {
-        printf("%-10s  %d dB\n", "DB", e->data.value.decibels);
+
+    node = tree->root;
+    for (level = tree->height - 1; level >= 0; level--) {
+        inner = node;
+        pos = upper_bound(inner->keys, inner->count - 1, key, comparisons);
+        path[level] = inner;
+        slot[level] = pos;
+        rightmost = rightmost && pos == inner->count - 1;
+        node = inner->children[pos];
     }
-    else if (e->data.type == TYPE_MOTION) {
-        printf("%-10s  [", "MOTION");
+    leaf = node;
+    pos = upper_bound(leaf->keys, leaf->count, key, comparisons);
 
-        // Loop through the 3-element motion array
-        for (i = 0; i < 3; i++) {
-            printf("%d", e->data.value.motion[i]);
-            if (i < 2) {
-                printf(",");
+    // A full leaf splits, then every full inner node above it, then a new
+    // root if the old one split
+    if (leaf->count == BTREE_LEAF_KEYS) {
+        for (needed = 1; needed <= tree->height && path[needed - 1]->count == BTREE_FANOUT;
+             needed++) {
+        }
+        if (needed > tree->height) {
+            needed++;
+        }
+    }
+    for (used = 0; used < needed; used++) {
+        spare[used] = btree_node_alloc();
+        if (spare[used] == NULL) {
+            while (used > 0) {
+                free(spare[--used]);
             }
+            return C_ERR_NO_MEMORY;
         }
-        printf("]\n");
+    }
+    tree->count++;
+    tree->nodes += needed;
+
+    if (needed == 0) {
+        btree_leaf_insert(leaf, pos, key, entry);
+        return C_ERR_OK;
+    }
+
+    used = 0;
+    new_leaf = spare[used++];
+    half = (rightmost && pos == BTREE_LEAF_KEYS) ? BTREE_LEAF_KEYS : BTREE_LEAF_KEYS / 2;
+    new_leaf->count = BTREE_LEAF_KEYS - half;
+    memcpy(new_leaf->keys, &leaf->keys[half], (size_t)new_leaf->count * sizeof(int));
+    memcpy(new_leaf->entries, &leaf->entries[half], (size_t)new_leaf->count * sizeof(LogEntry *));
+    leaf->count = half;
+    new_leaf->next = leaf->next;
+    leaf->next = new_leaf;
+    if (pos < half) {
+        btree_leaf_insert(leaf, pos, key, entry);
     }
     else {
-        // Unknown type
-        return C_ERR_INVALID;
+        btree_leaf_insert(new_leaf, pos - half, key, entry);
     }
-    
+    right = new_leaf;
+    separator = new_leaf->keys[0];
+
+    for (level = 0; level < tree->height; level++) {
+        inner = path[level];
+        pos = slot[level];
+        if (inner->count < BTREE_FANOUT) {
+            btree_inner_insert(inner, pos, separator, right);
+            return C_ERR_OK;
+        }
+
+        // Lay the node out with the new child, then keep the first half
+        // children here and move the rest; the key between them goes up
+        memcpy(keys, inner->keys, (size_t)pos * sizeof(int));
+        keys[pos] = separator;
+        memcpy(&keys[pos + 1], &inner->keys[pos], (size_t)(BTREE_FANOUT - 1 - pos) * sizeof(int));
+        memcpy(children, inner->children, (size_t)(pos + 1) * sizeof(void *));
+        children[pos + 1] = right;
+        memcpy(&children[pos + 2], &inner->children[pos + 1],
+               (size_t)(BTREE_FANOUT - 1 - pos) * sizeof(void *));
+
+        half = rightmost ? BTREE_FANOUT : (BTREE_FANOUT + 1) / 2;
+        new_inner = spare[used++];
+        new_inner->count = BTREE_FANOUT + 1 - half;
+        memcpy(new_inner->keys, &keys[half], (size_t)(new_inner->count - 1) * sizeof(int));
+        memcpy(new_inner->children, &children[half], (size_t)new_inner->count * sizeof(void *));
+        inner->count = half;
+        memcpy(inner->keys, keys, (size_t)(half - 1) * sizeof(int));
+        memcpy(inner->children, children, (size_t)half * sizeof(void *));
+        right = new_inner;
+        separator = keys[half - 1];
+    }
+
+    inner = spare[used];
+    inner->count = 2;
+    inner->keys[0] = separator;
+    inner->children[0] = tree->root;
+    inner->children[1] = right;
+    tree->root = inner;
+    tree->height++;
     return C_ERR_OK;
 }
 
-/* ---- room_print ------------------------------------------------------------
-   Purpose: Print a room header and all of its entries (already sorted).
+/* ---- btree_seek ------------------------------------------------------------
+   Purpose: Find the first entry of a B+tree with a key >= key.
    Params:
-     - r (in): room to print
-   Returns: C_ERR_OK, C_ERR_NULL_PTR if r is NULL
+     - tree (in): tree to search
+     - key (in): key to find
+     - leaf (out): its leaf, or NULL if every key is smaller
+     - slot (out): its position in the leaf
+   Returns: Nothing (void)
 ----------------------------------------------------------------------------- */
-int room_print(const Room *r) {
-    // Loop counter
-    int i;
-    // Store result from entry_print
-    int result;
-    
-    // Check for empty room
-    if (r == NULL) {
-        return C_ERR_NULL_PTR;
-    }
-    
-    // Print room header with name and entry count
-    printf("\nRoom: %s (entries=%d)\n", r->name, r->size);
-    
-    // Print column headers if there are entries to display
-    if (r->size > 0) {
-        printf("%-15s %10s  %-10s  %s\n", "ROOM", "TIMESTAMP", "TYPE", "VALUE");
-        printf("--------------- ----------  ----------  ---------------\n");
-        
-        // Print each entry in the room
-        for (i = 0; i < r->size; i++) {
+static void btree_seek(const BTree *tree, int key, const BTreeLeaf **leaf, int *slot) {
+    // Required by the search helpers, not reported
+    unsigned long comparisons = 0;
+    const BTreeInner *inner;
+    const void *node = tree->root;
+    int level;
 
-            // Call entry_print for each pointer in room's entries array
-            result = entry_print(r->entries[i]);
+    *leaf = NULL;
+    *slot = 0;
+    if (node == NULL) {
+        return;
+    }
 
-            // Check if printing failed
-            if (result != C_ERR_OK) {
-                printf("Error printing entry %d\n", i);
-            }
-        }
+    // Equal keys may sit left of a separator equal to them, so go left of it
+    for (level = tree->height; level > 0; level--) {
+        inner = node;
+        node = inner->children[lower_bound(inner->keys, inner->count - 1, key, &comparisons)];
     }
-    else {
-        printf("  (No entries)\n");
+    *leaf = node;
+    *slot = lower_bound((*leaf)->keys, (*leaf)->count, key, &comparisons);
+    if (*slot == (*leaf)->count) {
+        *leaf = (*leaf)->next;
+        *slot = 0;
     }
-    
-    return C_ERR_OK;
-}
\ No newline at end of file
+}
+
+/* ---- run_free --------------------------------------------------------------
+   Purpose: Free the arrays of a sorted run and leave it empty.
+----------------------------------------------------------------------------- */
+static void run_free(SortedRun *run) {
+    free(run->timestamps);
+    free(run->entries);
+    memset(run, 0, sizeof(*run));
+}
+
+/* ---- run_merge -------------------------------------------------------------
+   Purpose: Merge two sorted runs into a new one. Equal timestamps take the
+            older run's readings first, so arrival order is kept.
+   Params:
+     - out (out): the merged run, in new arrays
+     - older (in): run frozen first
+     - newer (in): run frozen after it
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (out is untouched)
+----------------------------------------------------------------------------- */
+static int run_merge(SortedRun *out, const SortedRun *older, const SortedRun *newer) {
+    int count = older->count + newer->count;
+    int *timestamps = malloc((size_t)count * sizeof(int));
+    LogEntry **entries = malloc((size_t)count * sizeof(LogEntry *));
+    int i = 0, j = 0, k;
+    PROFILE_CLOCK(started);
+
+    if (timestamps == NULL || entries == NULL) {
+        free(timestamps);
+        free(entries);
+        return C_ERR_NO_MEMORY;
+    }
+
+    for (k = 0; k < count; k++) {
+        if (j == newer->count || (i < older->count && older->timestamps[i] <= newer->timestamps[j])) {
+            timestamps[k] = older->timestamps[i];
+            entries[k] = older->entries[i++];
+        }
+        else {
+            timestamps[k] = newer->timestamps[j];
+            entries[k] = newer->entries[j++];
+        }
+    }
+
+    out->count = count;
+    out->timestamps = timestamps;
+    out->entries = entries;
+    PROFILE_COUNT(PROFILE_MERGE, moved, count);
+    PROFILE_STOP(PROFILE_MERGE, started);
+    return C_ERR_OK;
+}
+
+/* ---- memtable_freeze -------------------------------------------------------
+   Purpose: Copy the memtable of a series, leaf by leaf, into a new sorted
+            run after the others and empty it.
+   Params:
+     - series (in/out): series with a non-empty memtable and fewer than
+                        LSM_MAX_RUNS runs
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (nothing is changed)
+----------------------------------------------------------------------------- */
+static int memtable_freeze(Series *series) {
+    SortedRun *run;
+    const BTreeLeaf *leaf;
+    int count = 0;
+    PROFILE_CLOCK(started);
+
+    if (series->runs == NULL) {
+        series->runs = calloc(LSM_MAX_RUNS, sizeof(SortedRun));
+        if (series->runs == NULL) {
+            return C_ERR_NO_MEMORY;
+        }
+    }
+
+    run = &series->runs[series->num_runs];
+    run->timestamps = malloc((size_t)series->late.count * sizeof(int));
+    run->entries = malloc((size_t)series->late.count * sizeof(LogEntry *));
+    if (run->timestamps == NULL || run->entries == NULL) {
+        run_free(run);
+        return C_ERR_NO_MEMORY;
+    }
+
+    for (leaf = series->late.first; leaf != NULL; leaf = leaf->next) {
+        memcpy(&run->timestamps[count], leaf->keys, (size_t)leaf->count * sizeof(int));
+        memcpy(&run->entries[count], leaf->entries, (size_t)leaf->count * sizeof(LogEntry *));
+        count += leaf->count;
+    }
+    run->count = count;
+    series->num_runs++;
+    series->run_readings += count;
+    btree_clear(&series->late);
+    PROFILE_COUNT(PROFILE_FREEZE, moved, count);
+    PROFILE_STOP(PROFILE_FREEZE, started);
+    return C_ERR_OK;
+}
+
+/* ---- runs_compact ----------------------------------------------------------
+   Purpose: Merge the newest two runs of a series into one while the older
+            is at most LSM_RUN_RATIO times the newer's size, or, with all
+            set, until a single run is left.
+   Params:
+     - series (in/out): series to compact
+     - all (in): non-zero to merge every run
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (the runs merged so far stay merged)
+----------------------------------------------------------------------------- */
+static int runs_compact(Series *series, int all) {
+    SortedRun merged;
+    SortedRun *older, *newer;
+
+    while (series->num_runs > 1) {
+        older = &series->runs[series->num_runs - 2];
+        newer = &series->runs[series->num_runs - 1];
+        if (!all && older->count > LSM_RUN_RATIO * newer->count) {
+            break;
+        }
+        if (run_merge(&merged, older, newer) != C_ERR_OK) {
+            return C_ERR_NO_MEMORY;
+        }
+        run_free(older);
+        run_free(newer);
+        *older = merged;
+        series->num_runs--;
+    }
+    return C_ERR_OK;
+}
+
+/* ---- memtable_spill --------------------------------------------------------
+   Purpose: Freeze a full memtable into a run and compact the runs; once
+            they hold as many readings as the columns, merge everything
+            into the columns. This is the ingest path's share of the
+            compaction work, and it is best effort: whatever fails for lack
+            of memory stays where it is and is tried again at the next
+            spill or settle.
+   Params:
+     - series (in/out): series whose memtable reached LSM_MEMTABLE_KEYS
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void memtable_spill(Series *series) {
+    if (series->num_runs == LSM_MAX_RUNS || memtable_freeze(series) != C_ERR_OK ||
+        runs_compact(series, 0) != C_ERR_OK) {
+        return;
+    }
+    if (series->run_readings >= series->size) {
+        series_settle(series);
+    }
+}
+
+/* ---- series_settle ---------------------------------------------------------
+   Purpose: Merge the late readings of a series (see LSM_MEMTABLE_KEYS) into
+            its columns. The memtable and runs are merged into a single run
+            first, which then goes into the columns from the back: the
+            column readings newer than each late reading move up past the
+            gap it and the older late readings need, in one run, and it
+            goes into the top of the gap, so each column reading moves once,
+            straight to its final position. A late reading goes after
+            column readings with the same timestamp, as a direct insert
+            would have put it. Rolling statistics are rebuilt. Readers that
+            need the columns whole settle the series first, which is a
+            single check when nothing is late.
+   Params:
+     - series (in/out): series to settle, or NULL
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (no reading is lost; late ones may
+            have been merged into fewer runs)
+----------------------------------------------------------------------------- */
+int series_settle(Series *series) {
+    // Required by the search helper, not reported
+    unsigned long comparisons = 0;
+    const SortedRun *run;
+    RollingStats *stats;
+    LogEntry *e;
+    // Late readings, and the column readings not yet moved, [0, end)
+    int late, end;
+    // First column reading newer than a late one, and where that goes
+    int start, pos;
+    int i;
+    PROFILE_CLOCK(started);
+
+    if (series == NULL) {
+        return C_ERR_OK;
+    }
+    late = series->late.count + series->run_readings;
+    if (late == 0) {
+        return C_ERR_OK;
+    }
+
+    if (series_reserve(series, series->size + late) != C_ERR_OK ||
+        rolling_reserve(series->room, series->type, late) != C_ERR_OK ||
+        runs_compact(series, 1) != C_ERR_OK ||
+        (series->late.count > 0 &&
+         (memtable_freeze(series) != C_ERR_OK || runs_compact(series, 1) != C_ERR_OK))) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    run = &series->runs[0];
+    end = series->size;
+    for (i = run->count - 1; i >= 0; i--) {
+        // Equal timestamps: the late reading goes after the column's
+        start = upper_bound(series->timestamps, end, run->timestamps[i], &comparisons);
+        shift_entries_right(series, start, end, i + 1);
+        pos = start + i;
+        e = run->entries[i];
+        series_store(series, pos, e->timestamp, e->value);
+        series->rows[pos] = e;
+        end = start;
+    }
+
+    series->size += late;
+    run_free(&series->runs[0]);
+    series->num_runs = 0;
+    series->run_readings = 0;
+    stats = series->room->rolling[series->type - 1];
+    if (stats != NULL) {
+        rolling_rebuild(stats, series);
+    }
+    PROFILE_COUNT(PROFILE_SETTLE, comparisons, comparisons);
+    PROFILE_STOP(PROFILE_SETTLE, started);
+    return C_ERR_OK;
+}
+
+/* ---- entries_settle --------------------------------------------------------
+   Purpose: Settle every series of a collection (see series_settle), before
+            a pass over all of them.
+   Params:
+     - ec (in): entry collection; its series are changed, not the readings
+                they hold
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int entries_settle(const EntryCollection *ec) {
+    int i;
+
+    for (i = 0; i < ec->num_series; i++) {
+        if (series_settle(ec->series[i]) != C_ERR_OK) {
+            return C_ERR_NO_MEMORY;
+        }
+    }
+    return C_ERR_OK;
+}
+
+/* ---- series_values_bytes ---------------------------------------------------
+   Purpose: Size of a value column holding count readings.
+   Params:
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - count (in): number of readings
+   Returns: size in bytes
+----------------------------------------------------------------------------- */
+static size_t series_values_bytes(int type, int count) {
+    if (type == TYPE_TEMP) {
+        return (size_t)count * sizeof(float);
+    }
+    if (type == TYPE_DB) {
+        return (size_t)count * sizeof(int);
+    }
+    return MOTION_WORDS(count) * sizeof(unsigned long long);
+}
+
+/* ---- motion_normalize ------------------------------------------------------
+   Purpose: Store every motion flag as 0 or 1, the only values a bitplane
+            can hold, so the row and column views of a reading agree.
+   Params:
+     - value (in/out): motion value to normalize
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void motion_normalize(ReadingValue *value) {
+    value->motion[0] = (value->motion[0] != 0);
+    value->motion[1] = (value->motion[1] != 0);
+    value->motion[2] = (value->motion[2] != 0);
+}
+
+/* ---- motion_popcount -------------------------------------------------------
+   Purpose: Number of set bits in a bitplane word.
+----------------------------------------------------------------------------- */
+static int motion_popcount(unsigned long long word) {
+    return __builtin_popcountll(word);
+}
+
+/* ---- series_rebase ---------------------------------------------------------
+   Purpose: Move an owned series' columns back to the start of their
+            allocations after retention_drop_before moved their start
+            forward (see Series.offset), so they can be reallocated; motion
+            bits are shifted down to reading 0.
+   Params:
+     - series (in/out): series to rebase (not mapped)
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void series_rebase(Series *series) {
+    unsigned char *values;
+
+    if (series->offset == 0) {
+        return;
+    }
+
+    memmove(series->timestamps - series->offset, series->timestamps,
+            (size_t)series->size * sizeof(int));
+    series->timestamps -= series->offset;
+    memmove(series->rows - series->offset, series->rows, (size_t)series->size * sizeof(LogEntry *));
+    series->rows -= series->offset;
+    if (series->type == TYPE_MOTION) {
+        motion_shift_left(series->values.motion, series->offset, series->offset + series->size);
+    }
+    else {
+        // Temperatures and decibels are both 4 bytes wide
+        values = (unsigned char *)series->values.raw - (size_t)series->offset * sizeof(int);
+        memmove(values, series->values.raw, (size_t)series->size * sizeof(int));
+        series->values.raw = values;
+    }
+    series->capacity += series->offset;
+    series->offset = 0;
+}
+
+/* ---- series_reserve --------------------------------------------------------
+   Purpose: Make sure every column of a series has room for at least 'needed'
+            elements, doubling the capacity when it has to grow. Columns
+            that were already grown keep their new size if a later one fails,
+            so the series stays usable either way. Columns that start past
+            readings dropped by retention are moved back first.
+   Params:
+     - series (in/out): series to grow
+     - needed (in): number of elements that must fit
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int series_reserve(Series *series, int needed) {
+    // The new capacity and the reallocated columns
+    int new_capacity;
+    int *timestamps;
+    void *values;
+    LogEntry **rows;
+    // Bytes of the value column before it grows
+    size_t old_bytes;
+
+    if (needed <= series->capacity) {
+        return C_ERR_OK;
+    }
+
+    series_rebase(series);
+    if (needed <= series->capacity) {
+        return C_ERR_OK;
+    }
+    old_bytes = series_values_bytes(series->type, series->capacity);
+
+    new_capacity = (series->capacity > 0) ? series->capacity : MAX_ARR;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    timestamps = realloc(series->timestamps, (size_t)new_capacity * sizeof(int));
+    if (timestamps == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    series->timestamps = timestamps;
+
+    values = realloc(series->values.raw, series_values_bytes(series->type, new_capacity));
+    if (values == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    series->values.raw = values;
+    // Motion bits past the last reading must read as zero
+    memset((unsigned char *)values + old_bytes, 0,
+           series_values_bytes(series->type, new_capacity) - old_bytes);
+
+    rows = realloc(series->rows, (size_t)new_capacity * sizeof(LogEntry *));
+    if (rows == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    series->rows = rows;
+
+    series->capacity = new_capacity;
+    return C_ERR_OK;
+}
+
+/* ---- series_store ----------------------------------------------------------
+   Purpose: Write a timestamp and value into position pos of a series' columns.
+   Params:
+     - series (in/out): series to write to (pos < capacity)
+     - pos (in): position to write
+     - timestamp (in): timestamp of the reading
+     - value (in): value of the reading, interpreted by series->type
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void series_store(Series *series, int pos, int timestamp, ReadingValue value) {
+    // The reading's bit in each motion plane
+    unsigned long long *words;
+    unsigned long long bit;
+    int d;
+
+    series->timestamps[pos] = timestamp;
+
+    if (series->type == TYPE_TEMP) {
+        series->values.temperature[pos] = value.temperature;
+    }
+    else if (series->type == TYPE_DB) {
+        series->values.decibels[pos] = value.decibels;
+    }
+    else {
+        pos += series->offset;
+        words = &series->values.motion[MOTION_PLANES * (pos / 64)];
+        bit = 1ULL << (pos % 64);
+        for (d = 0; d < MOTION_PLANES; d++) {
+            words[d] = (value.motion[d] != 0) ? (words[d] | bit) : (words[d] & ~bit);
+        }
+    }
+}
+
+/* ---- series_value ----------------------------------------------------------
+   Purpose: Read the value at position i of a series' columns back as a
+            ReadingValue (sealed readings are read with a SeriesReader).
+   Params:
+     - series (in): series to read
+     - i (in): column position, 0 <= i < series->size
+   Returns: the value (unused union bytes are zero)
+----------------------------------------------------------------------------- */
+ReadingValue series_value(const Series *series, int i) {
+    ReadingValue value;
+    const unsigned long long *words;
+
+    memset(&value, 0, sizeof(value));
+    if (series->type == TYPE_TEMP) {
+        value.temperature = series->values.temperature[i];
+    }
+    else if (series->type == TYPE_DB) {
+        value.decibels = series->values.decibels[i];
+    }
+    else {
+        i += series->offset;
+        words = &series->values.motion[MOTION_PLANES * (i / 64)];
+        value.motion[0] = (unsigned char)((words[0] >> (i % 64)) & 1);
+        value.motion[1] = (unsigned char)((words[1] >> (i % 64)) & 1);
+        value.motion[2] = (unsigned char)((words[2] >> (i % 64)) & 1);
+    }
+
+    return value;
+}
+
+/* ---- bits_put --------------------------------------------------------------
+   Purpose: Append the low n bits of value to a block stream.
+   Params:
+     - w (in/out): stream being written
+     - value (in): the bits, in its low n bits
+     - n (in): number of bits, 1 to 32
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void bits_put(BitWriter *w, unsigned long long value, int n) {
+    w->bits = (w->bits << n) | (value & ((1ULL << n) - 1));
+    w->count += n;
+    while (w->count >= 8) {
+        w->count -= 8;
+        w->out[w->used++] = (unsigned char)(w->bits >> w->count);
+    }
+}
+
+/* ---- bits_finish -----------------------------------------------------------
+   Purpose: Pad a block stream with zero bits to a whole byte.
+   Returns: bytes written to the stream
+----------------------------------------------------------------------------- */
+static size_t bits_finish(BitWriter *w) {
+    if (w->count > 0) {
+        w->out[w->used++] = (unsigned char)(w->bits << (8 - w->count));
+        w->count = 0;
+    }
+    return w->used;
+}
+
+/* ---- bits_open -------------------------------------------------------------
+   Purpose: Start reading a block stream that occupies [start, end).
+----------------------------------------------------------------------------- */
+static void bits_open(BitReader *r, const unsigned char *start, const unsigned char *end) {
+    r->next = start;
+    r->end = end;
+    r->bits = 0;
+    r->count = 0;
+}
+
+/* ---- bits_get --------------------------------------------------------------
+   Purpose: Read the next n bits of a block stream. Reading past the end
+            gives zero bits.
+   Params:
+     - r (in/out): stream being read
+     - n (in): number of bits, 1 to 32
+   Returns: the bits, as the low n bits of the result
+----------------------------------------------------------------------------- */
+static unsigned int bits_get(BitReader *r, int n) {
+    while (r->count < n) {
+        r->bits = (r->bits << 8) | (r->next < r->end ? *r->next++ : 0);
+        r->count += 8;
+    }
+    r->count -= n;
+    return (unsigned int)((r->bits >> r->count) & ((1ULL << n) - 1));
+}
+
+/* ---- put_dod ---------------------------------------------------------------
+   Purpose: Append one timestamp delta-of-delta: '0' for none, then '10',
+            '110' and '1110' with 7, 9 and 12 bits for growing ranges, and
+            '1111' with all 64 bits for anything larger.
+   Params:
+     - w (in/out): timestamp stream
+     - dod (in): this delta minus the previous one
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void put_dod(BitWriter *w, long long dod) {
+    if (dod == 0) {
+        bits_put(w, 0, 1);
+    }
+    else if (dod >= -63 && dod <= 64) {
+        bits_put(w, 2, 2);
+        bits_put(w, (unsigned long long)(dod + 63), 7);
+    }
+    else if (dod >= -255 && dod <= 256) {
+        bits_put(w, 6, 3);
+        bits_put(w, (unsigned long long)(dod + 255), 9);
+    }
+    else if (dod >= -2047 && dod <= 2048) {
+        bits_put(w, 14, 4);
+        bits_put(w, (unsigned long long)(dod + 2047), 12);
+    }
+    else {
+        bits_put(w, 15, 4);
+        bits_put(w, (unsigned long long)dod >> 32, 32);
+        bits_put(w, (unsigned long long)dod, 32);
+    }
+}
+
+/* ---- get_dod ---------------------------------------------------------------
+   Purpose: Read one timestamp delta-of-delta written by put_dod.
+----------------------------------------------------------------------------- */
+static long long get_dod(BitReader *r) {
+    unsigned long long high;
+
+    if (bits_get(r, 1) == 0) {
+        return 0;
+    }
+    if (bits_get(r, 1) == 0) {
+        return (long long)bits_get(r, 7) - 63;
+    }
+    if (bits_get(r, 1) == 0) {
+        return (long long)bits_get(r, 9) - 255;
+    }
+    if (bits_get(r, 1) == 0) {
+        return (long long)bits_get(r, 12) - 2047;
+    }
+    high = bits_get(r, 32);
+    return (long long)((high << 32) | bits_get(r, 32));
+}
+
+/* ---- put_varint ------------------------------------------------------------
+   Purpose: Write a delta zig-zag encoded (0, -1, 1, -2, ... become 0, 1, 2,
+            3, ...) as a varint, 7 bits per byte with the high bit set on
+            every byte but the last.
+   Params:
+     - p (out): where to write, room for 10 bytes
+     - delta (in): value to write
+   Returns: pointer past the last byte written
+----------------------------------------------------------------------------- */
+static unsigned char* put_varint(unsigned char *p, long long delta) {
+    unsigned long long v = ((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63);
+
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+/* ---- get_varint ------------------------------------------------------------
+   Purpose: Read a delta written by put_varint and advance *p past it.
+----------------------------------------------------------------------------- */
+static long long get_varint(const unsigned char **p) {
+    const unsigned char *q = *p;
+    unsigned long long v = 0;
+    int shift = 0;
+
+    while (*q & 0x80) {
+        v |= (unsigned long long)(*q++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= (unsigned long long)*q++ << shift;
+
+    *p = q;
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+/* ---- block_encode ----------------------------------------------------------
+   Purpose: Compress readings pos .. pos + count - 1 of a series' columns
+            into a new sealed block (layout described at SeriesBlock).
+            A temperature equal to the one before costs '0'; otherwise its
+            XOR with it costs '10' and the bits of the previous window when
+            they fit there, or '11', the number of leading zeros (5 bits),
+            the width - 1 (5 bits) and the XOR's meaningful bits.
+   Params:
+     - series (in): series to read, with pos a multiple of 64
+     - pos (in): first column position
+     - count (in): readings, 1 to SERIES_BLOCK_SIZE
+     - scratch (in): work space of BLOCK_SCRATCH_BYTES
+   Returns: the block, or NULL if out of memory
+----------------------------------------------------------------------------- */
+static SeriesBlock* block_encode(const Series *series, int pos, int count, unsigned char *scratch) {
+    const int *timestamps = series->timestamps + pos;
+    SeriesBlock *block;
+    BitWriter w;
+    unsigned char *p = scratch;
+    size_t value_bytes, bytes;
+    // Float bits of this and the previous temperature, and their XOR
+    unsigned int bits, previous = 0, x;
+    // The current XOR window; 33 leading zeros means there is none yet
+    int leading = 33, trailing = 0, lz, tz;
+    long long delta = 0, next_delta;
+    int i;
+
+    memset(&w, 0, sizeof(w));
+    w.out = scratch;
+    if (series->type == TYPE_TEMP) {
+        for (i = 0; i < count; i++) {
+            memcpy(&bits, &series->values.temperature[pos + i], sizeof(bits));
+            x = bits ^ previous;
+            if (i == 0) {
+                bits_put(&w, bits, 32);
+            }
+            else if (x == 0) {
+                bits_put(&w, 0, 1);
+            }
+            else {
+                lz = __builtin_clz(x);
+                tz = __builtin_ctz(x);
+                if (lz >= leading && tz >= trailing) {
+                    bits_put(&w, 2, 2);
+                    bits_put(&w, x >> trailing, 32 - leading - trailing);
+                }
+                else {
+                    leading = lz;
+                    trailing = tz;
+                    bits_put(&w, 3, 2);
+                    bits_put(&w, (unsigned long long)lz, 5);
+                    bits_put(&w, (unsigned long long)(32 - lz - tz - 1), 5);
+                    bits_put(&w, x >> tz, 32 - lz - tz);
+                }
+            }
+            previous = bits;
+        }
+        value_bytes = bits_finish(&w);
+    }
+    else if (series->type == TYPE_DB) {
+        for (i = 0; i < count; i++) {
+            p = put_varint(p, (long long)series->values.decibels[pos + i] -
+                              (i > 0 ? series->values.decibels[pos + i - 1] : 0));
+        }
+        value_bytes = (size_t)(p - scratch);
+    }
+    else {
+        value_bytes = MOTION_WORDS(count) * sizeof(unsigned long long);
+        memcpy(scratch, &series->values.motion[MOTION_PLANES * (pos / 64)], value_bytes);
+    }
+
+    // The first timestamp is in the header; each one after it is a delta-of-delta
+    memset(&w, 0, sizeof(w));
+    w.out = scratch + value_bytes;
+    for (i = 1; i < count; i++) {
+        next_delta = (long long)timestamps[i] - timestamps[i - 1];
+        put_dod(&w, next_delta - delta);
+        delta = next_delta;
+    }
+    bytes = value_bytes + bits_finish(&w);
+
+    block = malloc(sizeof(SeriesBlock) + bytes);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->count = count;
+    block->first = timestamps[0];
+    block->last = timestamps[count - 1];
+    block->value_bytes = (unsigned int)value_bytes;
+    block->bytes = (unsigned int)bytes;
+    memcpy(block->data, scratch, bytes);
+    return block;
+}
+
+/* ---- block_range -----------------------------------------------------------
+   Purpose: Find the readings of a block inside [t_from, t_to] by decoding
+            its timestamps only.
+   Params:
+     - block (in): block to search
+     - t_from, t_to (in): the range, inclusive
+     - first (out): first reading in range
+     - last (out): one past the last reading in range
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void block_range(const SeriesBlock *block, int t_from, int t_to, int *first, int *last) {
+    const unsigned char *data = (const unsigned char *)block->data;
+    BitReader times;
+    long long timestamp = block->first;
+    long long delta = 0;
+    int i;
+
+    bits_open(&times, data + block->value_bytes, data + block->bytes);
+    *first = 0;
+    *last = block->count;
+    for (i = 0; i < block->count; i++) {
+        if (i > 0) {
+            delta += get_dod(&times);
+            timestamp += delta;
+        }
+        if (timestamp < t_from) {
+            *first = i + 1;
+        }
+        if (timestamp > t_to) {
+            *last = i;
+            return;
+        }
+    }
+}
+
+/* ---- first_block -----------------------------------------------------------
+   Purpose: Binary search the sealed blocks of a series by their last
+            timestamp.
+   Returns: the first block with readings at or after t_from, num_blocks if
+            there is none
+----------------------------------------------------------------------------- */
+static int first_block(const Series *series, int t_from) {
+    // Search window [low, high)
+    int low = 0;
+    int high = series->num_blocks;
+    int mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (series->blocks[mid]->last < t_from) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/* ---- sealed_last -----------------------------------------------------------
+   Purpose: Newest sealed timestamp of a series with sealed readings.
+----------------------------------------------------------------------------- */
+static int sealed_last(const Series *series) {
+    return series->blocks[series->num_blocks - 1]->last;
+}
+
+/* ---- block_start -----------------------------------------------------------
+   Purpose: Point a reader at the start of its current block.
+----------------------------------------------------------------------------- */
+static void block_start(SeriesReader *reader) {
+    const SeriesBlock *block = reader->series->blocks[reader->block];
+    const unsigned char *data = (const unsigned char *)block->data;
+
+    reader->index = 0;
+    reader->delta = 0;
+    bits_open(&reader->times, data + block->value_bytes, data + block->bytes);
+    bits_open(&reader->temps, data, data + block->value_bytes);
+    reader->varint = data;
+}
+
+/* ---- reader_advance --------------------------------------------------------
+   Purpose: Decode the reading after the one a reader holds (or its first),
+            moving on to the next block or to the columns as each runs out.
+            Clears ready at the end of the series.
+   Params:
+     - reader (in/out): reader to advance
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void reader_advance(SeriesReader *reader) {
+    const Series *series = reader->series;
+    const SeriesBlock *block;
+    const unsigned long long *words;
+    ReadingValue value;
+    // Float bits of the temperature, built from the previous one's
+    unsigned int bits;
+    int width;
+
+    if (reader->block < series->num_blocks &&
+        reader->index == series->blocks[reader->block]->count) {
+        reader->block++;
+        if (reader->block < series->num_blocks) {
+            block_start(reader);
+        }
+    }
+
+    if (reader->block == series->num_blocks && (series->num_runs > 0 || series->late.count > 0)) {
+        reader_merge_late(reader);
+        return;
+    }
+    if (reader->block == series->num_blocks) {
+        reader->ready = (reader->pos < series->size);
+        if (reader->ready) {
+            reader->timestamp = series->timestamps[reader->pos];
+            reader->value = series_value(series, reader->pos);
+            reader->entry = (series->rows != NULL) ? series->rows[reader->pos] : NULL;
+            reader->pos++;
+        }
+        return;
+    }
+
+    block = series->blocks[reader->block];
+    if (reader->index == 0) {
+        reader->timestamp = block->first;
+    }
+    else {
+        reader->delta += get_dod(&reader->times);
+        reader->timestamp = (int)(reader->timestamp + reader->delta);
+    }
+
+    memset(&value, 0, sizeof(value));
+    if (series->type == TYPE_TEMP) {
+        memcpy(&bits, &reader->value.temperature, sizeof(bits));
+        if (reader->index == 0) {
+            bits = bits_get(&reader->temps, 32);
+        }
+        else if (bits_get(&reader->temps, 1) != 0) {
+            if (bits_get(&reader->temps, 1) != 0) {
+                reader->leading = (int)bits_get(&reader->temps, 5);
+                width = (int)bits_get(&reader->temps, 5) + 1;
+                reader->trailing = 32 - reader->leading - width;
+            }
+            bits ^= bits_get(&reader->temps, 32 - reader->leading - reader->trailing)
+                    << reader->trailing;
+        }
+        memcpy(&value.temperature, &bits, sizeof(bits));
+    }
+    else if (series->type == TYPE_DB) {
+        value.decibels = (int)((reader->index > 0 ? reader->value.decibels : 0) +
+                               get_varint(&reader->varint));
+    }
+    else {
+        words = &block->data[MOTION_PLANES * (reader->index / 64)];
+        value.motion[0] = (unsigned char)((words[0] >> (reader->index % 64)) & 1);
+        value.motion[1] = (unsigned char)((words[1] >> (reader->index % 64)) & 1);
+        value.motion[2] = (unsigned char)((words[2] >> (reader->index % 64)) & 1);
+    }
+
+    reader->value = value;
+    reader->entry = NULL;
+    reader->index++;
+    reader->ready = 1;
+}
+
+/* ---- reader_merge_late -----------------------------------------------------
+   Purpose: Read the next reading of a series with late readings past its
+            sealed ones: the oldest of the next column reading, the next
+            reading of each run and the next memtable reading. Equal
+            timestamps go in that order, which is the order a direct insert
+            would have put them in. Clears ready at the end of the series.
+   Params:
+     - reader (in/out): reader in the columns of a series with late readings
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void reader_merge_late(SeriesReader *reader) {
+    const Series *series = reader->series;
+    const SortedRun *run;
+    const LogEntry *e;
+    // Oldest next timestamp so far and where it comes from: -1 for the
+    // columns, a run, or num_runs for the memtable
+    int best = 0;
+    int source = -2;
+    int r;
+
+    if (reader->pos < series->size) {
+        best = series->timestamps[reader->pos];
+        source = -1;
+    }
+    for (r = 0; r < series->num_runs; r++) {
+        run = &series->runs[r];
+        if (reader->run_pos[r] < run->count &&
+            (source == -2 || run->timestamps[reader->run_pos[r]] < best)) {
+            best = run->timestamps[reader->run_pos[r]];
+            source = r;
+        }
+    }
+    if (reader->leaf != NULL && (source == -2 || reader->leaf->keys[reader->slot] < best)) {
+        source = series->num_runs;
+    }
+
+    reader->ready = (source != -2);
+    if (source == -2) {
+        return;
+    }
+    if (source == -1) {
+        reader->timestamp = best;
+        reader->value = series_value(series, reader->pos);
+        reader->entry = series->rows[reader->pos];
+        reader->pos++;
+        return;
+    }
+
+    // The timestamp is the key the reading is kept under
+    if (source < series->num_runs) {
+        run = &series->runs[source];
+        reader->timestamp = run->timestamps[reader->run_pos[source]];
+        e = run->entries[reader->run_pos[source]++];
+    }
+    else {
+        reader->timestamp = reader->leaf->keys[reader->slot];
+        e = reader->leaf->entries[reader->slot];
+        if (++reader->slot == reader->leaf->count) {
+            reader->leaf = reader->leaf->next;
+            reader->slot = 0;
+        }
+    }
+    reader->entry = e;
+    memset(&reader->value, 0, sizeof(reader->value));
+    if (series->type == TYPE_MOTION) {
+        memcpy(reader->value.motion, e->value.motion, sizeof(e->value.motion));
+    }
+    else {
+        reader->value = e->value;
+    }
+}
+
+/* ---- series_reader_init ----------------------------------------------------
+   Purpose: Position a reader at the first reading of a series with a
+            timestamp not before t_from. Sealed blocks are found by binary
+            search on their last timestamp, and the columns and late runs
+            by binary search on their timestamps and the memtable by its
+            keys; inside a block the readings before t_from are decoded and
+            skipped.
+   Params:
+     - reader (out): reader to set up
+     - series (in): series to read
+     - t_from (in): first timestamp to read, INT_MIN for all of them
+   Returns: C_ERR_OK, C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int series_reader_init(SeriesReader *reader, const Series *series, int t_from) {
+    // Required by the search helpers, not reported
+    unsigned long comparisons = 0;
+    int r;
+
+    if (reader == NULL || series == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    memset(reader, 0, sizeof(*reader));
+    reader->series = series;
+    // Late readings are never older than the sealed ones
+    for (r = 0; r < series->num_runs; r++) {
+        reader->run_pos[r] = lower_bound(series->runs[r].timestamps, series->runs[r].count,
+                                         t_from, &comparisons);
+    }
+    btree_seek(&series->late, t_from, &reader->leaf, &reader->slot);
+    reader->block = first_block(series, t_from);
+    if (reader->block < series->num_blocks) {
+        block_start(reader);
+    }
+    else {
+        reader->pos = lower_bound(series->timestamps, series->size, t_from, &comparisons);
+    }
+
+    reader_advance(reader);
+    while (reader->ready && reader->timestamp < t_from) {
+        reader_advance(reader);
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- late_reader_init ------------------------------------------------------
+   Purpose: Position a reader at the first late reading of a series (see
+            LSM_MEMTABLE_KEYS) with a timestamp not before t_from. It starts
+            past the blocks and the columns, so it reads only the runs and
+            the memtable, merged in timestamp order. Used by readers that
+            take the sealed and column readings straight from their blocks
+            and columns.
+   Params:
+     - reader (out): reader to set up
+     - series (in): series to read
+     - t_from (in): first timestamp to read
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void late_reader_init(SeriesReader *reader, const Series *series, int t_from) {
+    // Required by the search helpers, not reported
+    unsigned long comparisons = 0;
+    int r;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->series = series;
+    for (r = 0; r < series->num_runs; r++) {
+        reader->run_pos[r] = lower_bound(series->runs[r].timestamps, series->runs[r].count,
+                                         t_from, &comparisons);
+    }
+    btree_seek(&series->late, t_from, &reader->leaf, &reader->slot);
+    reader->block = series->num_blocks;
+    reader->pos = series->size;
+    reader_advance(reader);
+}
+
+/* ---- series_reader_next ----------------------------------------------------
+   Purpose: Return the next reading of a series in timestamp order.
+   Params:
+     - reader (in/out): reader set up by series_reader_init
+     - timestamp (out): the reading's timestamp
+     - value (out): the reading's value (unused union bytes are zero)
+   Returns: 1 for a reading, 0 once the series has been read to the end
+----------------------------------------------------------------------------- */
+int series_reader_next(SeriesReader *reader, int *timestamp, ReadingValue *value) {
+    if (reader == NULL || timestamp == NULL || value == NULL || !reader->ready) {
+        return 0;
+    }
+
+    *timestamp = reader->timestamp;
+    *value = reader->value;
+    reader_advance(reader);
+    return 1;
+}
+
+/* ---- series_decode ---------------------------------------------------------
+   Purpose: Write the sealed and column readings of a series into columns
+            in the in-memory layout (see Series), e.g. to save them, and
+            with late set its late readings too, merged in where
+            series_settle would put them. The series is not changed.
+   Params:
+     - series (in): series to read
+     - timestamps (out): room for every timestamp written
+     - values (out): value column of the type with room for every reading
+                     written: sealed + size, plus late.count + run_readings
+                     with late set
+     - late (in): non-zero to merge in the late readings
+   Returns: number of readings written, C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int series_decode(const Series *series, int *timestamps, void *values, int late) {
+    // The output columns, written through series_store
+    Series columns;
+    SeriesReader reader;
+    ReadingValue value;
+    int timestamp;
+    // Readings to write, and written so far
+    int size;
+    int count = 0;
+    int i;
+
+    if (series == NULL || timestamps == NULL || values == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    size = series->sealed + series->size;
+    if (late) {
+        size += series->late.count + series->run_readings;
+    }
+    memset(&columns, 0, sizeof(columns));
+    columns.type = series->type;
+    columns.timestamps = timestamps;
+    columns.values.raw = values;
+    memset(values, 0, series_values_bytes(series->type, size));
+
+    if (late) {
+        series_reader_init(&reader, series, INT_MIN);
+        while (series_reader_next(&reader, &timestamp, &value)) {
+            series_store(&columns, count++, timestamp, value);
+        }
+        return count;
+    }
+
+    // Late readings are never older than the sealed ones, so the reader
+    // only merges them in after the last block
+    series_reader_init(&reader, series, INT_MIN);
+    while (count < series->sealed && series_reader_next(&reader, &timestamp, &value)) {
+        series_store(&columns, count++, timestamp, value);
+    }
+    for (i = 0; i < series->size; i++) {
+        series_store(&columns, count++, series->timestamps[i], series_value(series, i));
+    }
+
+    return count;
+}
+
+/* ---- get_series ------------------------------------------------------------
+   Purpose: Return the series for (room, type), creating it and slotting it
+            into the series directory the first time it gets an entry. The
+            directory is ordered by room id, then type.
+   Params:
+     - ec (in/out): entry collection that owns the series
+     - room (in/out): owning room, its series[] slot is filled in
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+   Returns: the series, or NULL if out of memory
+----------------------------------------------------------------------------- */
+static Series* get_series(EntryCollection *ec, Room *room, int type) {
+    // Search window [low, high) over the directory
+    int low = 0;
+    int high = ec->num_series;
+    int mid;
+    int new_cap;
+    Series *series = room->series[type - 1];
+    Series *probe;
+    Series **grown;
+
+    if (series != NULL) {
+        return series;
+    }
+
+    if (ec->num_series == ec->series_cap) {
+        new_cap = (ec->series_cap > 0) ? ec->series_cap * 2 : MAX_ARR;
+        grown = realloc(ec->series, (size_t)new_cap * sizeof(Series *));
+        if (grown == NULL) {
+            return NULL;
+        }
+        ec->series = grown;
+        ec->series_cap = new_cap;
+    }
+
+    series = calloc(1, sizeof(Series));
+    if (series == NULL) {
+        return NULL;
+    }
+    series->room = room;
+    series->type = type;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        probe = ec->series[mid];
+        if (probe->room->id < room->id || (probe->room == room && probe->type < type)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    memmove(&ec->series[low + 1], &ec->series[low], (size_t)(ec->num_series - low) * sizeof(Series *));
+    ec->series[low] = series;
+    ec->num_series++;
+    room->series[type - 1] = series;
+
+    return series;
+}
+
+/* ---- series_thaw ----------------------------------------------------------
+   Purpose: Give a mapped series its own columns and stored entries so it can
+            change. The snapshot mapping is never written to; a series is
+            copied the first time a reading is added to it, and series that
+            are only read stay in the mapping.
+   Params:
+     - ec (in/out): entry collection that owns the series and the chunks
+     - series (in/out): series to copy, nothing happens unless it is mapped
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (the series is left mapped)
+----------------------------------------------------------------------------- */
+static int series_thaw(EntryCollection *ec, Series *series) {
+    // The mapped series, read from and kept in case the copy fails
+    Series mapped = *series;
+    int i;
+    LogEntry *e;
+
+    if (!series->mapped) {
+        return C_ERR_OK;
+    }
+
+    series->timestamps = NULL;
+    series->values.raw = NULL;
+    series->capacity = 0;
+    series->offset = 0;
+    if (series_reserve(series, series->size) == C_ERR_OK) {
+        memcpy(series->timestamps, mapped.timestamps, (size_t)series->size * sizeof(int));
+        if (series->type == TYPE_MOTION && mapped.offset > 0) {
+            // Retention left the mapped bits past an offset; copy from reading 0
+            for (i = 0; i < series->size; i++) {
+                series_store(series, i, series->timestamps[i], series_value(&mapped, i));
+            }
+        }
+        else {
+            memcpy(series->values.raw, mapped.values.raw,
+                   series_values_bytes(series->type, series->size));
+        }
+
+        for (i = 0; i < series->size; i++) {
+            e = allocate_entry_slot(ec, series->timestamps[i]);
+            if (e == NULL) {
+                break;
+            }
+            e->room = (unsigned int)series->room->seq;
+            e->type = (unsigned int)series->type;
+            e->timestamp = series->timestamps[i];
+            e->value = series_value(series, i);
+            series->rows[i] = e;
+        }
+
+        if (i == series->size) {
+            series->mapped = 0;
+            return C_ERR_OK;
+        }
+
+        // Give back the slots handed out above, newest first
+        while (i-- > 0) {
+            release_entry_slot(ec, mapped.timestamps[i]);
+        }
+    }
+
+    // Back to the mapped columns
+    free(series->timestamps);
+    free(series->values.raw);
+    free(series->rows);
+    *series = mapped;
+    return C_ERR_NO_MEMORY;
+}
+
+/* ---- entries_map_series ----------------------------------------------------
+   Purpose: Add a series whose columns live in a snapshot mapping (see
+            snapshot_open). The columns are used in place: nothing is copied
+            and no entries are stored until the series first changes.
+   Params:
+     - ec (in/out): entry collection to add the series to
+     - room (in/out): owning room, which must not have this series yet
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - timestamps (in): sorted timestamp column, size elements
+     - values (in): value column of the type, size elements
+     - size (in): number of readings, > 0
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID, C_ERR_DUPLICATE if the
+            room already has a series of this type, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+int entries_map_series(EntryCollection *ec, Room *room, int type,
+                       const int *timestamps, const void *values, int size) {
+    Series *series;
+
+    if (ec == NULL || room == NULL || timestamps == NULL || values == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if ((type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) || size <= 0) {
+        return C_ERR_INVALID;
+    }
+
+    if (room->series[type - 1] != NULL) {
+        return C_ERR_DUPLICATE;
+    }
+
+    series = get_series(ec, room, type);
+    if (series == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    // The mapping is read-only; series_thaw copies before anything is written
+    series->timestamps = (int *)timestamps;
+    series->values.raw = (void *)values;
+    series->size = size;
+    series->capacity = size;
+    series->mapped = 1;
+
+    if (room->rolling[type - 1] != NULL) {
+        rolling_rebuild(room->rolling[type - 1], series);
+    }
+    room->size += size;
+    ec->size += size;
+
+    return C_ERR_OK;
+}
+
+/* ---- series_shrink ---------------------------------------------------------
+   Purpose: Give back the columns' spare capacity after readings have been
+            sealed. A column that cannot be shrunk keeps its larger block.
+   Params:
+     - series (in/out): series whose columns to shrink (not mapped)
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void series_shrink(Series *series) {
+    void *shrunk;
+
+    series_rebase(series);
+    if (series->size == 0) {
+        free(series->timestamps);
+        free(series->values.raw);
+        free(series->rows);
+        series->timestamps = NULL;
+        series->values.raw = NULL;
+        series->rows = NULL;
+        series->capacity = 0;
+        return;
+    }
+
+    shrunk = realloc(series->timestamps, (size_t)series->size * sizeof(int));
+    if (shrunk != NULL) {
+        series->timestamps = shrunk;
+    }
+    shrunk = realloc(series->values.raw, series_values_bytes(series->type, series->size));
+    if (shrunk != NULL) {
+        series->values.raw = shrunk;
+    }
+    shrunk = realloc(series->rows, (size_t)series->size * sizeof(LogEntry *));
+    if (shrunk != NULL) {
+        series->rows = shrunk;
+    }
+    series->capacity = series->size;
+}
+
+/* ---- series_seal -----------------------------------------------------------
+   Purpose: Compress the oldest blocks * SERIES_BLOCK_SIZE readings of a
+            series' columns into sealed blocks and move the rest of the
+            columns to the front. The rows of the sealed readings are
+            dropped; their entries are freed by entries_repack.
+   Params:
+     - series (in/out): series to seal (not mapped), with at least that many
+                        readings in its columns
+     - blocks (in): number of blocks to seal
+     - scratch (in): work space of BLOCK_SCRATCH_BYTES
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (the series is unchanged)
+----------------------------------------------------------------------------- */
+static int series_seal(Series *series, int blocks, unsigned char *scratch) {
+    // Readings that get sealed and readings that stay in the columns
+    int sealed = blocks * SERIES_BLOCK_SIZE;
+    int rest = series->size - sealed;
+    unsigned char *values;
+    SeriesBlock **grown;
+    int i;
+
+    // Motion blocks copy whole word groups from reading 0
+    series_rebase(series);
+    values = series->values.raw;
+
+    grown = realloc(series->blocks, (size_t)(series->num_blocks + blocks) * sizeof(SeriesBlock *));
+    if (grown == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    series->blocks = grown;
+
+    for (i = 0; i < blocks; i++) {
+        grown[series->num_blocks + i] = block_encode(series, i * SERIES_BLOCK_SIZE,
+                                                     SERIES_BLOCK_SIZE, scratch);
+        if (grown[series->num_blocks + i] == NULL) {
+            while (i-- > 0) {
+                free(grown[series->num_blocks + i]);
+            }
+            return C_ERR_NO_MEMORY;
+        }
+    }
+
+    memmove(series->timestamps, series->timestamps + sealed, (size_t)rest * sizeof(int));
+    memmove(series->rows, series->rows + sealed, (size_t)rest * sizeof(LogEntry *));
+    if (series->type == TYPE_MOTION) {
+        // Whole word groups move since sealed is a multiple of 64; the
+        // groups left behind are cleared so bits past the end read as zero
+        memmove(series->values.motion, series->values.motion + MOTION_WORDS(sealed),
+                MOTION_WORDS(rest) * sizeof(unsigned long long));
+        memset(series->values.motion + MOTION_WORDS(rest), 0,
+               (MOTION_WORDS(series->size) - MOTION_WORDS(rest)) * sizeof(unsigned long long));
+    }
+    else {
+        memmove(values, values + (size_t)sealed * sizeof(int), (size_t)rest * sizeof(int));
+    }
+
+    series->num_blocks += blocks;
+    series->sealed += sealed;
+    series->size = rest;
+    series_shrink(series);
+    return C_ERR_OK;
+}
+
+/* ---- series_unseal ---------------------------------------------------------
+   Purpose: Decode the sealed readings of a series back into its columns,
+            with stored entries, so a reading older than the newest sealed
+            one can be inserted. Sealed blocks are never changed in place.
+            Every column position moves up by the number of sealed
+            readings, so rolling statistics are rebuilt.
+   Params:
+     - ec (in/out): entry collection that owns the series and the chunks
+     - series (in/out): series to unseal (not mapped)
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (the series is left sealed)
+----------------------------------------------------------------------------- */
+static int series_unseal(EntryCollection *ec, Series *series) {
+    // The new columns, built next to the old ones
+    Series columns;
+    RollingStats *stats;
+    int i;
+    LogEntry *e;
+
+    if (series->num_blocks == 0) {
+        return C_ERR_OK;
+    }
+
+    // The rebuilt window may take in readings that were sealed
+    if (rolling_reserve(series->room, series->type, series->sealed) != C_ERR_OK) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    memset(&columns, 0, sizeof(columns));
+    columns.type = series->type;
+    if (series_reserve(&columns, series->sealed + series->size) == C_ERR_OK) {
+        series_decode(series, columns.timestamps, columns.values.raw, 0);
+
+        for (i = 0; i < series->sealed; i++) {
+            e = allocate_entry_slot(ec, columns.timestamps[i]);
+            if (e == NULL) {
+                break;
+            }
+            e->room = (unsigned int)series->room->seq;
+            e->type = (unsigned int)series->type;
+            e->timestamp = columns.timestamps[i];
+            e->value = series_value(&columns, i);
+            columns.rows[i] = e;
+        }
+
+        if (i == series->sealed) {
+            if (series->size > 0) {
+                memcpy(columns.rows + series->sealed, series->rows,
+                       (size_t)series->size * sizeof(LogEntry *));
+            }
+            for (i = 0; i < series->num_blocks; i++) {
+                free(series->blocks[i]);
+            }
+            free(series->blocks);
+            series_free_columns(series);
+            series->timestamps = columns.timestamps;
+            series->values.raw = columns.values.raw;
+            series->rows = columns.rows;
+            series->capacity = columns.capacity;
+            series->size += series->sealed;
+            series->blocks = NULL;
+            series->num_blocks = 0;
+            series->sealed = 0;
+
+            stats = series->room->rolling[series->type - 1];
+            if (stats != NULL) {
+                rolling_rebuild(stats, series);
+            }
+            return C_ERR_OK;
+        }
+
+        // Give back the slots handed out above, newest first
+        while (i-- > 0) {
+            release_entry_slot(ec, columns.timestamps[i]);
+        }
+    }
+
+    free(columns.timestamps);
+    free(columns.values.raw);
+    free(columns.rows);
+    return C_ERR_NO_MEMORY;
+}
+
+/* ---- entries_repack --------------------------------------------------------
+   Purpose: Copy the entries still referenced by a series row into as few
+            fresh chunks as each partition needs and free the old chunks,
+            releasing the entries of sealed readings and the partitions
+            left empty. Rows are updated to the copies. Slots are handed
+            out in order and never reused, so this runs whenever any slot
+            is unreferenced, even if the fresh chunks are no fewer.
+   Params:
+     - ec (in/out): entry collection to repack
+   Returns: C_ERR_OK (also when there is nothing to release),
+            C_ERR_NO_MEMORY (nothing is changed)
+----------------------------------------------------------------------------- */
+static int entries_repack(EntryCollection *ec) {
+    EntryPartition *fresh;
+    // Entries in use per partition, and the chunk and offset each one's
+    // next copy goes to
+    int *live;
+    int *chunk;
+    int *offset;
+    LogEntry *e;
+    Series *series;
+    // Entries referenced by the rows, across all partitions
+    int referenced = 0;
+    int result = C_ERR_OK;
+    int n = ec->num_partitions;
+    int kept = 0;
+    int i, j, p;
+
+    if (n == 0) {
+        return C_ERR_OK;
+    }
+
+    fresh = calloc((size_t)n, sizeof(EntryPartition));
+    live = calloc((size_t)n * 3, sizeof(int));
+    if (fresh == NULL || live == NULL) {
+        free(fresh);
+        free(live);
+        return C_ERR_NO_MEMORY;
+    }
+    chunk = live + n;
+    offset = live + 2 * n;
+
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        for (j = 0; series->rows != NULL && j < series->size; j++) {
+            live[find_partition(ec, series->rows[j]->timestamp, 0)]++;
+            referenced++;
+        }
+    }
+
+    if (referenced < ec->slots) {
+        for (p = 0; p < n && result == C_ERR_OK; p++) {
+            fresh[p].start = ec->partitions[p].start;
+            result = partition_reserve(&fresh[p], live[p]);
+        }
+    }
+    if (referenced == ec->slots || result != C_ERR_OK) {
+        for (p = 0; p < n; p++) {
+            partition_free(&fresh[p]);
+        }
+        free(fresh);
+        free(live);
+        return result;
+    }
+
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        for (j = 0; series->rows != NULL && j < series->size; j++) {
+            p = find_partition(ec, series->rows[j]->timestamp, 0);
+            e = &fresh[p].chunks[chunk[p]][offset[p]++];
+            if (offset[p] == ENTRY_CHUNK_SLOTS(chunk[p])) {
+                chunk[p]++;
+                offset[p] = 0;
+            }
+            *e = *series->rows[j];
+            series->rows[j] = e;
+        }
+    }
+
+    for (p = 0; p < n; p++) {
+        partition_free(&ec->partitions[p]);
+        if (fresh[p].slots > 0) {
+            fresh[kept++] = fresh[p];
+        }
+    }
+    free(ec->partitions);
+    free(live);
+    ec->partitions = fresh;
+    ec->num_partitions = kept;
+    ec->partition_cap = n;
+    ec->last_partition = 0;
+    ec->slots = 0;
+    for (p = 0; p < kept; p++) {
+        ec->slots += fresh[p].slots;
+    }
+    partition_index_fill(ec);
+    return C_ERR_OK;
+}
+
+/* ---- entries_compress ------------------------------------------------------
+   Purpose: Seal the history of every series: all full SERIES_BLOCK_SIZE runs
+            of readings from the oldest on are compressed into immutable
+            blocks and their LogEntry storage is released, leaving fewer than
+            SERIES_BLOCK_SIZE of the newest readings of each series open for
+            cheap appends. Queries, aggregations and the cursor decode the
+            blocks on the fly; a reading older than the newest sealed one
+            decodes its series back (see series_unseal). Series with
+            rolling statistics stay open, since those index the columns.
+            Mapped series are copied out of the snapshot first. LogEntry
+            pointers taken before the call are invalid after it.
+   Params:
+     - ec (in/out): entry collection to compress
+   Returns: number of readings sealed, C_ERR_NULL_PTR, C_ERR_NO_MEMORY
+            (the series sealed until then stay sealed)
+----------------------------------------------------------------------------- */
+int entries_compress(EntryCollection *ec) {
+    unsigned char *scratch;
+    Series *series;
+    // Blocks to seal in the current series and readings sealed so far
+    int blocks;
+    int sealed = 0;
+    int result = C_ERR_OK;
+    int i;
+
+    if (ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    // The repack below only keeps entries the columns refer to
+    if (entries_settle(ec) != C_ERR_OK) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    scratch = malloc(BLOCK_SCRATCH_BYTES);
+    if (scratch == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    for (i = 0; i < ec->num_series && result == C_ERR_OK; i++) {
+        series = ec->series[i];
+        blocks = series->size / SERIES_BLOCK_SIZE;
+        if (blocks == 0 || series->room->rolling[series->type - 1] != NULL) {
+            continue;
+        }
+
+        result = series_thaw(ec, series);
+        if (result == C_ERR_OK) {
+            result = series_seal(series, blocks, scratch);
+        }
+        if (result == C_ERR_OK) {
+            sealed += blocks * SERIES_BLOCK_SIZE;
+        }
+    }
+    free(scratch);
+
+    if (entries_repack(ec) != C_ERR_OK) {
+        result = C_ERR_NO_MEMORY;
+    }
+
+    return (result == C_ERR_OK) ? sealed : result;
+}
+
+/* ---- series_free_columns ---------------------------------------------------
+   Purpose: Free the columns of an owned series, which may start past
+            readings dropped by retention (see Series.offset).
+   Params:
+     - series (in/out): series whose columns to free; mapped columns are
+                        left alone
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void series_free_columns(Series *series) {
+    if (series->mapped) {
+        return;
+    }
+
+    // Back to the start of the allocations; nothing needs to move
+    if (series->offset > 0) {
+        series->timestamps -= series->offset;
+        series->rows -= series->offset;
+        if (series->type != TYPE_MOTION) {
+            series->values.raw = (int *)series->values.raw - series->offset;
+        }
+        series->offset = 0;
+    }
+    free(series->timestamps);
+    free(series->values.raw);
+    free(series->rows);
+}
+
+/* ---- series_free -----------------------------------------------------------
+   Purpose: Detach a series from its room, which then has no readings of
+            the type, and free it with its columns and sealed blocks.
+   Params:
+     - series (in/out): series to free, already out of the directory
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void series_free(Series *series) {
+    int i;
+
+    series->room->series[series->type - 1] = NULL;
+    if (series->room->rolling[series->type - 1] != NULL) {
+        rolling_rebuild(series->room->rolling[series->type - 1], NULL);
+    }
+
+    series_free_columns(series);
+    btree_clear(&series->late);
+    for (i = 0; i < series->num_runs; i++) {
+        run_free(&series->runs[i]);
+    }
+    free(series->runs);
+    for (i = 0; i < series->num_blocks; i++) {
+        free(series->blocks[i]);
+    }
+    free(series->blocks);
+    free(series);
+}
+
+/* ---- block_trim ------------------------------------------------------------
+   Purpose: Replace a sealed block with one holding only its readings at or
+            after cut, for a retention cut that goes through the block.
+   Params:
+     - series (in/out): series owning the block
+     - b (in): index of the block, which must have a reading at or after cut
+     - cut (in): oldest timestamp kept
+     - scratch (in): work space of BLOCK_SCRATCH_BYTES
+   Returns: number of readings removed, C_ERR_NO_MEMORY (the block is kept)
+----------------------------------------------------------------------------- */
+static int block_trim(Series *series, int b, int cut, unsigned char *scratch) {
+    // The block on its own, and columns for the readings that stay
+    Series view;
+    Series columns;
+    SeriesReader reader;
+    SeriesBlock *trimmed;
+    ReadingValue value;
+    int timestamp;
+    int count = 0;
+    int removed;
+
+    memset(&view, 0, sizeof(view));
+    view.type = series->type;
+    view.blocks = &series->blocks[b];
+    view.num_blocks = 1;
+    view.sealed = series->blocks[b]->count;
+
+    memset(&columns, 0, sizeof(columns));
+    columns.type = series->type;
+    if (series_reserve(&columns, view.sealed) != C_ERR_OK) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    series_reader_init(&reader, &view, cut);
+    while (series_reader_next(&reader, &timestamp, &value)) {
+        series_store(&columns, count++, timestamp, value);
+    }
+
+    trimmed = block_encode(&columns, 0, count, scratch);
+    free(columns.timestamps);
+    free(columns.values.raw);
+    free(columns.rows);
+    if (trimmed == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    removed = series->blocks[b]->count - count;
+    free(series->blocks[b]);
+    series->blocks[b] = trimmed;
+    return removed;
+}
+
+/* ---- series_drop_front -----------------------------------------------------
+   Purpose: Drop the readings of a series older than cut. Sealed blocks
+            before the cut are freed (block_trim handles one it goes
+            through); the columns' start moves past the old readings (see
+            Series.offset), so the readings that stay are not copied. The
+            entries of the dropped readings are left to their partitions.
+   Params:
+     - ec (in/out): entry collection that owns the series
+     - series (in/out): series to trim
+     - cut (in): oldest timestamp kept
+     - scratch (in): work space of BLOCK_SCRATCH_BYTES, or NULL if the
+                     series has no sealed blocks
+   Returns: number of readings dropped, C_ERR_NO_MEMORY (nothing is dropped)
+----------------------------------------------------------------------------- */
+static int series_drop_front(EntryCollection *ec, Series *series, int cut, unsigned char *scratch) {
+    RollingStats *stats = series->room->rolling[series->type - 1];
+    // Required by the search helper, not reported
+    unsigned long comparisons = 0;
+    // Whole blocks before the cut, and readings dropped from blocks and columns
+    int blocks = first_block(series, cut);
+    int sealed = 0;
+    int count = lower_bound(series->timestamps, series->size, cut, &comparisons);
+    int i;
+
+    if (blocks < series->num_blocks && series->blocks[blocks]->first < cut) {
+        sealed = block_trim(series, blocks, cut, scratch);
+        if (sealed < 0) {
+            return sealed;
+        }
+    }
+    if (blocks > 0) {
+        for (i = 0; i < blocks; i++) {
+            sealed += series->blocks[i]->count;
+            free(series->blocks[i]);
+        }
+        memmove(series->blocks, series->blocks + blocks,
+                (size_t)(series->num_blocks - blocks) * sizeof(SeriesBlock *));
+        series->num_blocks -= blocks;
+    }
+    series->sealed -= sealed;
+
+    if (count > 0) {
+        // Motion bits stay where they are and are addressed past the offset
+        if (series->type != TYPE_MOTION) {
+            series->values.raw = (int *)series->values.raw + count;
+        }
+        series->timestamps += count;
+        if (series->rows != NULL) {
+            series->rows += count;
+        }
+        series->offset += count;
+        series->size -= count;
+        series->capacity -= count;
+    }
+
+    // The window holds column positions, which have all moved
+    if (stats != NULL) {
+        rolling_rebuild(stats, series);
+    }
+    series->room->size -= sealed + count;
+    ec->size -= sealed + count;
+    return sealed + count;
+}
+
+/* ---- series_drop_late ------------------------------------------------------
+   Purpose: Drop the late readings of a series (see LSM_MEMTABLE_KEYS) older
+            than cut straight from its memtable and runs, without settling
+            them into the columns. A series with none is left alone after a
+            look at the front of each run and of the memtable; otherwise its
+            late readings are merged into one run, whose front is cut off.
+            The entries of the dropped readings are left to their partitions.
+   Params:
+     - ec (in/out): entry collection that owns the series
+     - series (in/out): series to trim
+     - cut (in): oldest timestamp kept
+   Returns: number of readings dropped, C_ERR_NO_MEMORY (nothing is dropped;
+            late ones may have been merged into fewer runs)
+----------------------------------------------------------------------------- */
+static int series_drop_late(EntryCollection *ec, Series *series, int cut) {
+    // Required by the search helper, not reported
+    unsigned long comparisons = 0;
+    SortedRun *run;
+    int old = (series->late.count > 0 && series->late.first->keys[0] < cut);
+    int count, r;
+
+    for (r = 0; r < series->num_runs && !old; r++) {
+        old = (series->runs[r].timestamps[0] < cut);
+    }
+    if (!old) {
+        return 0;
+    }
+
+    if (runs_compact(series, 1) != C_ERR_OK ||
+        (series->late.count > 0 &&
+         (memtable_freeze(series) != C_ERR_OK || runs_compact(series, 1) != C_ERR_OK))) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    run = &series->runs[0];
+    count = lower_bound(run->timestamps, run->count, cut, &comparisons);
+    if (count == run->count) {
+        run_free(run);
+        series->num_runs = 0;
+    }
+    else {
+        memmove(run->timestamps, run->timestamps + count, (size_t)(run->count - count) * sizeof(int));
+        memmove(run->entries, run->entries + count, (size_t)(run->count - count) * sizeof(LogEntry *));
+        run->count -= count;
+    }
+    series->run_readings -= count;
+    series->room->size -= count;
+    ec->size -= count;
+    return count;
+}
+
+/* ---- retention_drop_before -------------------------------------------------
+   Purpose: Drop every time partition that ends at or before timestamp,
+            i.e. every reading older than the start of timestamp's own
+            partition. The partitions' chunks are freed whole, one free per
+            chunk, and each series moves the start of its columns past its
+            old readings instead of shifting the rest (see
+            series_drop_front); sealed and mapped readings go the same way.
+            Late readings are not settled: only a series with one older than
+            the cut merges its late readings and drops them from the front
+            (see series_drop_late), the others cost a look at their runs.
+            Series left without readings are removed from their rooms.
+            LogEntry pointers to dropped readings are invalid after the call.
+   Params:
+     - ec (in/out): entry collection to trim
+     - timestamp (in): readings in partitions that end at or before it go
+   Returns: number of readings dropped, C_ERR_NULL_PTR, C_ERR_NO_MEMORY (the
+            series trimmed until then stay trimmed; their partitions are
+            freed by the next call that succeeds)
+----------------------------------------------------------------------------- */
+int retention_drop_before(EntryCollection *ec, int timestamp) {
+    long long cut;
+    unsigned char *scratch = NULL;
+    Series *series;
+    // Readings dropped, series and partitions kept
+    int dropped = 0;
+    int kept = 0;
+    int kept_partitions = 0;
+    int result = C_ERR_OK;
+    int i, p, count;
+
+    if (ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    cut = partition_start(ec, timestamp);
+    if (cut <= INT_MIN) {
+        return 0;
+    }
+
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        if (result == C_ERR_OK && series->num_blocks > 0 && scratch == NULL) {
+            scratch = malloc(BLOCK_SCRATCH_BYTES);
+            if (scratch == NULL) {
+                result = C_ERR_NO_MEMORY;
+            }
+        }
+        if (result == C_ERR_OK) {
+            // Late readings may sit in the partitions about to be freed
+            count = series_drop_late(ec, series, (int)cut);
+            if (count >= 0) {
+                dropped += count;
+                count = series_drop_front(ec, series, (int)cut, scratch);
+            }
+            if (count < 0) {
+                result = count;
+            }
+            else {
+                dropped += count;
+            }
+        }
+
+        if (series->sealed + series->size + series->late.count + series->run_readings == 0) {
+            series_free(series);
+        }
+        else {
+            ec->series[kept++] = series;
+        }
+    }
+    ec->num_series = kept;
+    free(scratch);
+
+    if (result != C_ERR_OK) {
+        return result;
+    }
+
+    // No series refers to an entry in these partitions any more
+    for (p = 0; p < ec->num_partitions; p++) {
+        if (ec->partitions[p].start < cut) {
+            ec->slots -= ec->partitions[p].slots;
+            partition_free(&ec->partitions[p]);
+        }
+        else {
+            ec->partitions[kept_partitions++] = ec->partitions[p];
+        }
+    }
+    if (kept_partitions < ec->num_partitions) {
+        ec->num_partitions = kept_partitions;
+        ec->last_partition = 0;
+        partition_index_fill(ec);
+    }
+
+    return dropped;
+}
+
+/* ---- entries_memory --------------------------------------------------------
+   Purpose: Heap bytes held by an entry collection: entry chunks, series
+            columns at their allocated size, sealed blocks, late-reading
+            memtable nodes and sorted runs, and the tables that point to
+            them. Mapped columns are file pages and are not counted, nor is
+            allocator overhead.
+   Params:
+     - ec (in): entry collection to measure
+   Returns: size in bytes, 0 for NULL
+----------------------------------------------------------------------------- */
+size_t entries_memory(const EntryCollection *ec) {
+    const Series *series;
+    const EntryPartition *part;
+    size_t bytes;
+    int i, b;
+
+    if (ec == NULL) {
+        return 0;
+    }
+
+    bytes = (size_t)ec->partition_cap * sizeof(EntryPartition) +
+            (size_t)ec->partition_index_cap * sizeof(int) +
+            (size_t)ec->series_cap * sizeof(Series *);
+    for (i = 0; i < ec->num_partitions; i++) {
+        part = &ec->partitions[i];
+        bytes += (size_t)part->chunk_cap * sizeof(LogEntry *);
+        for (b = 0; b < part->num_chunks; b++) {
+            bytes += (size_t)ENTRY_CHUNK_SLOTS(b) * sizeof(LogEntry);
+        }
+    }
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        bytes += sizeof(Series) + (size_t)series->num_blocks * sizeof(SeriesBlock *) +
+                 (size_t)series->late.nodes * BTREE_NODE_BYTES +
+                 (size_t)series->run_readings * (sizeof(int) + sizeof(LogEntry *));
+        if (series->runs != NULL) {
+            bytes += LSM_MAX_RUNS * sizeof(SortedRun);
+        }
+        if (!series->mapped) {
+            bytes += (size_t)(series->capacity + series->offset) * (sizeof(int) + sizeof(LogEntry *)) +
+                     series_values_bytes(series->type, series->capacity + series->offset);
+        }
+        for (b = 0; b < series->num_blocks; b++) {
+            bytes += sizeof(SeriesBlock) + series->blocks[b]->bytes;
+        }
+    }
+
+    return bytes;
+}
+
+/* ---- profile_cycles --------------------------------------------------------
+   Purpose: Read the cycle counter for the ingest probes: rdtsc on x86,
+            the monotonic clock in nanoseconds elsewhere.
+----------------------------------------------------------------------------- */
+#ifdef SENSOR_PROFILE
+static unsigned long long profile_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+#endif
+
+/* ---- profile_read ----------------------------------------------------------
+   Purpose: Copy the ingest probes' counters (see PROFILE_CREATE).
+   Params:
+     - counters (out): PROFILE_POINTS counters, indexed by PROFILE_*
+   Returns: 1 if this build counts them (-DSENSOR_PROFILE), 0 if every
+            counter stays zero
+----------------------------------------------------------------------------- */
+int profile_read(ProfileCounter *counters) {
+    memcpy(counters, profile_counters, sizeof(profile_counters));
+#ifdef SENSOR_PROFILE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* ---- profile_reset ---------------------------------------------------------
+   Purpose: Set every ingest counter back to zero.
+----------------------------------------------------------------------------- */
+void profile_reset(void) {
+    int i;
+
+    for (i = 0; i < PROFILE_POINTS; i++) {
+        profile_counters[i].calls = 0;
+        profile_counters[i].moved = 0;
+        profile_counters[i].comparisons = 0;
+        profile_counters[i].cycles = 0;
+    }
+}
+
+/* ---- profile_dump ----------------------------------------------------------
+   Purpose: Write the ingest counters as CSV, a header line and then
+            point,calls,moved,comparisons,cycles per probe.
+   Params:
+     - fp (in): stream to write to
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int profile_dump(FILE *fp) {
+    const ProfileCounter *c;
+    int i;
+
+    if (fp == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    fprintf(fp, "point,calls,moved,comparisons,cycles\n");
+    for (i = 0; i < PROFILE_POINTS; i++) {
+        c = &profile_counters[i];
+        fprintf(fp, "%s,%llu,%llu,%llu,%llu\n", c->name, c->calls, c->moved, c->comparisons,
+                c->cycles);
+    }
+    return ferror(fp) ? C_ERR_IO : C_ERR_OK;
+}
+
+#ifdef SENSOR_PROFILE
+/* ---- latency_now -----------------------------------------------------------
+   Purpose: Read the monotonic clock for the latency histograms.
+   Returns: nanoseconds
+----------------------------------------------------------------------------- */
+static unsigned long long latency_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/* ---- latency_record --------------------------------------------------------
+   Purpose: Count one operation's time in its histogram.
+   Params:
+     - h (in/out): histogram of the operation
+     - nanoseconds (in): time it took
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void latency_record(LatencyHistogram *h, unsigned long long nanoseconds) {
+    if (h->count == 0 || nanoseconds < h->min) {
+        h->min = nanoseconds;
+    }
+    if (nanoseconds > h->max) {
+        h->max = nanoseconds;
+    }
+    h->count++;
+    h->sum += nanoseconds;
+    h->buckets[latency_bucket(nanoseconds)]++;
+}
+
+/* ---- latency_bucket --------------------------------------------------------
+   Purpose: Find the histogram bucket of a time. Below 2^LATENCY_SUB_BITS
+            the bucket is the value itself; above it, the leading
+            LATENCY_SUB_BITS + 1 bits pick one of the 2^LATENCY_SUB_BITS
+            buckets of the value's power of two.
+   Params:
+     - nanoseconds (in): time, clamped below 2^LATENCY_MAX_BITS
+   Returns: bucket, 0 .. LATENCY_BUCKETS - 1
+----------------------------------------------------------------------------- */
+static int latency_bucket(unsigned long long nanoseconds) {
+    // Bits dropped below the leading LATENCY_SUB_BITS + 1
+    int shift;
+
+    if (nanoseconds >= (1ULL << LATENCY_MAX_BITS)) {
+        nanoseconds = (1ULL << LATENCY_MAX_BITS) - 1;
+    }
+    if (nanoseconds < (1ULL << LATENCY_SUB_BITS)) {
+        return (int)nanoseconds;
+    }
+    shift = 63 - __builtin_clzll(nanoseconds) - LATENCY_SUB_BITS;
+    return ((shift + 1) << LATENCY_SUB_BITS) + (int)(nanoseconds >> shift) - (1 << LATENCY_SUB_BITS);
+}
+#endif
+
+/* ---- latency_bucket_top ----------------------------------------------------
+   Purpose: Give the largest time that falls in a bucket (see
+            latency_bucket).
+   Params:
+     - bucket (in): bucket index
+   Returns: nanoseconds
+----------------------------------------------------------------------------- */
+static unsigned long long latency_bucket_top(int bucket) {
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    unsigned long long lead;
+
+    if (shift <= 0) {
+        return (unsigned long long)bucket;
+    }
+    lead = (unsigned long long)((bucket & ((1 << LATENCY_SUB_BITS) - 1)) + (1 << LATENCY_SUB_BITS));
+    return ((lead + 1) << shift) - 1;
+}
+
+/* ---- latency_at ------------------------------------------------------------
+   Purpose: Find the time below which a share of the recorded operations
+            fall: the top of the bucket that holds that rank, capped at the
+            largest time recorded.
+   Params:
+     - h (in): histogram
+     - per_mille (in): share in thousandths, 0 - 1000 (999 for p99.9)
+   Returns: nanoseconds, 0 if nothing is recorded
+----------------------------------------------------------------------------- */
+static unsigned long long latency_at(const LatencyHistogram *h, int per_mille) {
+    // Operations at or below the answer, rounded up, at least one
+    unsigned long long rank = (h->count * (unsigned long long)per_mille + 999) / 1000;
+    unsigned long long seen = 0;
+    unsigned long long top;
+    int i;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    top = latency_bucket_top(i);
+    return (top < h->max) ? top : h->max;
+}
+
+/* ---- latency_summary -------------------------------------------------------
+   Purpose: Summarise the latency histogram of one operation.
+   Params:
+     - op (in): LATENCY_ROOMS_ADD .. LATENCY_PRINT
+     - summary (out): count, min, p50, p90, p99, p99.9, max and mean in
+                      nanoseconds; all zero if nothing is recorded
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID
+----------------------------------------------------------------------------- */
+int latency_summary(int op, LatencySummary *summary) {
+    const LatencyHistogram *h;
+
+    if (summary == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+    if (op < 0 || op >= LATENCY_OPS) {
+        return C_ERR_INVALID;
+    }
+
+    h = &latency_histograms[op];
+    summary->name = latency_names[op];
+    summary->count = h->count;
+    summary->min = h->min;
+    summary->p50 = latency_at(h, 500);
+    summary->p90 = latency_at(h, 900);
+    summary->p99 = latency_at(h, 990);
+    summary->p999 = latency_at(h, 999);
+    summary->max = h->max;
+    summary->mean = (h->count > 0) ? (double)h->sum / (double)h->count : 0.0;
+    return C_ERR_OK;
+}
+
+/* ---- latency_reset ---------------------------------------------------------
+   Purpose: Empty every latency histogram.
+----------------------------------------------------------------------------- */
+void latency_reset(void) {
+    memset(latency_histograms, 0, sizeof(latency_histograms));
+}
+
+/* ---- latency_dump ----------------------------------------------------------
+   Purpose: Write the latency histograms as CSV, a header line and then
+            op,count,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,mean_ns per
+            operation or, with buckets set, op,top_ns,count per non-empty
+            bucket, which histograms from several runs can be added up from.
+   Params:
+     - fp (in): stream to write to
+     - buckets (in): non-zero for the buckets instead of the summaries
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int latency_dump(FILE *fp, int buckets) {
+    LatencySummary summary;
+    const LatencyHistogram *h;
+    int op, i;
+
+    if (fp == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (buckets) {
+        fprintf(fp, "op,top_ns,count\n");
+        for (op = 0; op < LATENCY_OPS; op++) {
+            h = &latency_histograms[op];
+            for (i = 0; i < LATENCY_BUCKETS && h->count > 0; i++) {
+                if (h->buckets[i] > 0) {
+                    fprintf(fp, "%s,%llu,%llu\n", latency_names[op], latency_bucket_top(i),
+                            h->buckets[i]);
+                }
+            }
+        }
+        return ferror(fp) ? C_ERR_IO : C_ERR_OK;
+    }
+
+    fprintf(fp, "op,count,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,mean_ns\n");
+    for (op = 0; op < LATENCY_OPS; op++) {
+        latency_summary(op, &summary);
+        fprintf(fp, "%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.1f\n", summary.name, summary.count,
+                summary.min, summary.p50, summary.p90, summary.p99, summary.p999, summary.max,
+                summary.mean);
+    }
+    return ferror(fp) ? C_ERR_IO : C_ERR_OK;
+}
+
+/* ---- partition_start -------------------------------------------------------
+   Purpose: First timestamp of the partition a timestamp falls in.
+   Params:
+     - ec (in): entry collection whose partition width to use
+     - timestamp (in): any timestamp, negative ones included
+   Returns: the timestamp rounded down to a multiple of the width
+----------------------------------------------------------------------------- */
+static long long partition_start(const EntryCollection *ec, int timestamp) {
+    long long width = (ec->partition_width > 0) ? ec->partition_width : ENTRY_PARTITION_WIDTH;
+    long long rest = (long long)timestamp % width;
+
+    return (long long)timestamp - ((rest < 0) ? rest + width : rest);
+}
+
+/* ---- partition_hash --------------------------------------------------------
+   Purpose: Hash of a partition start for the partition index. Starts are
+            multiples of the width, so the low bits alone would collide;
+            Fibonacci hashing spreads them.
+   Params:
+     - start (in): first timestamp of a partition
+   Returns: 32-bit hash value
+----------------------------------------------------------------------------- */
+static unsigned int partition_hash(long long start) {
+    return (unsigned int)(((unsigned long long)start * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/* ---- partition_index_fill --------------------------------------------------
+   Purpose: Empty the partition index and re-insert every partition, after
+            the directory has been compacted or the index grown.
+   Params:
+     - ec (in/out): entry collection with an index of at least twice
+                    num_partitions slots (or none while it has no partitions)
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void partition_index_fill(EntryCollection *ec) {
+    unsigned int mask = (unsigned int)ec->partition_index_cap - 1;
+    unsigned int slot;
+    int i;
+
+    // -1 marks an empty slot
+    for (i = 0; i < ec->partition_index_cap; i++) {
+        ec->partition_index[i] = -1;
+    }
+
+    for (i = 0; i < ec->num_partitions; i++) {
+        slot = partition_hash(ec->partitions[i].start) & mask;
+        while (ec->partition_index[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        ec->partition_index[slot] = i;
+    }
+}
+
+/* ---- find_partition --------------------------------------------------------
+   Purpose: Find the partition a timestamp falls in, trying the one the
+            last entry went to before probing the partition index, and
+            append it to the directory if asked to.
+   Params:
+     - ec (in/out): entry collection (last_partition is updated)
+     - timestamp (in): timestamp of an entry
+     - create (in): non-zero to add the partition when there is none
+   Returns: index in ec->partitions, -1 if there is none (or no memory to
+            add it)
+----------------------------------------------------------------------------- */
+static int find_partition(EntryCollection *ec, int timestamp, int create) {
+    long long start = partition_start(ec, timestamp);
+    // Current slot, wrapped with the power-of-two mask
+    unsigned int mask;
+    unsigned int slot;
+    int pos;
+    int new_cap;
+    EntryPartition *grown;
+    int *index;
+
+    if (ec->last_partition < ec->num_partitions &&
+        ec->partitions[ec->last_partition].start == start) {
+        return ec->last_partition;
+    }
+
+    // Linear probing: stop at the first empty slot
+    if (ec->partition_index_cap > 0) {
+        mask = (unsigned int)ec->partition_index_cap - 1;
+        for (slot = partition_hash(start) & mask; ec->partition_index[slot] >= 0;
+             slot = (slot + 1) & mask) {
+            pos = ec->partition_index[slot];
+            if (ec->partitions[pos].start == start) {
+                ec->last_partition = pos;
+                return pos;
+            }
+        }
+    }
+
+    if (!create) {
+        return -1;
+    }
+
+    if (ec->num_partitions == ec->partition_cap) {
+        new_cap = (ec->partition_cap > 0) ? ec->partition_cap * 2 : MAX_ARR;
+        grown = realloc(ec->partitions, (size_t)new_cap * sizeof(EntryPartition));
+        if (grown == NULL) {
+            return -1;
+        }
+        ec->partitions = grown;
+        ec->partition_cap = new_cap;
+    }
+
+    // Keep the index at most half full
+    if (2 * (ec->num_partitions + 1) > ec->partition_index_cap) {
+        new_cap = (ec->partition_index_cap > 0) ? ec->partition_index_cap * 2 : 2 * MAX_ARR;
+        index = malloc((size_t)new_cap * sizeof(int));
+        if (index == NULL) {
+            return -1;
+        }
+        free(ec->partition_index);
+        ec->partition_index = index;
+        ec->partition_index_cap = new_cap;
+        partition_index_fill(ec);
+    }
+
+    pos = ec->num_partitions++;
+    memset(&ec->partitions[pos], 0, sizeof(EntryPartition));
+    ec->partitions[pos].start = start;
+
+    mask = (unsigned int)ec->partition_index_cap - 1;
+    slot = partition_hash(start) & mask;
+    while (ec->partition_index[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    ec->partition_index[slot] = pos;
+
+    ec->last_partition = pos;
+    return pos;
+}
+
+/* ---- partition_reserve -----------------------------------------------------
+   Purpose: Give an empty partition the chunks for 'slots' entries and mark
+            them all used, for entries_repack to fill in.
+   Params:
+     - part (in/out): partition without chunks
+     - slots (in): number of entries
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY (chunks allocated until then are kept
+            for partition_free)
+----------------------------------------------------------------------------- */
+static int partition_reserve(EntryPartition *part, int slots) {
+    // Chunks needed and the slots they hold
+    int chunks = 0;
+    int capacity = 0;
+
+    while (capacity < slots) {
+        capacity += ENTRY_CHUNK_SLOTS(chunks);
+        chunks++;
+    }
+    if (chunks == 0) {
+        return C_ERR_OK;
+    }
+
+    part->chunks = malloc((size_t)chunks * sizeof(LogEntry *));
+    if (part->chunks == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    part->chunk_cap = chunks;
+
+    while (part->num_chunks < chunks) {
+        part->chunks[part->num_chunks] = malloc((size_t)ENTRY_CHUNK_SLOTS(part->num_chunks) *
+                                                sizeof(LogEntry));
+        if (part->chunks[part->num_chunks] == NULL) {
+            return C_ERR_NO_MEMORY;
+        }
+        part->num_chunks++;
+    }
+
+    part->slots = slots;
+    part->tail = slots - (capacity - ENTRY_CHUNK_SLOTS(chunks - 1));
+    return C_ERR_OK;
+}
+
+/* ---- partition_free --------------------------------------------------------
+   Purpose: Free a partition's chunks and chunk table.
+   Params:
+     - part (in/out): partition to empty
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void partition_free(EntryPartition *part) {
+    int k;
+
+    for (k = 0; k < part->num_chunks; k++) {
+        free(part->chunks[k]);
+    }
+    free(part->chunks);
+    part->chunks = NULL;
+    part->num_chunks = 0;
+    part->chunk_cap = 0;
+    part->tail = 0;
+    part->slots = 0;
+}
+
+/* ---- allocate_entry_slot --------------------------------------------------
+   Purpose: Hand out storage for one new entry in the partition of its
+            timestamp. Slots are used in order, so a new chunk is only
+            needed when the partition's last one is full.
+   Params:
+     - ec (in/out): entry collection that owns the partitions
+     - timestamp (in): timestamp of the entry
+   Returns: pointer to an unused LogEntry, or NULL if out of memory
+----------------------------------------------------------------------------- */
+static LogEntry* allocate_entry_slot(EntryCollection *ec, int timestamp) {
+    int p = find_partition(ec, timestamp, 1);
+    int new_cap;
+    EntryPartition *part;
+    LogEntry **grown;
+
+    if (p < 0) {
+        return NULL;
+    }
+
+    part = &ec->partitions[p];
+    if (part->num_chunks == 0 || part->tail == ENTRY_CHUNK_SLOTS(part->num_chunks - 1)) {
+        // Grow the chunk table itself if needed (only chunk pointers move)
+        if (part->num_chunks == part->chunk_cap) {
+            new_cap = (part->chunk_cap > 0) ? part->chunk_cap * 2 : MAX_ARR;
+            grown = realloc(part->chunks, (size_t)new_cap * sizeof(LogEntry *));
+            if (grown == NULL) {
+                return NULL;
+            }
+            part->chunks = grown;
+            part->chunk_cap = new_cap;
+        }
+
+        part->chunks[part->num_chunks] = malloc((size_t)ENTRY_CHUNK_SLOTS(part->num_chunks) *
+                                                sizeof(LogEntry));
+        if (part->chunks[part->num_chunks] == NULL) {
+            return NULL;
+        }
+        part->num_chunks++;
+        part->tail = 0;
+    }
+
+    part->slots++;
+    ec->slots++;
+    return &part->chunks[part->num_chunks - 1][part->tail++];
+}
+
+/* ---- release_entry_slot ----------------------------------------------------
+   Purpose: Take back the last slot handed out in a timestamp's partition,
+            to undo allocations in reverse order when an insert fails.
+   Params:
+     - ec (in/out): entry collection that owns the partitions
+     - timestamp (in): timestamp the slot was allocated for
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void release_entry_slot(EntryCollection *ec, int timestamp) {
+    EntryPartition *part = &ec->partitions[find_partition(ec, timestamp, 0)];
+
+    part->tail--;
+    part->slots--;
+    ec->slots--;
+    if (part->tail == 0) {
+        free(part->chunks[--part->num_chunks]);
+        part->tail = (part->num_chunks > 0) ? ENTRY_CHUNK_SLOTS(part->num_chunks - 1) : 0;
+    }
+}
+
+/* ---- entries_create -----------------------------------------------------------
+   Purpose: Create a log entry and place it, in sorted order, in its
+            (room, type) series. Readings from one sensor normally arrive
+            with increasing timestamps, so the common case is a tail append
+            that needs no search and no shifting (the fast path); anything
+            else is inserted into the series' memtable of late readings in
+            O(log LSM_MEMTABLE_KEYS), which is frozen into a sorted run when
+            full (slow path, see memtable_spill). Either way the cost does
+            not depend on how far out of order the reading is.
+   Params:
+     - ec (in/out): entry collection (owns LogEntry storage)
+     - room (in/out): room to attach entry to (must already exist)
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - value (in): union payload for reading
+     - timestamp (in): simple int timestamp
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+int entries_create(EntryCollection *ec, Room *room, int type, ReadingValue value, int timestamp) {
+    // The new entry, stored in its final (never moving) slot
+    LogEntry *new_entry;
+    // The (room, type) series it goes into
+    Series *series;
+    // Where to insert it in sorted order
+    int insert_pos;
+    PROFILE_CLOCK(started);
+    LATENCY_START(began);
+    
+    // Check for empty pointers
+    if (ec == NULL || room == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+    
+    // Validate type
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        return C_ERR_INVALID;
+    }
+    
+    // Reserve space in the series before touching anything, so a failed
+    // allocation leaves the collection unchanged; a reading that belongs
+    // among the sealed ones needs them back in the columns
+    series = get_series(ec, room, type);
+    if (series == NULL || series_thaw(ec, series) != C_ERR_OK ||
+        (series->sealed > 0 && timestamp < sealed_last(series) &&
+         series_unseal(ec, series) != C_ERR_OK) ||
+        series_reserve(series, series->size + 1) != C_ERR_OK ||
+        rolling_reserve(room, type, 1) != C_ERR_OK) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    new_entry = allocate_entry_slot(ec, timestamp);
+    if (new_entry == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    
+    // Create the new entry
+    if (type == TYPE_MOTION) {
+        motion_normalize(&value);
+    }
+    new_entry->room = (unsigned int)room->seq;
+    new_entry->type = (unsigned int)type;
+    new_entry->timestamp = timestamp;
+    new_entry->value = value;
+    
+    if (series->size > 0 && timestamp < series->timestamps[series->size - 1]) {
+        // Slow path: the entry waits among the late readings; nothing moves
+        PROFILE_DECLARE(compared, ec->comparisons);
+        PROFILE_CLOCK(located);
+
+        if (btree_insert(&series->late, timestamp, new_entry, &ec->comparisons) != C_ERR_OK) {
+            release_entry_slot(ec, timestamp);
+            return C_ERR_NO_MEMORY;
+        }
+        PROFILE_COUNT(PROFILE_LOCATE, comparisons, ec->comparisons - compared);
+        PROFILE_STOP(PROFILE_LOCATE, located);
+        if (series->late.count >= LSM_MEMTABLE_KEYS) {
+            memtable_spill(series);
+        }
+        ec->slow_inserts++;
+        room->size++;
+        ec->size++;
+        PROFILE_STOP(PROFILE_CREATE, started);
+        LATENCY_STOP(LATENCY_CREATE, began);
+        return C_ERR_OK;
+    }
+
+    // Fast path: the entry belongs at the end of its series
+    insert_pos = series->size;
+    ec->fast_appends++;
+    series_store(series, insert_pos, timestamp, value);
+    series->rows[insert_pos] = new_entry;
+
+    series->size++;
+    rolling_after_insert(room, series, insert_pos, 1);
+    room->size++;
+    ec->size++;
+    PROFILE_STOP(PROFILE_APPEND, started);
+    PROFILE_AGAIN(PROFILE_CREATE, started);
+    LATENCY_STOP(LATENCY_CREATE, began);
+    
+    return C_ERR_OK;
+}
+
+/* ---- sort_entries_by_key --------------------------------------------------
+   Purpose: Stable bottom-up merge sort of entry pointers by key. Entries with
+            equal keys keep their relative order, just as if they had been
+            inserted one at a time.
+   Params:
+     - array (in/out): pointers to sort
+     - scratch (in): work space for at least size pointers
+     - size (in): number of pointers
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void sort_entries_by_key(LogEntry **array, LogEntry **scratch, int size) {
+    // Source and destination of the current pass
+    LogEntry **src = array;
+    LogEntry **dst = scratch;
+    LogEntry **swap;
+    int width, low, mid, high, i, j, k;
+
+    for (width = 1; width < size; width *= 2) {
+        for (low = 0; low < size; low += 2 * width) {
+            mid = (low + width < size) ? low + width : size;
+            high = (low + 2 * width < size) ? low + 2 * width : size;
+
+            // Merge src[low, mid) and src[mid, high), taking the left one on ties
+            i = low;
+            j = mid;
+            for (k = low; k < high; k++) {
+                if (i < mid && (j >= high || ENTRY_KEY_OF(src[i]) <= ENTRY_KEY_OF(src[j]))) {
+                    dst[k] = src[i++];
+                }
+                else {
+                    dst[k] = src[j++];
+                }
+            }
+        }
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != array) {
+        memcpy(array, src, (size_t)size * sizeof(LogEntry *));
+    }
+}
+
+/* ---- merge_sorted_tail -----------------------------------------------------
+   Purpose: Merge a sorted run of new pointers into a sorted array in place,
+            working backwards from the end so that nothing before the first
+            insertion point is touched. Existing entries stay in front of new
+            ones with an equal key.
+   Params:
+     - dst (in/out): sorted array with capacity for size + count pointers
+     - size (in): number of pointers already in dst
+     - add (in): sorted pointers to merge in
+     - count (in): number of pointers in add
+     - comparisons (in/out): incremented once per key comparison
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void merge_sorted_tail(LogEntry **dst, int size, LogEntry *const *add, int count,
+                              unsigned long *comparisons) {
+    // Read positions in dst and add, write position in dst
+    int i = size - 1;
+    int j = count - 1;
+    int k = size + count - 1;
+
+    while (j >= 0) {
+        if (i >= 0) {
+            (*comparisons)++;
+        }
+        if (i >= 0 && ENTRY_KEY_OF(dst[i]) > ENTRY_KEY_OF(add[j])) {
+            dst[k--] = dst[i--];
+        }
+        else {
+            dst[k--] = add[j--];
+        }
+    }
+}
+
+/* ---- insert_batch ----------------------------------------------------------
+   Purpose: Body of entries_create_batch, working in caller-provided buffers.
+   Params:
+     - ec, rc, readings, count (in/out): as for entries_create_batch
+     - owners (in): space for count room pointers
+     - batch, scratch (in): space for count entry pointers each
+     - per_series (in): zeroed space for NUM_TYPES * rc->size counters
+     - starts (in): space for NUM_TYPES * rc->size positions, which first
+                    holds each series' oldest new timestamp
+   Returns: C_ERR_OK, C_ERR_NOT_FOUND, C_ERR_INVALID, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int insert_batch(EntryCollection *ec, RoomCollection *rc,
+                        const SensorReading *readings, int count,
+                        Room **owners, LogEntry **batch, LogEntry **scratch,
+                        int *per_series, int *starts) {
+    int i, t, start, slot, first, end;
+    Room *room;
+    Series *series;
+    LogEntry *e;
+
+    // Validate everything before changing anything
+    for (i = 0; i < count; i++) {
+        t = readings[i].data.type;
+        if (t != TYPE_TEMP && t != TYPE_DB && t != TYPE_MOTION) {
+            return C_ERR_INVALID;
+        }
+
+        owners[i] = rooms_find(rc, readings[i].room_name);
+        if (owners[i] == NULL) {
+            return C_ERR_NOT_FOUND;
+        }
+        slot = owners[i]->id * NUM_TYPES + t - 1;
+        if (per_series[slot] == 0 || readings[i].timestamp < starts[slot]) {
+            starts[slot] = readings[i].timestamp;
+        }
+        per_series[slot]++;
+    }
+
+    // Reserve all the space the merges need, unsealing series that get
+    // readings older than their newest sealed one
+    for (i = 0; i < rc->size; i++) {
+        for (t = 0; t < NUM_TYPES; t++) {
+            if (per_series[i * NUM_TYPES + t] == 0) {
+                continue;
+            }
+
+            series = get_series(ec, rc->sorted[i], t + 1);
+            if (series == NULL || series_thaw(ec, series) != C_ERR_OK ||
+                series_settle(series) != C_ERR_OK ||
+                (series->sealed > 0 && starts[i * NUM_TYPES + t] < sealed_last(series) &&
+                 series_unseal(ec, series) != C_ERR_OK) ||
+                series_reserve(series, series->size + per_series[i * NUM_TYPES + t]) != C_ERR_OK ||
+                rolling_reserve(rc->sorted[i], t + 1, per_series[i * NUM_TYPES + t]) != C_ERR_OK) {
+                return C_ERR_NO_MEMORY;
+            }
+        }
+    }
+    for (i = 0; i < count; i++) {
+        batch[i] = allocate_entry_slot(ec, readings[i].timestamp);
+        if (batch[i] == NULL) {
+            while (i-- > 0) {
+                release_entry_slot(ec, readings[i].timestamp);
+            }
+            return C_ERR_NO_MEMORY;
+        }
+    }
+
+    // Group the batch by series with a stable counting sort; series slots in
+    // increasing order are room id then type order
+    start = 0;
+    for (slot = 0; slot < rc->size * NUM_TYPES; slot++) {
+        starts[slot] = start;
+        start += per_series[slot];
+    }
+    for (i = 0; i < count; i++) {
+        e = batch[i];
+        e->room = (unsigned int)owners[i]->seq;
+        e->type = (unsigned int)readings[i].data.type;
+        e->timestamp = readings[i].timestamp;
+        e->value = readings[i].data.value;
+        if (e->type == TYPE_MOTION) {
+            motion_normalize(&e->value);
+        }
+        scratch[starts[owners[i]->id * NUM_TYPES + e->type - 1]++] = e;
+    }
+    memcpy(batch, scratch, (size_t)count * sizeof(LogEntry *));
+
+    // Each group is in arrival order, which for a stream is already
+    // timestamp order; only the groups that are not get sorted
+    for (slot = 0; slot < rc->size * NUM_TYPES; slot++) {
+        end = starts[slot];
+        start = end - per_series[slot];
+        i = start + 1;
+        while (i < end && batch[i - 1]->timestamp <= batch[i]->timestamp) {
+            i++;
+        }
+        if (i < end) {
+            sort_entries_by_key(&batch[start], scratch, end - start);
+        }
+    }
+
+    // The sorted batch is grouped by (room, type), so each series gets one
+    // merge of its rows, after which the columns are refilled from the
+    // first position that changed
+    start = 0;
+    while (start < count) {
+        room = rc->rooms[batch[start]->room];
+        t = batch[start]->type;
+        slot = room->id * NUM_TYPES + t - 1;
+        series = room->series[t - 1];
+
+        first = upper_bound(series->timestamps, series->size, batch[start]->timestamp,
+                            &ec->comparisons);
+        merge_sorted_tail(series->rows, series->size, &batch[start], per_series[slot],
+                          &ec->comparisons);
+        series->size += per_series[slot];
+        for (i = first; i < series->size; i++) {
+            series_store(series, i, series->rows[i]->timestamp, series->rows[i]->value);
+        }
+
+        if (room->rolling[t - 1] != NULL) {
+            rolling_rebuild(room->rolling[t - 1], series);
+        }
+
+        room->size += per_series[slot];
+        start += per_series[slot];
+    }
+    ec->size += count;
+
+    return C_ERR_OK;
+}
+
+/* ---- entries_create_batch --------------------------------------------------
+   Purpose: Create many entries at once. The batch is grouped by series with
+            a counting sort, each group is sorted by timestamp unless it
+            already is, and then merged into its (room, type) series in a
+            single linear pass, instead of one search and shift per reading.
+            Either every reading is added or none is.
+   Params:
+     - ec (in/out): entry collection (owns LogEntry storage)
+     - rc (in): rooms that the readings refer to by name
+     - readings (in): readings to add, in any order
+     - count (in): number of readings
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_NOT_FOUND (unknown room),
+            C_ERR_INVALID (bad type or count), C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+int entries_create_batch(EntryCollection *ec, RoomCollection *rc,
+                         const SensorReading *readings, int count) {
+    // Room of each reading, looked up once
+    Room **owners;
+    // New entry pointers in key order, and the merge sort's work space
+    LogEntry **batch;
+    LogEntry **scratch;
+    // Number of readings per series, indexed by room id * NUM_TYPES + type - 1,
+    // and where each series' readings go in the grouped batch
+    int *per_series;
+    int *starts;
+    int result;
+    PROFILE_CLOCK(started);
+
+    if (ec == NULL || rc == NULL || readings == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+    if (count < 0) {
+        return C_ERR_INVALID;
+    }
+    if (count == 0) {
+        return C_ERR_OK;
+    }
+
+    owners = malloc((size_t)count * sizeof(Room *));
+    batch = malloc((size_t)count * sizeof(LogEntry *));
+    scratch = malloc((size_t)count * sizeof(LogEntry *));
+    per_series = calloc((size_t)rc->size * NUM_TYPES + 1, sizeof(int));
+    starts = malloc(((size_t)rc->size * NUM_TYPES + 1) * sizeof(int));
+
+    if (owners == NULL || batch == NULL || scratch == NULL || per_series == NULL || starts == NULL) {
+        result = C_ERR_NO_MEMORY;
+    }
+    else {
+        result = insert_batch(ec, rc, readings, count, owners, batch, scratch, per_series, starts);
+    }
+
+    free(owners);
+    free(batch);
+    free(scratch);
+    free(per_series);
+    free(starts);
+    if (result == C_ERR_OK) {
+        PROFILE_COUNT(PROFILE_BATCH, moved, count);
+        PROFILE_STOP(PROFILE_BATCH, started);
+    }
+    return result;
+}
+
+/* ---- reading_print ---------------------------------------------------------
+   Purpose: Print one reading as a row of the entry table.
+   Params:
+     - room_name (in): name of the room the reading belongs to
+     - timestamp (in): timestamp of the reading
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - value (in): the reading's value
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for an unknown type
+----------------------------------------------------------------------------- */
+int reading_print(const char *room_name, int timestamp, int type, ReadingValue value) {
+    // Loop counter
+    int i;
+
+    if (room_name == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        return C_ERR_INVALID;
+    }
+
+    // Print room name and timestamp
+    printf("%-15s %10d  ", room_name, timestamp);
+    
+    // Print type and value based on type
+    if (type == TYPE_TEMP) {
+        printf("%-10s  %.2f°C\n", "TEMP", value.temperature);
+    }
+    else if (type == TYPE_DB) {
+        printf("%-10s  %d dB\n", "DB", value.decibels);
+    }
+    else {
+        printf("%-10s  [", "MOTION");
+
+        // Loop through the 3-element motion array
+        for (i = 0; i < 3; i++) {
+            printf("%d", value.motion[i]);
+            if (i < 2) {
+                printf(",");
+            }
+        }
+        printf("]\n");
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- entry_room ------------------------------------------------------------
+   Purpose: Find the room an entry belongs to from its room id.
+   Params:
+     - rc (in): room collection the entry's room is in
+     - e (in): entry
+   Returns: the room, or NULL if either pointer is NULL or the id is not
+            one of rc's
+----------------------------------------------------------------------------- */
+Room* entry_room(const RoomCollection *rc, const LogEntry *e) {
+    if (rc == NULL || e == NULL || (int)e->room >= rc->size) {
+        return NULL;
+    }
+
+    return rc->rooms[e->room];
+}
+
+/* ---- entry_print -----------------------------------------------------------
+   Purpose: Print a single log entry as a row of the entry table.
+   Params:
+     - rc (in): room collection the entry's room is in
+     - e (in): entry to print
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for a missing room or
+            unknown type
+----------------------------------------------------------------------------- */
+int entry_print(const RoomCollection *rc, const LogEntry *e) {
+    // The entry's room, found from its id
+    const Room *room;
+
+    // Check for empty pointers
+    if (rc == NULL || e == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+    
+    // Check for a room id outside the collection
+    room = entry_room(rc, e);
+    if (room == NULL) {
+        return C_ERR_INVALID;
+    }
+    
+    return reading_print(room->name, e->timestamp, e->type, e->value);
+}
+
+/* ---- room_print ------------------------------------------------------------
+   Purpose: Print a room header and all of its entries (already sorted),
+            reading each series front to back with a SeriesReader, which
+            merges in the late readings.
+   Params:
+     - r (in): room to print
+   Returns: C_ERR_OK, C_ERR_NULL_PTR if r is NULL
+----------------------------------------------------------------------------- */
+int room_print(const Room *r) {
+    // Loop counter over the room's series
+    int t;
+    int timestamp;
+    ReadingValue value;
+    SeriesReader reader;
+    LATENCY_START(started);
+    
+    // Check for empty room
+    if (r == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+    
+    // Print room header with name and entry count
+    printf("\nRoom: %s (entries=%d)\n", r->name, r->size);
+    
+    // Print column headers if there are entries to display
+    if (r->size > 0) {
+        printf("%-15s %10s  %-10s  %s\n", "ROOM", "TIMESTAMP", "TYPE", "VALUE");
+        printf("--------------- ----------  ----------  ---------------\n");
+        
+        // Print each entry in the room, one series per type in type order
+        for (t = 0; t < NUM_TYPES; t++) {
+            if (series_reader_init(&reader, r->series[t], INT_MIN) != C_ERR_OK) {
+                continue;
+            }
+            while (series_reader_next(&reader, &timestamp, &value)) {
+                reading_print(r->name, timestamp, t + 1, value);
+            }
+        }
+    }
+    else {
+        printf("  (No entries)\n");
+    }
+    LATENCY_STOP(LATENCY_PRINT, started);
+    
+    return C_ERR_OK;
+}
+
+/* ---- render_init -----------------------------------------------------------
+   Purpose: Start rendering into a caller-owned buffer.
+   Params:
+     - rb (out): render state
+     - fp (in): stream each full block is written to
+     - buffer (in): storage for pending output, kept by the caller
+     - capacity (in): size of buffer, at least RENDER_MAX_LINE
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for a small buffer
+----------------------------------------------------------------------------- */
+int render_init(RenderBuffer *rb, FILE *fp, char *buffer, size_t capacity) {
+    if (rb == NULL || fp == NULL || buffer == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (capacity < RENDER_MAX_LINE) {
+        return C_ERR_INVALID;
+    }
+
+    rb->fp = fp;
+    rb->buffer = buffer;
+    rb->capacity = capacity;
+    rb->used = 0;
+    return C_ERR_OK;
+}
+
+/* ---- render_flush ----------------------------------------------------------
+   Purpose: Write the pending output to the stream with a single fwrite.
+   Params:
+     - rb (in/out): render state
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO if the write came up short
+----------------------------------------------------------------------------- */
+int render_flush(RenderBuffer *rb) {
+    size_t used;
+
+    if (rb == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    used = rb->used;
+    rb->used = 0;
+    if (used > 0 && fwrite(rb->buffer, 1, used, rb->fp) != used) {
+        return C_ERR_IO;
+    }
+    return C_ERR_OK;
+}
+
+/* ---- render_reserve --------------------------------------------------------
+   Purpose: Make sure one more row of up to RENDER_MAX_LINE bytes fits.
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int render_reserve(RenderBuffer *rb) {
+    if (rb->capacity - rb->used < RENDER_MAX_LINE) {
+        return render_flush(rb);
+    }
+    return C_ERR_OK;
+}
+
+/* ---- put_padded / put_int --------------------------------------------------
+   Purpose: Append text left-justified, or a decimal int right-justified, in
+            a field of at least width characters (%-*s and %*d).
+   Returns: position after the field
+----------------------------------------------------------------------------- */
+static char* put_padded(char *p, const char *text, int width) {
+    while (*text != '\0') {
+        *p++ = *text++;
+        width--;
+    }
+    while (width-- > 0) {
+        *p++ = ' ';
+    }
+    return p;
+}
+
+static char* put_int(char *p, int value, int width) {
+    // Digits are produced last to first
+    char digits[12];
+    int n = 0;
+    unsigned int magnitude = (value < 0) ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[n++] = '-';
+    }
+
+    while (width-- > n) {
+        *p++ = ' ';
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+/* ---- put_fixed2 ------------------------------------------------------------
+   Purpose: Append a float exactly as printf's %.2f would. A float has 24
+            significant bits, so number * 100 is exact in a double and
+            rounding it half-to-even gives printf's result. Values that do
+            not fit in 64-bit cents, and NaN, go through snprintf.
+   Returns: position after the number
+----------------------------------------------------------------------------- */
+static char* put_fixed2(char *p, float number) {
+    double value = number;
+    double scaled, fraction;
+    unsigned long long cents, whole;
+    // Digits of the whole part, produced last to first
+    char digits[20];
+    int n = 0;
+
+    if (!(value > -1e15 && value < 1e15)) {
+        return p + snprintf(p, RENDER_MAX_LINE / 2, "%.2f", value);
+    }
+
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+
+    scaled = value * 100.0;
+    cents = (unsigned long long)scaled;
+    fraction = scaled - (double)cents;
+    if (fraction > 0.5 || (fraction == 0.5 && (cents & 1) != 0)) {
+        cents++;
+    }
+
+    whole = cents / 100;
+    do {
+        digits[n++] = (char)('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+
+    *p++ = '.';
+    *p++ = (char)('0' + (cents / 10) % 10);
+    *p++ = (char)('0' + cents % 10);
+    return p;
+}
+
+/* ---- render_text -----------------------------------------------------------
+   Purpose: Append literal text, such as a table header.
+   Params:
+     - rb (in/out): render state
+     - text (in): text to append
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int render_text(RenderBuffer *rb, const char *text) {
+    size_t length, chunk;
+
+    if (rb == NULL || text == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    length = strlen(text);
+    while (length > 0) {
+        if (rb->used == rb->capacity && render_flush(rb) != C_ERR_OK) {
+            return C_ERR_IO;
+        }
+        chunk = rb->capacity - rb->used;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(rb->buffer + rb->used, text, chunk);
+        rb->used += chunk;
+        text += chunk;
+        length -= chunk;
+    }
+    return C_ERR_OK;
+}
+
+/* ---- render_reading --------------------------------------------------------
+   Purpose: Append one reading as a row of the entry table, the same bytes
+            reading_print writes.
+   Params:
+     - rb (in/out): render state
+     - room_name (in): name of the room, shorter than MAX_STR
+     - timestamp (in): timestamp of the reading
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - value (in): the reading's value
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for an unknown type or a
+            long name, C_ERR_IO
+----------------------------------------------------------------------------- */
+int render_reading(RenderBuffer *rb, const char *room_name, int timestamp, int type,
+                   ReadingValue value) {
+    char *p;
+    int i;
+
+    if (rb == NULL || room_name == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if ((type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) ||
+        strnlen(room_name, MAX_STR) == MAX_STR) {
+        return C_ERR_INVALID;
+    }
+
+    if (render_reserve(rb) != C_ERR_OK) {
+        return C_ERR_IO;
+    }
+
+    // "%-15s %10d  " then "%-10s  " and the value
+    p = rb->buffer + rb->used;
+    p = put_padded(p, room_name, 15);
+    *p++ = ' ';
+    p = put_int(p, timestamp, 10);
+    *p++ = ' ';
+    *p++ = ' ';
+
+    if (type == TYPE_TEMP) {
+        p = put_padded(p, "TEMP", 12);
+        p = put_fixed2(p, value.temperature);
+        memcpy(p, "°C\n", sizeof("°C\n") - 1);
+        p += sizeof("°C\n") - 1;
+    }
+    else if (type == TYPE_DB) {
+        p = put_padded(p, "DB", 12);
+        p = put_int(p, value.decibels, 0);
+        memcpy(p, " dB\n", 4);
+        p += 4;
+    }
+    else {
+        p = put_padded(p, "MOTION", 12);
+        *p++ = '[';
+        for (i = 0; i < 3; i++) {
+            p = put_int(p, value.motion[i], 0);
+            *p++ = (i < 2) ? ',' : ']';
+        }
+        *p++ = '\n';
+    }
+
+    rb->used = (size_t)(p - rb->buffer);
+    return C_ERR_OK;
+}
+
+/* ---- render_entry ----------------------------------------------------------
+   Purpose: Append a log entry as a row of the entry table (see entry_print).
+   Params:
+     - rb (in/out): render state
+     - rc (in): room collection the entry's room is in
+     - e (in): entry to render
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID, C_ERR_IO
+----------------------------------------------------------------------------- */
+int render_entry(RenderBuffer *rb, const RoomCollection *rc, const LogEntry *e) {
+    const Room *room;
+
+    if (rc == NULL || e == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    room = entry_room(rc, e);
+    if (room == NULL) {
+        return C_ERR_INVALID;
+    }
+
+    return render_reading(rb, room->name, e->timestamp, e->type, e->value);
+}
+
+/* ---- render_room -----------------------------------------------------------
+   Purpose: Append a room header and all of its entries (see room_print).
+   Params:
+     - rb (in/out): render state
+     - r (in): room to render
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int render_room(RenderBuffer *rb, const Room *r) {
+    SeriesReader reader;
+    ReadingValue value;
+    char *p;
+    int t, timestamp, result;
+    LATENCY_START(started);
+
+    if (rb == NULL || r == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (render_reserve(rb) != C_ERR_OK) {
+        return C_ERR_IO;
+    }
+
+    // "\nRoom: %s (entries=%d)\n"
+    p = rb->buffer + rb->used;
+    p = put_padded(p, "\nRoom: ", 0);
+    p = put_padded(p, r->name, 0);
+    p = put_padded(p, " (entries=", 0);
+    p = put_int(p, r->size, 0);
+    *p++ = ')';
+    *p++ = '\n';
+    rb->used = (size_t)(p - rb->buffer);
+
+    if (r->size == 0) {
+        result = render_text(rb, "  (No entries)\n");
+        if (result == C_ERR_OK) {
+            LATENCY_STOP(LATENCY_PRINT, started);
+        }
+        return result;
+    }
+
+    result = render_text(rb, "ROOM             TIMESTAMP  TYPE        VALUE\n"
+                             "--------------- ----------  ----------  ---------------\n");
+    for (t = 0; t < NUM_TYPES && result == C_ERR_OK; t++) {
+        if (series_reader_init(&reader, r->series[t], INT_MIN) != C_ERR_OK) {
+            continue;
+        }
+        while (result == C_ERR_OK && series_reader_next(&reader, &timestamp, &value)) {
+            result = render_reading(rb, r->name, timestamp, t + 1, value);
+        }
+    }
+
+    if (result == C_ERR_OK) {
+        LATENCY_STOP(LATENCY_PRINT, started);
+    }
+    return result;
+}
+
+/* ---- room_query_range ------------------------------------------------------
+   Purpose: Report every reading of one type in a room whose timestamp lies in
+            [t_from, t_to], in timestamp order. The start is found by binary
+            search (see series_reader_init) and the readings from there are
+            read sequentially, so the cost is O(log n + k), plus decoding
+            at most one block ahead of the range for sealed readings and
+            one comparison per late run for each reading.
+   Params:
+     - room (in): room to query
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - t_from (in): first timestamp of the range (inclusive)
+     - t_to (in): last timestamp of the range (inclusive)
+     - callback (in): called once per reading; a non-zero return stops the query
+     - ctx (in/out): passed through to callback
+   Returns: number of readings passed to callback (0 for an empty range),
+            C_ERR_NULL_PTR, C_ERR_INVALID for an unknown type
+----------------------------------------------------------------------------- */
+int room_query_range(const Room *room, int type, int t_from, int t_to,
+                     RangeCallback callback, void *ctx) {
+    // Readings reported so far
+    int count = 0;
+    int timestamp;
+    ReadingValue value;
+    SeriesReader reader;
+    const Series *series;
+    LATENCY_START(started);
+
+    if (room == NULL || callback == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        return C_ERR_INVALID;
+    }
+
+    series = room->series[type - 1];
+    if (series == NULL || t_from > t_to) {
+        return 0;
+    }
+
+    series_reader_init(&reader, series, t_from);
+    while (series_reader_next(&reader, &timestamp, &value) && timestamp <= t_to) {
+        count++;
+        if (callback(room, type, timestamp, value, ctx) != 0) {
+            break;
+        }
+    }
+
+    LATENCY_STOP(LATENCY_QUERY, started);
+    return count;
+}
+
+/* ---- series_number ---------------------------------------------------------
+   Purpose: Read the value at position i of a series as a number to aggregate:
+            the temperature, the decibel level, or for motion the number of
+            directions (0-3) that saw movement.
+   Params:
+     - series (in): series to read
+     - i (in): position, 0 <= i < series->size
+   Returns: the value as a double (exact for every type)
+----------------------------------------------------------------------------- */
+static double series_number(const Series *series, int i) {
+    const unsigned long long *words;
+
+    if (series->type == TYPE_TEMP) {
+        return series->values.temperature[i];
+    }
+    if (series->type == TYPE_DB) {
+        return series->values.decibels[i];
+    }
+    i += series->offset;
+    words = &series->values.motion[MOTION_PLANES * (i / 64)];
+    return (double)(((words[0] >> (i % 64)) & 1) + ((words[1] >> (i % 64)) & 1) +
+                    ((words[2] >> (i % 64)) & 1));
+}
+
+/* ---- reading_number --------------------------------------------------------
+   Purpose: A reading's value as a number to aggregate, as series_number.
+----------------------------------------------------------------------------- */
+static double reading_number(int type, ReadingValue value) {
+    if (type == TYPE_TEMP) {
+        return value.temperature;
+    }
+    if (type == TYPE_DB) {
+        return value.decibels;
+    }
+    return (double)(value.motion[0] + value.motion[1] + value.motion[2]);
+}
+
+/* ---- room_aggregate ----------------------------------------------------------
+   Purpose: Summarise one room's readings of one type in [t_from, t_to] per
+            fixed-width time bucket, in a single sequential pass: sealed
+            readings through a SeriesReader, then the columns directly. A
+            series with late readings is read through the SeriesReader to
+            the end, which merges them in; the series is not changed.
+            Buckets are aligned to multiples of width
+            (a bucket holds timestamps start .. start + width - 1) and only
+            buckets with readings are reported, in time order.
+   Params:
+     - room (in): room to aggregate
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION (see series_number for motion)
+     - t_from (in): first timestamp to include
+     - t_to (in): last timestamp to include
+     - width (in): bucket width in timestamp units, > 0
+     - callback (in): called once per bucket; a non-zero return stops the pass
+     - ctx (in/out): passed through to callback
+   Returns: number of buckets passed to callback, C_ERR_NULL_PTR,
+            C_ERR_INVALID for an unknown type or width <= 0
+----------------------------------------------------------------------------- */
+int room_aggregate(const Room *room, int type, int t_from, int t_to, int width,
+                   AggregateCallback callback, void *ctx) {
+    // The current reading
+    int timestamp;
+    ReadingValue value;
+    // Slice of the columns inside [t_from, t_to] and the current position
+    int first, last, i;
+    // Required by the search helpers, not reported
+    unsigned long comparisons = 0;
+    // Number of buckets reported so far
+    int buckets = 0;
+    // Exclusive end of the current bucket
+    long long bucket_end = 0;
+    double number;
+    // Non-zero if the reader reads the whole series, late readings included
+    int merged;
+    Aggregate bucket;
+    SeriesReader reader;
+    const Series *series;
+    LATENCY_START(started);
+
+    if (room == NULL || callback == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if ((type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) || width <= 0) {
+        return C_ERR_INVALID;
+    }
+
+    series = room->series[type - 1];
+    if (series == NULL || t_from > t_to) {
+        return 0;
+    }
+
+    merged = (series->late.count + series->run_readings > 0);
+    series_reader_init(&reader, series, t_from);
+    first = lower_bound(series->timestamps, series->size, t_from, &comparisons);
+    last = upper_bound(series->timestamps, series->size, t_to, &comparisons);
+
+    bucket.count = 0;
+    i = first;
+    while (1) {
+        // The reader holds a block's reading until the blocks run out
+        if ((merged || reader.block < series->num_blocks) &&
+            series_reader_next(&reader, &timestamp, &value)) {
+            number = reading_number(type, value);
+        }
+        else if (!merged && i < last) {
+            timestamp = series->timestamps[i];
+            number = series_number(series, i);
+            i++;
+        }
+        else {
+            break;
+        }
+        if (timestamp > t_to) {
+            break;
+        }
+
+        // Close the current bucket once a timestamp passes its end
+        if (bucket.count > 0 && timestamp >= bucket_end) {
+            bucket.mean = bucket.sum / bucket.count;
+            buckets++;
+            if (callback(room, type, &bucket, ctx) != 0) {
+                LATENCY_STOP(LATENCY_AGGREGATE, started);
+                return buckets;
+            }
+            bucket.count = 0;
+        }
+
+        if (bucket.count == 0) {
+            // Round down to a multiple of width, also for negative timestamps
+            bucket.start = (long long)timestamp - (((long long)timestamp % width) + width) % width;
+            bucket_end = bucket.start + width;
+            bucket.sum = 0;
+            bucket.min = number;
+            bucket.max = number;
+        }
+
+        bucket.count++;
+        bucket.sum += number;
+        if (number < bucket.min) {
+            bucket.min = number;
+        }
+        if (number > bucket.max) {
+            bucket.max = number;
+        }
+    }
+
+    if (bucket.count > 0) {
+        bucket.mean = bucket.sum / bucket.count;
+        buckets++;
+        callback(room, type, &bucket, ctx);
+    }
+
+    LATENCY_STOP(LATENCY_AGGREGATE, started);
+    return buckets;
+}
+
+/* ---- deque_reserve -----------------------------------------------------------
+   Purpose: Make sure a ring-buffer deque can hold 'needed' positions, growing
+            it (and unwrapping its contents) when it cannot.
+   Params:
+     - dq (in/out): deque to grow
+     - needed (in): number of positions that must fit
+   Returns: C_ERR_OK, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int deque_reserve(IndexDeque *dq, int needed) {
+    int new_capacity;
+    int i;
+    int *items;
+
+    if (needed <= dq->capacity) {
+        return C_ERR_OK;
+    }
+
+    new_capacity = (dq->capacity > 0) ? dq->capacity : MAX_ARR;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    items = malloc((size_t)new_capacity * sizeof(int));
+    if (items == NULL) {
+        return C_ERR_NO_MEMORY;
+    }
+    for (i = 0; i < dq->size; i++) {
+        items[i] = dq->items[(dq->head + i) % dq->capacity];
+    }
+
+    free(dq->items);
+    dq->items = items;
+    dq->head = 0;
+    dq->capacity = new_capacity;
+    return C_ERR_OK;
+}
+
+/* ---- rolling_push ----------------------------------------------------------
+   Purpose: Add the reading at series position pos, which must be newer than
+            every reading already in the window, to the running count and sum
+            and to the back of both monotonic deques. Positions whose value
+            can no longer be the window's min (or max) are dropped first.
+   Params:
+     - stats (in/out): rolling statistics (deques have room for one more)
+     - series (in): series the positions refer to
+     - pos (in): position of the new reading
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void rolling_push(RollingStats *stats, const Series *series, int pos) {
+    double number = series_number(series, pos);
+    IndexDeque *min_q = &stats->min_q;
+    IndexDeque *max_q = &stats->max_q;
+
+    stats->count++;
+    stats->sum += number;
+
+    while (min_q->size > 0 &&
+           series_number(series, min_q->items[(min_q->head + min_q->size - 1) % min_q->capacity]) >= number) {
+        min_q->size--;
+    }
+    min_q->items[(min_q->head + min_q->size) % min_q->capacity] = pos;
+    min_q->size++;
+
+    while (max_q->size > 0 &&
+           series_number(series, max_q->items[(max_q->head + max_q->size - 1) % max_q->capacity]) <= number) {
+        max_q->size--;
+    }
+    max_q->items[(max_q->head + max_q->size) % max_q->capacity] = pos;
+    max_q->size++;
+}
+
+/* ---- rolling_evict ---------------------------------------------------------
+   Purpose: Drop readings that have fallen out of the window, which ends at the
+            series' newest timestamp and is stats->window timestamps wide.
+   Params:
+     - stats (in/out): rolling statistics
+     - series (in): series the positions refer to (size > 0)
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void rolling_evict(RollingStats *stats, const Series *series) {
+    // Readings at or before this timestamp are outside the window
+    long long cutoff = (long long)series->timestamps[series->size - 1] - stats->window;
+    IndexDeque *min_q = &stats->min_q;
+    IndexDeque *max_q = &stats->max_q;
+
+    while (stats->count > 0 && series->timestamps[stats->head] <= cutoff) {
+        stats->count--;
+        stats->sum -= series_number(series, stats->head);
+
+        if (min_q->size > 0 && min_q->items[min_q->head] == stats->head) {
+            min_q->head = (min_q->head + 1) % min_q->capacity;
+            min_q->size--;
+        }
+        if (max_q->size > 0 && max_q->items[max_q->head] == stats->head) {
+            max_q->head = (max_q->head + 1) % max_q->capacity;
+            max_q->size--;
+        }
+        stats->head++;
+    }
+}
+
+/* ---- rolling_window_start --------------------------------------------------
+   Purpose: Find the first position of a series inside a window of 'window'
+            timestamps that ends at its newest reading.
+   Params:
+     - series (in): series to search (size > 0)
+     - window (in): window width, > 0
+   Returns: position of the oldest reading in the window
+----------------------------------------------------------------------------- */
+static int rolling_window_start(const Series *series, int window) {
+    // Readings at or before this timestamp are outside the window
+    long long cutoff = (long long)series->timestamps[series->size - 1] - window;
+    // Required by the search helper, not reported
+    unsigned long comparisons = 0;
+
+    if (cutoff < series->timestamps[0]) {
+        return 0;
+    }
+    return upper_bound(series->timestamps, series->size, (int)cutoff, &comparisons);
+}
+
+/* ---- rolling_rebuild -------------------------------------------------------
+   Purpose: Recompute rolling statistics from the series' columns. Used when a
+            reading lands inside the series rather than at its end, since that
+            moves the positions the deques hold; costs O(readings in window).
+   Params:
+     - stats (in/out): rolling statistics (deques have room for the window)
+     - series (in): series to read, or NULL to just empty the statistics
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void rolling_rebuild(RollingStats *stats, const Series *series) {
+    int i;
+
+    stats->head = 0;
+    stats->count = 0;
+    stats->sum = 0;
+    stats->min_q.head = 0;
+    stats->min_q.size = 0;
+    stats->max_q.head = 0;
+    stats->max_q.size = 0;
+
+    if (series == NULL || series->size == 0) {
+        return;
+    }
+
+    stats->head = rolling_window_start(series, stats->window);
+    for (i = stats->head; i < series->size; i++) {
+        rolling_push(stats, series, i);
+    }
+}
+
+/* ---- rolling_reserve -------------------------------------------------------
+   Purpose: Make sure a room's rolling statistics for a type can take 'extra'
+            more readings without allocating, so inserts cannot fail halfway.
+            A window with new readings never holds more than the readings it
+            held before plus the new ones, so that is all the deques need.
+   Params:
+     - room (in/out): room whose statistics to grow
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - extra (in): number of readings about to be added
+   Returns: C_ERR_OK (also when rolling statistics are off), C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int rolling_reserve(Room *room, int type, int extra) {
+    RollingStats *stats = room->rolling[type - 1];
+
+    if (stats == NULL) {
+        return C_ERR_OK;
+    }
+
+    if (deque_reserve(&stats->min_q, stats->count + extra) != C_ERR_OK ||
+        deque_reserve(&stats->max_q, stats->count + extra) != C_ERR_OK) {
+        return C_ERR_NO_MEMORY;
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- rolling_after_insert --------------------------------------------------
+   Purpose: Bring a room's rolling statistics up to date after entries_create
+            put a reading at position pos of a series. Appends are O(1)
+            amortized; anything else falls back to a rebuild.
+   Params:
+     - room (in/out): room owning the series
+     - series (in): series that grew
+     - pos (in): position of the new reading
+     - appended (in): non-zero if the reading went onto the end of the series
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void rolling_after_insert(Room *room, const Series *series, int pos, int appended) {
+    RollingStats *stats = room->rolling[series->type - 1];
+
+    if (stats == NULL) {
+        return;
+    }
+
+    if (appended) {
+        rolling_push(stats, series, pos);
+        rolling_evict(stats, series);
+    }
+    else {
+        rolling_rebuild(stats, series);
+    }
+}
+
+/* ---- room_rolling_configure ------------------------------------------------
+   Purpose: Turn on rolling statistics for one room and type over the last
+            'window' timestamps (the window ends at the newest reading), or
+            turn them off with window <= 0. Existing readings are taken into
+            account straight away; after that entries_create keeps the
+            statistics up to date.
+   Params:
+     - room (in/out): room to configure
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - window (in): window width in timestamp units, <= 0 to turn off
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_NO_MEMORY, C_ERR_INVALID for a
+            bad type or a window that reaches sealed readings (see
+            entries_compress)
+----------------------------------------------------------------------------- */
+int room_rolling_configure(Room *room, int type, int window) {
+    RollingStats *stats;
+    const Series *series;
+    // Readings that will be in the window
+    int count = 0;
+
+    if (room == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        return C_ERR_INVALID;
+    }
+
+    stats = room->rolling[type - 1];
+    if (window <= 0) {
+        if (stats != NULL) {
+            free(stats->min_q.items);
+            free(stats->max_q.items);
+            free(stats);
+            room->rolling[type - 1] = NULL;
+        }
+        return C_ERR_OK;
+    }
+
+    // The window is kept as column positions, so it must not reach back
+    // into sealed readings
+    series = room->series[type - 1];
+    if (series != NULL && series->sealed > 0 &&
+        (series->size == 0 ||
+         (long long)series->timestamps[series->size - 1] - window < sealed_last(series))) {
+        return C_ERR_INVALID;
+    }
+
+    if (stats == NULL) {
+        stats = calloc(1, sizeof(RollingStats));
+        if (stats == NULL) {
+            return C_ERR_NO_MEMORY;
+        }
+        room->rolling[type - 1] = stats;
+    }
+
+    if (series != NULL && series->size > 0) {
+        count = series->size - rolling_window_start(series, window);
+    }
+    if (deque_reserve(&stats->min_q, count) != C_ERR_OK ||
+        deque_reserve(&stats->max_q, count) != C_ERR_OK) {
+        // A new, never used configuration is dropped again
+        if (stats->window == 0) {
+            room_rolling_configure(room, type, 0);
+        }
+        return C_ERR_NO_MEMORY;
+    }
+
+    stats->window = window;
+    rolling_rebuild(stats, series);
+    return C_ERR_OK;
+}
+
+/* ---- room_rolling ----------------------------------------------------------
+   Purpose: Read a room's rolling statistics for one type in O(1). The
+            statistics cover the columns; late readings inside the window
+            are added from the runs and memtable (O(log k) plus one step per
+            late reading in the window), without changing the series.
+   Params:
+     - room (in): room to read
+     - type (in): TYPE_TEMP|TYPE_DB|TYPE_MOTION
+     - out (out): count, sum, min, max and mean of the readings in the window;
+                  start is the first timestamp of the window. min, max and
+                  mean are 0 when the window is empty.
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID,
+            C_ERR_NOT_FOUND if rolling statistics are off for the type
+----------------------------------------------------------------------------- */
+int room_rolling(const Room *room, int type, Aggregate *out) {
+    const RollingStats *stats;
+    const Series *series;
+    SeriesReader reader;
+    ReadingValue value;
+    // First timestamp of the window, and a late reading in it
+    long long start;
+    int timestamp;
+    double number;
+
+    if (room == NULL || out == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (type != TYPE_TEMP && type != TYPE_DB && type != TYPE_MOTION) {
+        return C_ERR_INVALID;
+    }
+
+    stats = room->rolling[type - 1];
+    if (stats == NULL) {
+        return C_ERR_NOT_FOUND;
+    }
+
+    series = room->series[type - 1];
+    memset(out, 0, sizeof(*out));
+    out->count = stats->count;
+    out->sum = stats->sum;
+    if (stats->count == 0) {
+        return C_ERR_OK;
+    }
+
+    start = (long long)series->timestamps[series->size - 1] - stats->window + 1;
+    out->start = start;
+    out->min = series_number(series, stats->min_q.items[stats->min_q.head]);
+    out->max = series_number(series, stats->max_q.items[stats->max_q.head]);
+
+    // Late readings are never newer than the columns' newest, so the window
+    // holds those from its start on
+    late_reader_init(&reader, series, (start < INT_MIN) ? INT_MIN : (int)start);
+    while (series_reader_next(&reader, &timestamp, &value)) {
+        number = reading_number(type, value);
+        out->count++;
+        out->sum += number;
+        if (number < out->min) {
+            out->min = number;
+        }
+        if (number > out->max) {
+            out->max = number;
+        }
+    }
+    out->mean = out->sum / out->count;
+
+    return C_ERR_OK;
+}
+
+/* ---- motion_count ----------------------------------------------------------
+   Purpose: Add readings first .. last - 1 of a set of motion bitplanes to a
+            summary, 64 readings at a time with popcounts; only the two end
+            words are masked, so there is no branch per reading.
+   Params:
+     - words (in): motion bitplanes
+     - first (in): first reading to count
+     - last (in): one past the last reading to count
+     - out (in/out): counts to add to
+   Returns: Nothing (void)
+----------------------------------------------------------------------------- */
+static void motion_count(const unsigned long long *words, int first, int last,
+                         MotionSummary *out) {
+    // g walks the word groups of the readings
+    int g, g_last;
+    unsigned long long mask, left, forward, right;
+
+    if (first >= last) {
+        return;
+    }
+
+    out->readings += last - first;
+    g_last = (last - 1) / 64;
+    for (g = first / 64; g <= g_last; g++) {
+        mask = ~0ULL;
+        if (g == first / 64) {
+            mask &= ~0ULL << (first % 64);
+        }
+        if (g == g_last && last % 64 != 0) {
+            mask &= ~0ULL >> (64 - last % 64);
+        }
+
+        left = words[MOTION_PLANES * g] & mask;
+        forward = words[MOTION_PLANES * g + 1] & mask;
+        right = words[MOTION_PLANES * g + 2] & mask;
+        out->left += motion_popcount(left);
+        out->forward += motion_popcount(forward);
+        out->right += motion_popcount(right);
+        out->any += motion_popcount(left | forward | right);
+    }
+}
+
+/* ---- room_motion_summary ---------------------------------------------------
+   Purpose: Count a room's motion readings in [t_from, t_to] and how many saw
+            movement in each direction and in any direction. The range is
+            found by binary search and then counted with motion_count. Sealed
+            blocks keep their bitplanes, so a block inside the range is
+            counted without decoding it; only the blocks at the two ends
+            have their timestamps decoded. Late readings in the range are
+            then counted one at a time from the runs and memtable; the
+            series is not changed.
+   Params:
+     - room (in): room to summarise
+     - t_from (in): first timestamp of the range (inclusive)
+     - t_to (in): last timestamp of the range (inclusive)
+     - out (out): the counts, all zero for an empty range
+   Returns: C_ERR_OK, C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int room_motion_summary(const Room *room, int t_from, int t_to, MotionSummary *out) {
+    const Series *series;
+    const SeriesBlock *block;
+    SeriesReader reader;
+    ReadingValue value;
+    // Readings [first, last) of a block or of the columns are in range
+    int first, last, b;
+    int timestamp;
+    // Required by the search helpers, not reported
+    unsigned long comparisons = 0;
+
+    if (room == NULL || out == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    memset(out, 0, sizeof(*out));
+    series = room->series[TYPE_MOTION - 1];
+    if (series == NULL || t_from > t_to) {
+        return C_ERR_OK;
+    }
+
+    for (b = first_block(series, t_from);
+         b < series->num_blocks && series->blocks[b]->first <= t_to; b++) {
+        block = series->blocks[b];
+        first = 0;
+        last = block->count;
+        if (block->first < t_from || block->last > t_to) {
+            block_range(block, t_from, t_to, &first, &last);
+        }
+        motion_count(block->data, first, last, out);
+    }
+
+    first = lower_bound(series->timestamps, series->size, t_from, &comparisons);
+    last = upper_bound(series->timestamps, series->size, t_to, &comparisons);
+    motion_count(series->values.motion, series->offset + first, series->offset + last, out);
+
+    late_reader_init(&reader, series, t_from);
+    while (series_reader_next(&reader, &timestamp, &value) && timestamp <= t_to) {
+        out->readings++;
+        out->left += value.motion[0];
+        out->forward += value.motion[1];
+        out->right += value.motion[2];
+        out->any += (value.motion[0] | value.motion[1] | value.motion[2]);
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- rooms_clear -----------------------------------------------------------
+   Purpose: Release every room, its rolling statistics and the name index,
+            leaving an empty collection. The entries and series are owned by the EntryCollection,
+            which should be cleared first.
+   Params:
+     - rc (in/out): room collection to clear
+   Returns: C_ERR_OK, C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int rooms_clear(RoomCollection *rc) {
+    // Loop counters over rooms and types
+    int i, t;
+    RollingStats *stats;
+
+    if (rc == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    for (i = 0; i < rc->size; i++) {
+        for (t = 0; t < NUM_TYPES; t++) {
+            stats = rc->rooms[i]->rolling[t];
+            if (stats != NULL) {
+                free(stats->min_q.items);
+                free(stats->max_q.items);
+                free(stats);
+            }
+        }
+        free(rc->rooms[i]);
+    }
+    free(rc->rooms);
+    free(rc->sorted);
+    free(rc->index);
+
+    rc->rooms = NULL;
+    rc->sorted = NULL;
+    rc->size = 0;
+    rc->capacity = 0;
+    rc->index = NULL;
+    rc->index_cap = 0;
+
+    return C_ERR_OK;
+}
+
+/* ---- entries_clear ---------------------------------------------------------
+   Purpose: Release all entry partitions and series (with their sealed
+            blocks), leaving an empty collection that can be used again with
+            the same partition width. The rooms the series belong to must still
+            exist, so clear entries before rooms.
+   Params:
+     - ec (in/out): entry collection to clear
+   Returns: C_ERR_OK, C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int entries_clear(EntryCollection *ec) {
+    // Loop counter over partitions and series
+    int i;
+
+    if (ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    for (i = 0; i < ec->num_partitions; i++) {
+        partition_free(&ec->partitions[i]);
+    }
+    free(ec->partitions);
+    free(ec->partition_index);
+
+    // Detach each series from its room so the rooms can be reused
+    for (i = 0; i < ec->num_series; i++) {
+        ec->series[i]->room->size = 0;
+        series_free(ec->series[i]);
+    }
+    free(ec->series);
+
+    if (ec->mapping != NULL) {
+        munmap(ec->mapping, ec->mapping_size);
+    }
+
+    ec->partitions = NULL;
+    ec->num_partitions = 0;
+    ec->partition_cap = 0;
+    ec->partition_index = NULL;
+    ec->partition_index_cap = 0;
+    ec->last_partition = 0;
+    ec->series = NULL;
+    ec->num_series = 0;
+    ec->series_cap = 0;
+    ec->size = 0;
+    ec->slots = 0;
+    ec->mapping = NULL;
+    ec->mapping_size = 0;
+    ec->comparisons = 0;
+    ec->fast_appends = 0;
+    ec->slow_inserts = 0;
+
+    return C_ERR_OK;
+}
+
+/* ---- entries_cursor_init ---------------------------------------------------
+   Purpose: Position a cursor before the first entry of a collection.
+   Params:
+     - cursor (out): cursor to initialise
+     - ec (in): collection to walk; must not change while the cursor is used
+   Returns: C_ERR_OK, C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int entries_cursor_init(EntryCursor *cursor, const EntryCollection *ec) {
+    if (cursor == NULL || ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    cursor->ec = ec;
+    cursor->series = 0;
+    cursor->pos = 0;
+    return C_ERR_OK;
+}
+
+/* ---- entries_cursor_next ---------------------------------------------------
+   Purpose: Return the next entry in room -> type -> timestamp order.
+   Params:
+     - cursor (in/out): cursor set up by entries_cursor_init
+   Returns: the next entry (for a mapped series, a sealed reading or a
+            series with late readings, cursor->row), or NULL once every
+            entry has been returned
+----------------------------------------------------------------------------- */
+LogEntry* entries_cursor_next(EntryCursor *cursor) {
+    const Series *series;
+    // Position in the series' columns
+    int i;
+    int timestamp = 0;
+    // Late readings of the series
+    int late;
+
+    if (cursor == NULL || cursor->ec == NULL) {
+        return NULL;
+    }
+
+    while (cursor->series < cursor->ec->num_series) {
+        series = cursor->ec->series[cursor->series];
+        cursor->row.room = (unsigned int)series->room->seq;
+        cursor->row.type = (unsigned int)series->type;
+        late = series->late.count + series->run_readings;
+        if (cursor->pos < series->sealed ||
+            (late > 0 && cursor->pos < series->sealed + series->size + late)) {
+            // Sealed readings, or a series with late ones: read it through
+            // the reader, which decodes and merges them
+            if (cursor->pos == 0) {
+                series_reader_init(&cursor->reader, series, INT_MIN);
+            }
+            series_reader_next(&cursor->reader, &timestamp, &cursor->row.value);
+            cursor->row.timestamp = timestamp;
+            cursor->pos++;
+            return &cursor->row;
+        }
+
+        i = cursor->pos - series->sealed;
+        if (i < series->size && series->rows == NULL) {
+            // Mapped series: build the entry from the columns
+            cursor->row.timestamp = series->timestamps[i];
+            cursor->row.value = series_value(series, i);
+            cursor->pos++;
+            return &cursor->row;
+        }
+        if (i < series->size) {
+            cursor->pos++;
+            return series->rows[i];
+        }
+        cursor->series++;
+        cursor->pos = 0;
+    }
+
+    return NULL;
+}
+
+/* ---- validate_fail ---------------------------------------------------------
+   Purpose: Record the first violation of an entries_validate pass.
+   Params:
+     - v (in/out): validation whose report to fill; v->series names the
+                   series at fault, or is NULL
+     - check (in): VALIDATE_ORDER or VALIDATE_ROOMS
+     - position (in): reading position in the series, -1 for none
+     - format (in): printf format of the message, then its arguments
+   Returns: C_ERR_INVALID
+----------------------------------------------------------------------------- */
+static int validate_fail(Validation *v, int check, long long position, const char *format, ...) {
+    va_list args;
+
+    v->report->check = check;
+    v->report->room = (v->series != NULL) ? v->series->room->id : -1;
+    v->report->type = (v->series != NULL) ? v->series->type : 0;
+    v->report->position = position;
+    va_start(args, format);
+    vsnprintf(v->report->message, sizeof(v->report->message), format, args);
+    va_end(args);
+    return C_ERR_INVALID;
+}
+
+/* ---- pointer_cmp -----------------------------------------------------------
+   Purpose: qsort comparator ordering entry pointers by address.
+----------------------------------------------------------------------------- */
+static int pointer_cmp(const void *a, const void *b) {
+    const LogEntry *x = *(const LogEntry *const *)a;
+    const LogEntry *y = *(const LogEntry *const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* ---- validate_group --------------------------------------------------------
+   Purpose: Check that the stored entries of the readings with the current
+            timestamp are all different, and start a new group. An entry
+            referenced twice in a sorted series has the same timestamp both
+            times, so only these groups need comparing, and they are
+            nearly always one reading long.
+   Params:
+     - v (in/out): validation in progress
+   Returns: C_ERR_OK, C_ERR_INVALID
+----------------------------------------------------------------------------- */
+static int validate_group(Validation *v) {
+    int i;
+
+    if (v->group_size > 2) {
+        qsort(v->group, (size_t)v->group_size, sizeof(LogEntry *), pointer_cmp);
+    }
+    for (i = 1; i < v->group_size; i++) {
+        if (v->group[i] == v->group[i - 1]) {
+            return validate_fail(v, VALIDATE_ROOMS, v->position,
+                                 "%s type %d: the entry at timestamp %d is referenced twice",
+                                 v->series->room->name, v->series->type, v->previous);
+        }
+    }
+    v->group_size = 0;
+    return C_ERR_OK;
+}
+
+/* ---- validate_reading ------------------------------------------------------
+   Purpose: Check the next reading of the series being validated: it is not
+            older than the one before, and its stored entry (if it has one)
+            belongs to the series and carries the timestamp it is kept
+            under.
+   Params:
+     - v (in/out): validation in progress
+     - timestamp (in): timestamp the reading is kept under
+     - e (in): its stored entry, NULL for sealed and mapped readings
+   Returns: C_ERR_OK, C_ERR_INVALID, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int validate_reading(Validation *v, int timestamp, const LogEntry *e) {
+    const Series *series = v->series;
+    const LogEntry **grown;
+    int cap;
+
+    if (v->position > 0 && timestamp != v->previous && validate_group(v) != C_ERR_OK) {
+        return C_ERR_INVALID;
+    }
+    if ((v->checks & VALIDATE_ORDER) && v->position > 0 && timestamp < v->previous) {
+        return validate_fail(v, VALIDATE_ORDER, v->position,
+                             "%s type %d: reading %lld at %d comes after one at %d",
+                             series->room->name, series->type, v->position, timestamp,
+                             v->previous);
+    }
+
+    if (e != NULL && (v->checks & VALIDATE_ROOMS)) {
+        if (e->room != (unsigned int)series->room->seq || e->type != (unsigned int)series->type ||
+            e->timestamp != timestamp) {
+            return validate_fail(v, VALIDATE_ROOMS, v->position,
+                                 "%s type %d: reading %lld at %d points to an entry of room id "
+                                 "%u type %u at %d", series->room->name, series->type,
+                                 v->position, timestamp, (unsigned int)e->room,
+                                 (unsigned int)e->type, e->timestamp);
+        }
+        if (v->group_size == v->group_cap) {
+            cap = (v->group_cap > 0) ? v->group_cap * 2 : 16;
+            grown = realloc(v->group, (size_t)cap * sizeof(LogEntry *));
+            if (grown == NULL) {
+                return C_ERR_NO_MEMORY;
+            }
+            v->group = grown;
+            v->group_cap = cap;
+        }
+        v->group[v->group_size++] = e;
+        v->referenced++;
+    }
+
+    v->previous = timestamp;
+    v->position++;
+    return C_ERR_OK;
+}
+
+/* ---- validate_series -------------------------------------------------------
+   Purpose: Check every reading of one series (see validate_reading) and
+            that there are as many as the series counts. Plain column
+            series are read straight from the columns; the others go through
+            a SeriesReader, which decodes the sealed readings and merges in
+            the late ones.
+   Params:
+     - v (in/out): validation in progress
+     - series (in): series to check
+   Returns: C_ERR_OK, C_ERR_INVALID, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int validate_series(Validation *v, const Series *series) {
+    SeriesReader reader;
+    // Readings the series counts, sealed and late ones included
+    long long count = (long long)series->sealed + series->size + series->late.count +
+                      series->run_readings;
+    int result = C_ERR_OK;
+    int i;
+
+    v->series = series;
+    v->position = 0;
+    v->group_size = 0;
+
+    if (series->sealed == 0 && series->num_runs == 0 && series->late.count == 0) {
+        for (i = 0; i < series->size && result == C_ERR_OK; i++) {
+            result = validate_reading(v, series->timestamps[i],
+                                      (series->rows != NULL) ? series->rows[i] : NULL);
+        }
+    }
+    else {
+        series_reader_init(&reader, series, INT_MIN);
+        while (reader.ready && result == C_ERR_OK) {
+            result = validate_reading(v, reader.timestamp, reader.entry);
+            reader_advance(&reader);
+        }
+    }
+
+    if (result == C_ERR_OK) {
+        result = validate_group(v);
+    }
+    if (result == C_ERR_OK && (v->checks & VALIDATE_ROOMS) && v->position != count) {
+        result = validate_fail(v, VALIDATE_ROOMS, -1, "%s type %d: %lld readings found, %lld counted",
+                               series->room->name, series->type, v->position, count);
+    }
+    return result;
+}
+
+/* ---- validate_rooms --------------------------------------------------------
+   Purpose: Check the rooms and the series directory for entries_validate:
+            room names in order with each room's id its position, series
+            ordered by (room id, type) with each one the handle of its
+            room, every handle in the directory, and each room's size the
+            readings of its series.
+   Params:
+     - v (in/out): validation in progress
+     - rc (in): rooms to check
+     - ec (in): collection whose directory to check
+   Returns: C_ERR_OK, C_ERR_INVALID
+----------------------------------------------------------------------------- */
+static int validate_rooms(Validation *v, const RoomCollection *rc, const EntryCollection *ec) {
+    const Room *room;
+    const Series *series;
+    const Series *before = NULL;
+    // Series handles held by the rooms, and readings counted by a room's series
+    int handles = 0;
+    long long count;
+    int i, t;
+
+    for (i = 0; i < rc->size; i++) {
+        room = rc->sorted[i];
+        if ((v->checks & VALIDATE_ORDER) && i > 0 && strcmp(rc->sorted[i - 1]->name, room->name) >= 0) {
+            return validate_fail(v, VALIDATE_ORDER, -1, "room %s is listed after %s",
+                                 room->name, rc->sorted[i - 1]->name);
+        }
+        if (!(v->checks & VALIDATE_ROOMS)) {
+            continue;
+        }
+        if (room->id != i) {
+            return validate_fail(v, VALIDATE_ROOMS, -1, "room %s has id %d at position %d",
+                                 room->name, room->id, i);
+        }
+        if (room->seq < 0 || room->seq >= rc->size || rc->rooms[room->seq] != room) {
+            return validate_fail(v, VALIDATE_ROOMS, -1, "room %s is not at position %d of the rooms",
+                                 room->name, room->seq);
+        }
+        count = 0;
+        for (t = 0; t < NUM_TYPES; t++) {
+            series = room->series[t];
+            if (series != NULL) {
+                handles++;
+                count += (long long)series->sealed + series->size + series->late.count +
+                         series->run_readings;
+            }
+        }
+        if (count != room->size) {
+            return validate_fail(v, VALIDATE_ROOMS, -1, "room %s has size %d but %lld readings",
+                                 room->name, room->size, count);
+        }
+    }
+
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        room = series->room;
+        v->series = series;
+        if ((v->checks & VALIDATE_ROOMS) &&
+            (room->id < 0 || room->id >= rc->size || rc->sorted[room->id] != room ||
+             series->type < TYPE_TEMP || series->type > TYPE_MOTION ||
+             room->series[series->type - 1] != series)) {
+            return validate_fail(v, VALIDATE_ROOMS, -1,
+                                 "series %d (%s type %d) does not belong to its room",
+                                 i, room->name, series->type);
+        }
+        if ((v->checks & VALIDATE_ORDER) && before != NULL &&
+            (before->room->id > room->id ||
+             (before->room->id == room->id && before->type >= series->type))) {
+            return validate_fail(v, VALIDATE_ORDER, -1,
+                                 "series %d (%s type %d) is listed after %s type %d",
+                                 i, room->name, series->type, before->room->name, before->type);
+        }
+        before = series;
+    }
+    v->series = NULL;
+
+    if ((v->checks & VALIDATE_ROOMS) && handles != ec->num_series) {
+        return validate_fail(v, VALIDATE_ROOMS, -1, "rooms hold %d series, the directory %d",
+                             handles, ec->num_series);
+    }
+    return C_ERR_OK;
+}
+
+/* ---- entries_validate ------------------------------------------------------
+   Purpose: Check the collections in one O(n) pass and report the first
+            violation. With VALIDATE_ORDER: room names, the series
+            directory and each series' readings (sealed, column and late)
+            are in room -> type -> timestamp order, which is the global
+            order. With VALIDATE_ROOMS: each room's id is its name
+            position and its size the readings of its series, each series
+            is the handle of its room, every stored entry points back to
+            the room and type of the series holding it with the timestamp
+            it is kept under, no entry is referenced twice, and the stored
+            entries referenced are the slots in use, so each one is in
+            exactly one room. Nothing is changed; the only memory used is
+            for a group of readings with equal timestamps.
+   Params:
+     - rc (in): rooms
+     - ec (in): entries
+     - checks (in): VALIDATE_ORDER, VALIDATE_ROOMS or VALIDATE_ALL
+     - report (out): the first violation (check is 0 if there is none)
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID (see report),
+            C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+int entries_validate(const RoomCollection *rc, const EntryCollection *ec, int checks,
+                     ValidateReport *report) {
+    Validation v;
+    // Readings in every series
+    long long total = 0;
+    int result;
+    int i;
+
+    if (rc == NULL || ec == NULL || report == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->room = -1;
+    report->position = -1;
+    memset(&v, 0, sizeof(v));
+    v.checks = checks;
+    v.report = report;
+
+    result = validate_rooms(&v, rc, ec);
+    for (i = 0; i < ec->num_series && result == C_ERR_OK; i++) {
+        result = validate_series(&v, ec->series[i]);
+        total += v.position;
+    }
+    v.series = NULL;
+
+    if (result == C_ERR_OK && (checks & VALIDATE_ROOMS) && total != ec->size) {
+        result = validate_fail(&v, VALIDATE_ROOMS, -1, "%lld readings in the series, size %d",
+                               total, ec->size);
+    }
+    if (result == C_ERR_OK && (checks & VALIDATE_ROOMS) && v.referenced != ec->slots) {
+        result = validate_fail(&v, VALIDATE_ROOMS, -1,
+                               "%lld stored entries referenced, %d slots in use",
+                               v.referenced, ec->slots);
+    }
+
+    free(v.group);
+    return result;
+}
+
+/* ---- loader_import ---------------------------------------------------------
+   Purpose: Replace the contents of the collections with the data produced by
+            load_sample in the loader's fixed-size layout.
+   Params:
+     - rc (in/out): room collection to fill
+     - ec (in/out): entry collection to fill
+     - lrc (in): rooms as written by load_sample
+     - lec (in): entries as written by load_sample
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, or the first error from rooms_add/entries_create
+----------------------------------------------------------------------------- */
+int loader_import(RoomCollection *rc, EntryCollection *ec,
+                  const LoaderRoomCollection *lrc, const LoaderEntryCollection *lec) {
+    // Loop counter
+    int i;
+    // Result of each add/create call
+    int result;
+    // Room that the current entry belongs to
+    Room *room;
+    const LoaderEntry *le;
+
+    if (rc == NULL || ec == NULL || lrc == NULL || lec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    // Entries point at rooms, so drop them first
+    entries_clear(ec);
+    rooms_clear(rc);
+
+    for (i = 0; i < lrc->size; i++) {
+        result = rooms_add(rc, lrc->rooms[i].name);
+        if (result != C_ERR_OK) {
+            return result;
+        }
+    }
+
+    for (i = 0; i < lec->size; i++) {
+        le = &lec->entries[i];
+        if (le->room == NULL) {
+            return C_ERR_INVALID;
+        }
+
+        room = rooms_find(rc, le->room->name);
+        if (room == NULL) {
+            return C_ERR_NOT_FOUND;
+        }
+
+        result = entries_create(ec, room, le->data.type, le->data.value, le->timestamp);
+        if (result != C_ERR_OK) {
+            return result;
+        }
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- loader_export ---------------------------------------------------------
+   Purpose: Build a copy of the collections in the loader's fixed-size layout
+            so that loader_test_order and loader_test_rooms can check them.
+            Each room's pointers are added in global order, which is also the
+            room's own sorted order.
+   Params:
+     - rc (in): room collection to copy
+     - ec (in): entry collection to copy
+     - lrc (out): fixed-size rooms
+     - lec (out): fixed-size entries
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_FULL_ARRAY if the data does not fit
+            in MAX_ARR, C_ERR_INVALID if an entry's room is not in rc
+----------------------------------------------------------------------------- */
+int loader_export(const RoomCollection *rc, const EntryCollection *ec,
+                  LoaderRoomCollection *lrc, LoaderEntryCollection *lec) {
+    // Loop counter
+    int i;
+    // The current entry's room
+    const Room *room;
+    const LogEntry *e;
+    LoaderRoom *lroom;
+    EntryCursor cursor;
+
+    if (rc == NULL || ec == NULL || lrc == NULL || lec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (rc->size > MAX_ARR || ec->size > MAX_ARR) {
+        return C_ERR_FULL_ARRAY;
+    }
+
+    for (i = 0; i < rc->size; i++) {
+        memcpy(lrc->rooms[i].name, rc->rooms[i]->name, MAX_STR);
+        lrc->rooms[i].size = 0;
+    }
+    lrc->size = rc->size;
+
+    entries_cursor_init(&cursor, ec);
+    for (i = 0; i < ec->size; i++) {
+        e = entries_cursor_next(&cursor);
+        room = entry_room(rc, e);
+        if (room == NULL) {
+            return C_ERR_INVALID;
+        }
+
+        // Loader rooms are in rc->rooms order, which is the room's seq
+        lroom = &lrc->rooms[room->seq];
+        lec->entries[i].data.type = e->type;
+        lec->entries[i].data.value = e->value;
+        lec->entries[i].room = lroom;
+        lec->entries[i].timestamp = e->timestamp;
+        lroom->entries[lroom->size++] = &lec->entries[i];
+    }
+    lec->size = ec->size;
+
+    return C_ERR_OK;
+}
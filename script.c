@@ -0,0 +1,618 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include "defs.h"
+
+#define SCRIPT_MAX_FIELDS  8
+
+/* State shared by the commands of one script */
+typedef struct {
+    const char      *name;     /* script name for error messages */
+    int              line;     /* current line number */
+    int              failed;   /* commands that failed so far */
+    WriteAheadLog   *wal;
+    RoomCollection  *rc;
+    EntryCollection *ec;
+} Script;
+
+typedef void (*ScriptCommand)(Script *script, char *args);
+
+// Helper function declarations
+static void script_error(Script *script, const char *format, ...);
+static int split_fields(char *args, char **fields, int max);
+static int field_int(const char *field, int *out);
+static Room* field_room(Script *script, const char *field);
+static int field_type(Script *script, const char *field);
+static int write_range_reading(const Room *room, int type, int timestamp,
+                               ReadingValue value, void *ctx);
+static int write_bucket(const Room *room, int type, const Aggregate *bucket, void *ctx);
+static void cmd_add_room(Script *script, char *args);
+static void cmd_add_entry(Script *script, char *args);
+static void cmd_query(Script *script, char *args);
+static void cmd_aggregate(Script *script, char *args);
+static void cmd_rolling(Script *script, char *args);
+static void cmd_motion(Script *script, char *args);
+static void cmd_export(Script *script, char *args);
+static void cmd_import(Script *script, char *args);
+static void cmd_save(Script *script, char *args);
+static void cmd_open(Script *script, char *args);
+static void cmd_stats(Script *script, char *args);
+static void cmd_compress(Script *script, char *args);
+static void cmd_retention(Script *script, char *args);
+static void cmd_validate(Script *script, char *args);
+static void cmd_profile(Script *script, char *args);
+static void cmd_latency(Script *script, char *args);
+
+static const char *type_names[NUM_TYPES + 1] = { "", "TEMP", "DB", "MOTION" };
+
+/* Command words and the functions that run them */
+static const struct {
+    const char   *word;
+    ScriptCommand run;
+} commands[] = {
+    { "add-room",  cmd_add_room },
+    { "add-entry", cmd_add_entry },
+    { "query",     cmd_query },
+    { "aggregate", cmd_aggregate },
+    { "rolling",   cmd_rolling },
+    { "motion",    cmd_motion },
+    { "export",    cmd_export },
+    { "import",    cmd_import },
+    { "save",      cmd_save },
+    { "open",      cmd_open },
+    { "stats",     cmd_stats },
+    { "compress",  cmd_compress },
+    { "retention", cmd_retention },
+    { "validate",  cmd_validate },
+    { "profile",   cmd_profile },
+    { "latency",   cmd_latency },
+};
+
+/* ---- script_error ----------------------------------------------------------
+   Purpose: Report a failed command on stderr as name:line: message and
+            count it.
+----------------------------------------------------------------------------- */
+static void script_error(Script *script, const char *format, ...) {
+    va_list args;
+
+    fprintf(stderr, "%s:%d: ", script->name, script->line);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    script->failed++;
+}
+
+/* ---- split_fields ----------------------------------------------------------
+   Purpose: Split comma-separated arguments in place.
+   Params:
+     - args (in/out): argument string, commas are replaced by '\0'
+     - fields (out): start of each field
+     - max (in): size of fields
+   Returns: number of fields (an empty string has none), or max + 1 if there
+            are more than max
+----------------------------------------------------------------------------- */
+static int split_fields(char *args, char **fields, int max) {
+    int count = 0;
+    char *comma;
+
+    if (*args == '\0') {
+        return 0;
+    }
+
+    while (count < max) {
+        fields[count++] = args;
+        comma = strchr(args, ',');
+        if (comma == NULL) {
+            return count;
+        }
+        *comma = '\0';
+        args = comma + 1;
+    }
+
+    return max + 1;
+}
+
+/* ---- field_int -------------------------------------------------------------
+   Purpose: Parse a whole field as a decimal int.
+   Returns: C_ERR_OK, C_ERR_INVALID
+----------------------------------------------------------------------------- */
+static int field_int(const char *field, int *out) {
+    char *end;
+    long value;
+
+    errno = 0;
+    value = strtol(field, &end, 10);
+    if (end == field || *end != '\0' || errno != 0 || value < INT_MIN || value > INT_MAX) {
+        return C_ERR_INVALID;
+    }
+
+    *out = (int)value;
+    return C_ERR_OK;
+}
+
+/* ---- field_room / field_type -----------------------------------------------
+   Purpose: Look up a room or parse a type argument, reporting an error if
+            that fails.
+   Returns: the room (NULL on error) / the type (C_ERR_INVALID on error)
+----------------------------------------------------------------------------- */
+static Room* field_room(Script *script, const char *field) {
+    Room *room = rooms_find(script->rc, field);
+
+    if (room == NULL) {
+        script_error(script, "room '%s' not found", field);
+    }
+    return room;
+}
+
+static int field_type(Script *script, const char *field) {
+    int type = csv_parse_type(field);
+
+    if (type == C_ERR_INVALID) {
+        script_error(script, "invalid type '%s'", field);
+    }
+    return type;
+}
+
+/* ---- write_range_reading ---------------------------------------------------
+   Purpose: RangeCallback that writes each reading as a CSV line.
+   Returns: 0 to keep the query going
+----------------------------------------------------------------------------- */
+static int write_range_reading(const Room *room, int type, int timestamp,
+                               ReadingValue value, void *ctx) {
+    (void)ctx;
+    csv_write_reading(stdout, room->name, timestamp, type, value);
+    return 0;
+}
+
+/* ---- write_bucket ----------------------------------------------------------
+   Purpose: AggregateCallback that writes room,start,count,min,max,mean.
+   Returns: 0 to keep the pass going
+----------------------------------------------------------------------------- */
+static int write_bucket(const Room *room, int type, const Aggregate *bucket, void *ctx) {
+    (void)type;
+    (void)ctx;
+    printf("%s,%lld,%d,%.6g,%.6g,%.6g\n", room->name, bucket->start, bucket->count,
+           bucket->min, bucket->max, bucket->mean);
+    return 0;
+}
+
+/* ---- cmd_add_room ----------------------------------------------------------
+   Purpose: add-room NAME (the rest of the line, commas included)
+----------------------------------------------------------------------------- */
+static void cmd_add_room(Script *script, char *args) {
+    int result;
+
+    if (*args == '\0' || strlen(args) >= MAX_STR) {
+        script_error(script, "room name must be 1 to %d characters", MAX_STR - 1);
+        return;
+    }
+
+    result = wal_rooms_add(script->wal, script->rc, args);
+    if (result == C_ERR_DUPLICATE) {
+        script_error(script, "room '%s' already exists", args);
+    }
+    else if (result == C_ERR_NO_MEMORY) {
+        script_error(script, "out of memory");
+    }
+    else if (result != C_ERR_OK) {
+        script_error(script, "cannot log room '%s'", args);
+    }
+}
+
+/* ---- cmd_add_entry ---------------------------------------------------------
+   Purpose: add-entry ROOM,TIMESTAMP,TYPE,VALUE (a CSV import line)
+----------------------------------------------------------------------------- */
+static void cmd_add_entry(Script *script, char *args) {
+    SensorReading reading;
+    Room *room;
+    int result;
+
+    if (csv_parse_line(args, args + strlen(args), &reading) != C_ERR_OK) {
+        script_error(script, "expected room,timestamp,type,value");
+        return;
+    }
+
+    room = field_room(script, reading.room_name);
+    if (room == NULL) {
+        return;
+    }
+
+    result = wal_entries_create(script->wal, script->ec, room, reading.data.type,
+                                reading.data.value, reading.timestamp);
+    if (result == C_ERR_NO_MEMORY) {
+        script_error(script, "out of memory");
+    }
+    else if (result != C_ERR_OK) {
+        script_error(script, "cannot log entry");
+    }
+}
+
+/* ---- cmd_query -------------------------------------------------------------
+   Purpose: query ROOM,TYPE,FROM,TO - write the readings in range as CSV lines
+----------------------------------------------------------------------------- */
+static void cmd_query(Script *script, char *args) {
+    char *fields[SCRIPT_MAX_FIELDS];
+    Room *room;
+    int type, t_from, t_to;
+
+    if (split_fields(args, fields, SCRIPT_MAX_FIELDS) != 4 ||
+        field_int(fields[2], &t_from) != C_ERR_OK || field_int(fields[3], &t_to) != C_ERR_OK) {
+        script_error(script, "expected room,type,from,to");
+        return;
+    }
+
+    room = field_room(script, fields[0]);
+    type = field_type(script, fields[1]);
+    if (room != NULL && type != C_ERR_INVALID) {
+        room_query_range(room, type, t_from, t_to, write_range_reading, NULL);
+    }
+}
+
+/* ---- cmd_aggregate ---------------------------------------------------------
+   Purpose: aggregate TYPE,WIDTH,FROM,TO - one line per non-empty bucket of
+            every room, in room name order
+----------------------------------------------------------------------------- */
+static void cmd_aggregate(Script *script, char *args) {
+    char *fields[SCRIPT_MAX_FIELDS];
+    int type, width, t_from, t_to, i;
+
+    if (split_fields(args, fields, SCRIPT_MAX_FIELDS) != 4 ||
+        field_int(fields[1], &width) != C_ERR_OK || width <= 0 ||
+        field_int(fields[2], &t_from) != C_ERR_OK || field_int(fields[3], &t_to) != C_ERR_OK) {
+        script_error(script, "expected type,width,from,to with a positive width");
+        return;
+    }
+
+    type = field_type(script, fields[0]);
+    for (i = 0; type != C_ERR_INVALID && i < script->rc->size; i++) {
+        room_aggregate(script->rc->sorted[i], type, t_from, t_to, width, write_bucket, NULL);
+    }
+}
+
+/* ---- cmd_rolling -----------------------------------------------------------
+   Purpose: rolling ROOM,TYPE[,WINDOW] - (re)configure when a positive window
+            is given, then write room,type,start,count,min,max,mean,sum
+----------------------------------------------------------------------------- */
+static void cmd_rolling(Script *script, char *args) {
+    char *fields[SCRIPT_MAX_FIELDS];
+    Aggregate stats;
+    Room *room;
+    int count, type, result;
+    int window = 0;
+
+    count = split_fields(args, fields, SCRIPT_MAX_FIELDS);
+    if ((count != 2 && count != 3) || (count == 3 && field_int(fields[2], &window) != C_ERR_OK)) {
+        script_error(script, "expected room,type[,window]");
+        return;
+    }
+
+    room = field_room(script, fields[0]);
+    type = field_type(script, fields[1]);
+    if (room == NULL || type == C_ERR_INVALID) {
+        return;
+    }
+
+    result = (window > 0) ? room_rolling_configure(room, type, window) : C_ERR_OK;
+    if (result == C_ERR_INVALID) {
+        script_error(script, "window reaches compressed readings");
+        return;
+    }
+    if (result != C_ERR_OK) {
+        script_error(script, "out of memory");
+        return;
+    }
+
+    result = room_rolling(room, type, &stats);
+    if (result == C_ERR_NOT_FOUND) {
+        script_error(script, "rolling statistics are off for '%s' %s", room->name, type_names[type]);
+    }
+    else if (stats.count == 0) {
+        printf("%s,%s,,0,,,,\n", room->name, type_names[type]);
+    }
+    else {
+        printf("%s,%s,%lld,%d,%.6g,%.6g,%.6g,%.6g\n", room->name, type_names[type], stats.start,
+               stats.count, stats.min, stats.max, stats.mean, stats.sum);
+    }
+}
+
+/* ---- cmd_motion ------------------------------------------------------------
+   Purpose: motion ROOM,FROM,TO - write room,readings,any,left,forward,right
+----------------------------------------------------------------------------- */
+static void cmd_motion(Script *script, char *args) {
+    char *fields[SCRIPT_MAX_FIELDS];
+    MotionSummary summary;
+    Room *room;
+    int t_from, t_to;
+
+    if (split_fields(args, fields, SCRIPT_MAX_FIELDS) != 3 ||
+        field_int(fields[1], &t_from) != C_ERR_OK || field_int(fields[2], &t_to) != C_ERR_OK) {
+        script_error(script, "expected room,from,to");
+        return;
+    }
+
+    room = field_room(script, fields[0]);
+    if (room != NULL) {
+        if (room_motion_summary(room, t_from, t_to, &summary) != C_ERR_OK) {
+            script_error(script, "out of memory");
+            return;
+        }
+        printf("%s,%d,%d,%d,%d,%d\n", room->name, summary.readings, summary.any,
+               summary.left, summary.forward, summary.right);
+    }
+}
+
+/* ---- cmd_export ------------------------------------------------------------
+   Purpose: export [PATH] - write every entry as CSV to PATH, or to stdout
+----------------------------------------------------------------------------- */
+static void cmd_export(Script *script, char *args) {
+    FILE *fp = stdout;
+    int result;
+
+    if (*args != '\0') {
+        fp = fopen(args, "w");
+        if (fp == NULL) {
+            script_error(script, "cannot write '%s'", args);
+            return;
+        }
+    }
+
+    result = csv_export(script->ec, fp);
+    if (fp != stdout && fclose(fp) != 0) {
+        result = C_ERR_IO;
+    }
+    if (result < 0) {
+        script_error(script, "export failed");
+    }
+}
+
+/* ---- cmd_import ------------------------------------------------------------
+   Purpose: import PATH - bulk-load a CSV file
+----------------------------------------------------------------------------- */
+static void cmd_import(Script *script, char *args) {
+    CsvImport import;
+    int result;
+
+    memset(&import, 0, sizeof(import));
+    import.wal = script->wal;
+    import.rc = script->rc;
+    import.ec = script->ec;
+    result = csv_import(&import, (*args != '\0') ? args : CSV_DEFAULT_PATH);
+
+    if (result != C_ERR_OK) {
+        script_error(script, "import stopped after %ld reading(s)", import.imported);
+    }
+    else if (import.rejected > 0) {
+        fprintf(stderr, "%s:%d: skipped %ld line(s) that did not parse, the first at line %ld\n",
+                script->name, script->line, import.rejected, import.first_rejected);
+    }
+}
+
+/* ---- cmd_save / cmd_open -----------------------------------------------------
+   Purpose: save [PATH] / open [PATH] - write or map a snapshot and restart
+            the log from it
+----------------------------------------------------------------------------- */
+static void cmd_save(Script *script, char *args) {
+    const char *path = (*args != '\0') ? args : SNAPSHOT_DEFAULT_PATH;
+
+    if (snapshot_save(path, script->rc, script->ec) != C_ERR_OK) {
+        script_error(script, "cannot write snapshot '%s'", path);
+    }
+    else if (script->wal != NULL && wal_checkpoint(script->wal, path) != C_ERR_OK) {
+        script_error(script, "cannot restart the log from '%s'", path);
+    }
+}
+
+static void cmd_open(Script *script, char *args) {
+    const char *path = (*args != '\0') ? args : SNAPSHOT_DEFAULT_PATH;
+
+    if (snapshot_open(path, script->rc, script->ec) != C_ERR_OK) {
+        script_error(script, "cannot open snapshot '%s'; the collections are unchanged", path);
+    }
+    else if (script->wal != NULL && wal_checkpoint(script->wal, path) != C_ERR_OK) {
+        script_error(script, "cannot restart the log from '%s'", path);
+    }
+}
+
+/* ---- cmd_stats -------------------------------------------------------------
+   Purpose: stats - write the ingest counters as name,value lines
+----------------------------------------------------------------------------- */
+static void cmd_stats(Script *script, char *args) {
+    const EntryCollection *ec = script->ec;
+
+    (void)args;
+    printf("rooms,%d\n", script->rc->size);
+    printf("entries,%d\n", ec->size);
+    printf("series,%d\n", ec->num_series);
+    printf("fast_appends,%lu\n", ec->fast_appends);
+    printf("slow_inserts,%lu\n", ec->slow_inserts);
+    printf("comparisons,%lu\n", ec->comparisons);
+    printf("memory_bytes,%zu\n", entries_memory(ec));
+    printf("partitions,%d\n", ec->num_partitions);
+}
+
+/* ---- cmd_compress ----------------------------------------------------------
+   Purpose: compress - seal the history of every series, then write
+            sealed,count and memory_bytes,before,after
+----------------------------------------------------------------------------- */
+static void cmd_compress(Script *script, char *args) {
+    size_t before = entries_memory(script->ec);
+    int sealed;
+
+    (void)args;
+    sealed = entries_compress(script->ec);
+    if (sealed < 0) {
+        script_error(script, "out of memory");
+        return;
+    }
+    printf("sealed,%d\n", sealed);
+    printf("memory_bytes,%zu,%zu\n", before, entries_memory(script->ec));
+}
+
+/* ---- cmd_retention ---------------------------------------------------------
+   Purpose: retention TIMESTAMP - drop every time partition that ends at or
+            before TIMESTAMP, then write dropped,count
+----------------------------------------------------------------------------- */
+static void cmd_retention(Script *script, char *args) {
+    int timestamp;
+    int dropped;
+
+    if (field_int(args, &timestamp) != C_ERR_OK) {
+        script_error(script, "expected timestamp");
+        return;
+    }
+
+    dropped = wal_retention_drop_before(script->wal, script->ec, timestamp);
+    if (dropped == C_ERR_NO_MEMORY) {
+        script_error(script, "out of memory");
+        return;
+    }
+    if (dropped < 0) {
+        script_error(script, "cannot log retention");
+        return;
+    }
+    printf("dropped,%d\n", dropped);
+}
+
+/* ---- cmd_validate ----------------------------------------------------------
+   Purpose: validate - check the order and the room-entry links of the
+            collections (see entries_validate), then write validate,ok
+----------------------------------------------------------------------------- */
+static void cmd_validate(Script *script, char *args) {
+    ValidateReport report;
+    int result;
+
+    (void)args;
+    result = entries_validate(script->rc, script->ec, VALIDATE_ALL, &report);
+    if (result == C_ERR_NO_MEMORY) {
+        script_error(script, "out of memory");
+        return;
+    }
+    if (result != C_ERR_OK) {
+        script_error(script, "invalid: %s", report.message);
+        return;
+    }
+    printf("validate,ok\n");
+}
+
+/* ---- cmd_profile -----------------------------------------------------------
+   Purpose: profile [reset] - write the ingest probes' counters as CSV (see
+            profile_dump), or set them back to zero
+----------------------------------------------------------------------------- */
+static void cmd_profile(Script *script, char *args) {
+    ProfileCounter counters[PROFILE_POINTS];
+
+    if (!profile_read(counters)) {
+        script_error(script, "profiling is off in this build (-DSENSOR_PROFILE)");
+        return;
+    }
+    if (strcmp(args, "reset") == 0) {
+        profile_reset();
+        return;
+    }
+    if (*args != '\0') {
+        script_error(script, "usage: profile [reset]");
+        return;
+    }
+    profile_dump(stdout);
+}
+
+/* ---- cmd_latency -----------------------------------------------------------
+   Purpose: latency [buckets|reset] - write the latency percentiles as CSV,
+            or the non-empty buckets (see latency_dump), or empty the
+            histograms
+----------------------------------------------------------------------------- */
+static void cmd_latency(Script *script, char *args) {
+    ProfileCounter counters[PROFILE_POINTS];
+
+    if (!profile_read(counters)) {
+        script_error(script, "profiling is off in this build (-DSENSOR_PROFILE)");
+        return;
+    }
+    if (strcmp(args, "reset") == 0) {
+        latency_reset();
+    }
+    else if (strcmp(args, "buckets") == 0) {
+        latency_dump(stdout, 1);
+    }
+    else if (*args == '\0') {
+        latency_dump(stdout, 0);
+    }
+    else {
+        script_error(script, "usage: latency [buckets|reset]");
+    }
+}
+
+/* ---- script_run ------------------------------------------------------------
+   Purpose: Run every command of a script. Each line is a command word and
+            its arguments, separated by one space; blank lines and lines
+            starting with '#' are skipped. A failed command is reported and
+            the script goes on.
+   Params:
+     - in (in): script to read
+     - name (in): script name for error messages
+     - wal (in/out): log for changes, or NULL
+     - rc, ec (in/out): collections the commands work on
+   Returns: number of failed commands, or C_ERR_NULL_PTR
+----------------------------------------------------------------------------- */
+int script_run(FILE *in, const char *name, WriteAheadLog *wal,
+               RoomCollection *rc, EntryCollection *ec) {
+    char line[SCRIPT_MAX_LINE];
+    Script script;
+    char *args;
+    size_t length;
+    int i, c;
+    const int num_commands = (int)(sizeof(commands) / sizeof(commands[0]));
+
+    if (in == NULL || name == NULL || rc == NULL || ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    script.name = name;
+    script.line = 0;
+    script.failed = 0;
+    script.wal = wal;
+    script.rc = rc;
+    script.ec = ec;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        script.line++;
+        length = strlen(line);
+
+        if (length == sizeof(line) - 1 && line[length - 1] != '\n') {
+            // Too long: report it and drop the rest of the line
+            script_error(&script, "line longer than %d characters", SCRIPT_MAX_LINE - 2);
+            while ((c = fgetc(in)) != EOF && c != '\n');
+            continue;
+        }
+
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+
+        // Split off the command word
+        args = strchr(line, ' ');
+        if (args != NULL) {
+            *args++ = '\0';
+        }
+        else {
+            args = line + length;
+        }
+
+        for (i = 0; i < num_commands && strcmp(line, commands[i].word) != 0; i++);
+        if (i == num_commands) {
+            script_error(&script, "unknown command '%s'", line);
+            continue;
+        }
+        commands[i].run(&script, args);
+
+        if (wal != NULL) {
+            wal_poll(wal);
+        }
+    }
+
+    return script.failed;
+}
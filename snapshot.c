@@ -0,0 +1,464 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "defs.h"
+
+#define SNAPSHOT_MAGIC      "SSNP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_ALIGN      8
+
+/* On-disk header, at offset 0 */
+typedef struct {
+    char               magic[4];
+    unsigned int       version;
+    unsigned int       byte_order;      /* SNAPSHOT_BYTE_ORDER as the writer stored it */
+    unsigned int       room_count;
+    unsigned int       series_count;
+    unsigned int       reserved;
+    unsigned long long entry_count;
+    unsigned long long file_size;
+    unsigned long long rooms_offset;    /* room_count SnapshotRoom records */
+    unsigned long long series_offset;   /* series_count SnapshotSeries records */
+} SnapshotHeader;
+
+typedef struct {
+    char name[MAX_STR];
+} SnapshotRoom;
+
+typedef struct {
+    unsigned int       room;            /* index into the room table */
+    unsigned int       type;
+    unsigned int       size;
+    unsigned int       reserved;
+    unsigned long long timestamps_offset;
+    unsigned long long values_offset;
+} SnapshotSeries;
+
+// Helper function declarations
+static unsigned long long align_up(unsigned long long offset);
+static unsigned long long value_bytes(int type, unsigned long long count);
+static int write_padding(FILE *fp, unsigned long long *offset);
+static unsigned long long series_readings(const Series *series);
+static int write_columns(FILE *fp, const Series *series, unsigned long long *offset);
+static int write_snapshot(FILE *fp, const RoomCollection *rc, const EntryCollection *ec);
+static int column_in_file(unsigned long long offset, unsigned long long bytes,
+                          size_t alignment, unsigned long long file_size);
+static int map_contents(const unsigned char *base, const SnapshotHeader *header,
+                        RoomCollection *rc, EntryCollection *ec);
+static int load_snapshot(const char *path, RoomCollection *rc, EntryCollection *ec);
+
+/* ---- align_up --------------------------------------------------------------
+   Purpose: Round a file offset up to the next SNAPSHOT_ALIGN boundary.
+----------------------------------------------------------------------------- */
+static unsigned long long align_up(unsigned long long offset) {
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+/* ---- value_bytes -----------------------------------------------------------
+   Purpose: Bytes in a value column of the given type holding count readings.
+----------------------------------------------------------------------------- */
+static unsigned long long value_bytes(int type, unsigned long long count) {
+    if (type == TYPE_TEMP) {
+        return count * sizeof(float);
+    }
+    if (type == TYPE_DB) {
+        return count * sizeof(int);
+    }
+    return MOTION_WORDS(count) * sizeof(unsigned long long);
+}
+
+/* ---- write_padding ---------------------------------------------------------
+   Purpose: Write zero bytes up to the next aligned offset.
+   Params:
+     - fp (in/out): file being written
+     - offset (in/out): current offset, advanced to the aligned one
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int write_padding(FILE *fp, unsigned long long *offset) {
+    static const unsigned char zeros[SNAPSHOT_ALIGN];
+    unsigned long long aligned = align_up(*offset);
+
+    if (aligned > *offset && fwrite(zeros, 1, (size_t)(aligned - *offset), fp) != aligned - *offset) {
+        return C_ERR_IO;
+    }
+    *offset = aligned;
+    return C_ERR_OK;
+}
+
+/* ---- series_readings -------------------------------------------------------
+   Purpose: Number of readings a series is saved with: sealed, in the
+            columns and late.
+   Params:
+     - series (in): series to count
+   Returns: number of readings
+----------------------------------------------------------------------------- */
+static unsigned long long series_readings(const Series *series) {
+    return (unsigned long long)series->sealed + (unsigned long long)series->size +
+           (unsigned long long)series->late.count + (unsigned long long)series->run_readings;
+}
+
+/* ---- write_columns ---------------------------------------------------------
+   Purpose: Write the timestamp and value columns of one series, each from
+            an aligned offset. Sealed and late readings, and motion bits
+            left past an offset by retention, are decoded into temporary
+            columns first (see series_decode), so the file always holds
+            plain columns in order and the series is not changed.
+   Params:
+     - fp (in/out): file being written
+     - series (in): series to write
+     - offset (in/out): current offset, advanced past the value column
+   Returns: C_ERR_OK, C_ERR_IO, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int write_columns(FILE *fp, const Series *series, unsigned long long *offset) {
+    // Readings and the columns they are written from
+    size_t size = (size_t)series_readings(series);
+    unsigned long long bytes = value_bytes(series->type, size);
+    const int *timestamps = series->timestamps;
+    const void *values = series->values.raw;
+    int *decoded_timestamps = NULL;
+    void *decoded_values = NULL;
+    int result = C_ERR_OK;
+
+    if ((size_t)series->size < size || (series->type == TYPE_MOTION && series->offset > 0)) {
+        decoded_timestamps = malloc(size * sizeof(int));
+        decoded_values = malloc((size_t)bytes);
+        if (decoded_timestamps == NULL || decoded_values == NULL) {
+            free(decoded_timestamps);
+            free(decoded_values);
+            return C_ERR_NO_MEMORY;
+        }
+        series_decode(series, decoded_timestamps, decoded_values, 1);
+        timestamps = decoded_timestamps;
+        values = decoded_values;
+    }
+
+    if (write_padding(fp, offset) != C_ERR_OK ||
+        fwrite(timestamps, sizeof(int), size, fp) != size) {
+        result = C_ERR_IO;
+    }
+    *offset += size * sizeof(int);
+
+    if (result == C_ERR_OK &&
+        (write_padding(fp, offset) != C_ERR_OK || fwrite(values, 1, (size_t)bytes, fp) != bytes)) {
+        result = C_ERR_IO;
+    }
+    *offset += bytes;
+
+    free(decoded_timestamps);
+    free(decoded_values);
+    return result;
+}
+
+/* ---- write_snapshot --------------------------------------------------------
+   Purpose: Write the header, room table, series table and columns. The
+            layout is computed first, so the tables can be written before
+            the columns they point to.
+   Params:
+     - fp (in/out): empty file opened for writing
+     - rc (in): rooms to write
+     - ec (in): series to write
+   Returns: C_ERR_OK, C_ERR_IO, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int write_snapshot(FILE *fp, const RoomCollection *rc, const EntryCollection *ec) {
+    SnapshotHeader header;
+    SnapshotRoom room;
+    SnapshotSeries record;
+    const Series *series;
+    // Offset the next column will start at
+    unsigned long long offset;
+    // Readings of the series being laid out, sealed ones included
+    unsigned long long size;
+    int result;
+    // Series with readings; a failed first insert can leave an empty one
+    int written = 0;
+    int i;
+
+    for (i = 0; i < ec->num_series; i++) {
+        written += (series_readings(ec->series[i]) > 0);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.room_count = (unsigned int)rc->size;
+    header.series_count = (unsigned int)written;
+    header.entry_count = (unsigned long long)ec->size;
+    header.rooms_offset = align_up(sizeof(header));
+    header.series_offset = align_up(header.rooms_offset + (unsigned long long)rc->size * sizeof(room));
+
+    // The file ends after the last column
+    offset = header.series_offset + (unsigned long long)written * sizeof(record);
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        size = series_readings(series);
+        if (size == 0) {
+            continue;
+        }
+        offset = align_up(offset) + size * sizeof(int);
+        offset = align_up(offset) + value_bytes(series->type, size);
+    }
+    header.file_size = offset;
+
+    offset = 0;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        return C_ERR_IO;
+    }
+    offset += sizeof(header);
+
+    if (write_padding(fp, &offset) != C_ERR_OK) {
+        return C_ERR_IO;
+    }
+    for (i = 0; i < rc->size; i++) {
+        memset(&room, 0, sizeof(room));
+        strcpy(room.name, rc->rooms[i]->name);
+        if (fwrite(&room, sizeof(room), 1, fp) != 1) {
+            return C_ERR_IO;
+        }
+    }
+    offset += (unsigned long long)rc->size * sizeof(room);
+
+    // Series records, with the column offsets laid out as above
+    if (write_padding(fp, &offset) != C_ERR_OK) {
+        return C_ERR_IO;
+    }
+    offset += (unsigned long long)written * sizeof(record);
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        size = series_readings(series);
+        if (size == 0) {
+            continue;
+        }
+        memset(&record, 0, sizeof(record));
+        record.room = (unsigned int)series->room->seq;
+        record.type = (unsigned int)series->type;
+        record.size = (unsigned int)size;
+        record.timestamps_offset = align_up(offset);
+        offset = record.timestamps_offset + size * sizeof(int);
+        record.values_offset = align_up(offset);
+        offset = record.values_offset + value_bytes(series->type, size);
+        if (fwrite(&record, sizeof(record), 1, fp) != 1) {
+            return C_ERR_IO;
+        }
+    }
+
+    // Columns
+    offset = header.series_offset + (unsigned long long)written * sizeof(record);
+    for (i = 0; i < ec->num_series; i++) {
+        series = ec->series[i];
+        if (series_readings(series) == 0) {
+            continue;
+        }
+        result = write_columns(fp, series, &offset);
+        if (result != C_ERR_OK) {
+            return result;
+        }
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- snapshot_save ---------------------------------------------------------
+   Purpose: Write the collections to a snapshot file. The file is written
+            under a temporary name, synced and then renamed over path, so a
+            crash leaves either the old snapshot or the new one, and a
+            snapshot that is currently open stays valid. Sealed and late
+            readings are decoded into the file's columns as they are
+            written; the collections are not changed.
+   Params:
+     - path (in): file name, shorter than MAX_PATH_STR
+     - rc (in): rooms to save
+     - ec (in): entries to save
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for a path that is too
+            long, C_ERR_IO, C_ERR_NO_MEMORY (decoding sealed or late
+            readings)
+----------------------------------------------------------------------------- */
+int snapshot_save(const char *path, const RoomCollection *rc, const EntryCollection *ec) {
+    char temp_path[MAX_PATH_STR + 4];
+    FILE *fp;
+    int result;
+
+    if (path == NULL || rc == NULL || ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (strlen(path) >= MAX_PATH_STR) {
+        return C_ERR_INVALID;
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    fp = fopen(temp_path, "wb");
+    if (fp == NULL) {
+        return C_ERR_IO;
+    }
+
+    result = write_snapshot(fp, rc, ec);
+    if (result == C_ERR_OK && (fflush(fp) != 0 || fsync(fileno(fp)) != 0)) {
+        result = C_ERR_IO;
+    }
+    if (fclose(fp) != 0) {
+        result = C_ERR_IO;
+    }
+
+    if (result == C_ERR_OK && rename(temp_path, path) != 0) {
+        result = C_ERR_IO;
+    }
+    if (result != C_ERR_OK) {
+        remove(temp_path);
+    }
+    return result;
+}
+
+/* ---- column_in_file --------------------------------------------------------
+   Purpose: Check that a column lies inside the file and is aligned for its
+            element type.
+   Returns: 1 if it does, 0 if not
+----------------------------------------------------------------------------- */
+static int column_in_file(unsigned long long offset, unsigned long long bytes,
+                          size_t alignment, unsigned long long file_size) {
+    return offset % alignment == 0 && offset <= file_size && bytes <= file_size - offset;
+}
+
+/* ---- map_contents ----------------------------------------------------------
+   Purpose: Add the snapshot's rooms to rc and attach its series to ec, in
+            place. Only the tables are checked, not the readings themselves.
+   Params:
+     - base (in): start of the mapping
+     - header (in): header, already checked against the file size
+     - rc, ec (in/out): empty collections to fill
+   Returns: C_ERR_OK, C_ERR_INVALID for a damaged snapshot, C_ERR_NO_MEMORY
+----------------------------------------------------------------------------- */
+static int map_contents(const unsigned char *base, const SnapshotHeader *header,
+                        RoomCollection *rc, EntryCollection *ec) {
+    const SnapshotRoom *rooms = (const SnapshotRoom *)(base + header->rooms_offset);
+    const SnapshotSeries *records = (const SnapshotSeries *)(base + header->series_offset);
+    const SnapshotSeries *record;
+    unsigned int i;
+    int result;
+
+    for (i = 0; i < header->room_count; i++) {
+        if (memchr(rooms[i].name, '\0', MAX_STR) == NULL) {
+            return C_ERR_INVALID;
+        }
+        result = rooms_add(rc, rooms[i].name);
+        if (result != C_ERR_OK) {
+            return (result == C_ERR_NO_MEMORY) ? result : C_ERR_INVALID;
+        }
+    }
+
+    for (i = 0; i < header->series_count; i++) {
+        record = &records[i];
+        if (record->room >= header->room_count || record->size == 0 || record->size > 0x7fffffffu ||
+            record->type < TYPE_TEMP || record->type > TYPE_MOTION ||
+            !column_in_file(record->timestamps_offset, (unsigned long long)record->size * sizeof(int),
+                            sizeof(int), header->file_size) ||
+            !column_in_file(record->values_offset, value_bytes((int)record->type, record->size),
+                            (record->type == TYPE_MOTION) ? sizeof(unsigned long long) : sizeof(int),
+                            header->file_size)) {
+            return C_ERR_INVALID;
+        }
+
+        result = entries_map_series(ec, rc->rooms[record->room], (int)record->type,
+                                    (const int *)(base + record->timestamps_offset),
+                                    base + record->values_offset, (int)record->size);
+        if (result != C_ERR_OK) {
+            return (result == C_ERR_NO_MEMORY) ? result : C_ERR_INVALID;
+        }
+    }
+
+    return ((unsigned long long)ec->size == header->entry_count) ? C_ERR_OK : C_ERR_INVALID;
+}
+
+/* ---- snapshot_open ---------------------------------------------------------
+   Purpose: Replace the contents of the collections with a snapshot. The file
+            is mapped read-only and the series use its columns in place; the
+            mapping belongs to ec and is released by entries_clear. The
+            snapshot is opened and checked into new collections first, which
+            take the place of the old ones only once it has loaded.
+   Params:
+     - path (in): snapshot file written by snapshot_save
+     - rc (in/out): room collection to replace
+     - ec (in/out): entry collection to replace
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID if the file is not a
+            usable snapshot, C_ERR_NO_MEMORY, C_ERR_IO (on any error the
+            collections are unchanged)
+----------------------------------------------------------------------------- */
+int snapshot_open(const char *path, RoomCollection *rc, EntryCollection *ec) {
+    // The snapshot's contents, until they replace rc and ec
+    RoomCollection  rooms   = { .size = 0 };
+    EntryCollection entries = { .size = 0 };
+    int result;
+
+    if (path == NULL || rc == NULL || ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    entries.partition_width = ec->partition_width;
+    result = load_snapshot(path, &rooms, &entries);
+    if (result != C_ERR_OK) {
+        entries_clear(&entries);
+        rooms_clear(&rooms);
+        return result;
+    }
+
+    // Entries point at rooms, so drop them first
+    entries_clear(ec);
+    rooms_clear(rc);
+    *rc = rooms;
+    *ec = entries;
+    return C_ERR_OK;
+}
+
+/* ---- load_snapshot ---------------------------------------------------------
+   Purpose: Map a snapshot file and check its header and tables, filling
+            empty collections with its contents (see snapshot_open).
+   Params:
+     - path (in): snapshot file
+     - rc (in/out): empty room collection to fill
+     - ec (in/out): empty entry collection to fill; owns the mapping once
+                    it is made, even if loading fails
+   Returns: C_ERR_OK, C_ERR_INVALID, C_ERR_NO_MEMORY, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int load_snapshot(const char *path, RoomCollection *rc, EntryCollection *ec) {
+    const SnapshotHeader *header;
+    struct stat info;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return C_ERR_IO;
+    }
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return C_ERR_IO;
+    }
+    if ((size_t)info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return C_ERR_INVALID;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return C_ERR_IO;
+    }
+    ec->mapping = base;
+    ec->mapping_size = (size_t)info.st_size;
+
+    header = base;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        header->file_size != (unsigned long long)info.st_size ||
+        !column_in_file(header->rooms_offset, (unsigned long long)header->room_count * sizeof(SnapshotRoom),
+                        SNAPSHOT_ALIGN, header->file_size) ||
+        !column_in_file(header->series_offset,
+                        (unsigned long long)header->series_count * sizeof(SnapshotSeries),
+                        SNAPSHOT_ALIGN, header->file_size)) {
+        return C_ERR_INVALID;
+    }
+
+    return map_contents(base, header, rc, ec);
+}
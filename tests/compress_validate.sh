@@ -0,0 +1,41 @@
+#!/bin/sh
+# Compression releases the entries of the readings it seals: 1024 sealed
+# temperatures next to 8200 decibel readings kept open by their rolling
+# statistics, all in one time partition, so the repacked chunks are no
+# fewer than before. The validator must then find every slot in use
+# referenced. Run from the repository root:
+#     sh tests/compress_validate.sh
+set -e
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+gcc -Wall main.c manager.c wal.c snapshot.c csv.c script.c loader.o -o "$dir/a2"
+
+{
+    echo "add-room A"
+    echo "add-room B"
+    echo "rolling B,DB,100"
+    i=0
+    while [ $i -lt 1024 ]; do
+        echo "add-entry A,$i,TEMP,$i"
+        i=$((i + 1))
+    done
+    i=0
+    while [ $i -lt 8200 ]; do
+        echo "add-entry B,$((i / 3)),DB,$((i % 90))"
+        i=$((i + 1))
+    done
+    echo "compress"
+    echo "validate"
+} > "$dir/test.txt"
+
+"$dir/a2" --script "$dir/test.txt" "$dir/test.wal" > "$dir/out.txt" 2>&1 || true
+
+if grep -q '^sealed,1024$' "$dir/out.txt" && grep -q '^validate,ok$' "$dir/out.txt"; then
+    echo "compress_validate: PASSED"
+else
+    echo "compress_validate: FAILED"
+    cat "$dir/out.txt"
+    exit 1
+fi
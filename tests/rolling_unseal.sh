@@ -0,0 +1,46 @@
+#!/bin/sh
+# Rolling statistics across an unseal: compress 1100 temperatures, turn on
+# a 50-wide window, then insert a reading older than the sealed ones, which
+# decodes them back into the columns. The window must still be the newest
+# 50 readings, before and after the next append. Run from the repository
+# root:
+#     sh tests/rolling_unseal.sh
+set -e
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+gcc -Wall main.c manager.c wal.c snapshot.c csv.c script.c loader.o -o "$dir/a2"
+
+{
+    echo "add-room A"
+    i=0
+    while [ $i -lt 1100 ]; do
+        echo "add-entry A,$i,TEMP,$i"
+        i=$((i + 1))
+    done
+    echo "compress"
+    echo "rolling A,TEMP,50"
+    echo "add-entry A,10,TEMP,10"
+    echo "rolling A,TEMP"
+    echo "add-entry A,1100,TEMP,1100"
+    echo "rolling A,TEMP"
+    echo "validate"
+} > "$dir/test.txt"
+
+"$dir/a2" --script "$dir/test.txt" "$dir/test.wal" > "$dir/out.txt"
+grep '^A,TEMP,' "$dir/out.txt" > "$dir/rolling.txt"
+
+cat > "$dir/expected.txt" <<EOF
+A,TEMP,1050,50,1050,1099,1074.5,53725
+A,TEMP,1050,50,1050,1099,1074.5,53725
+A,TEMP,1051,50,1051,1100,1075.5,53775
+EOF
+
+if cmp -s "$dir/rolling.txt" "$dir/expected.txt" && grep -q '^validate,ok$' "$dir/out.txt"; then
+    echo "rolling_unseal: PASSED"
+else
+    echo "rolling_unseal: FAILED"
+    cat "$dir/out.txt"
+    exit 1
+fi
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Crash test for the write-ahead log: add a room and an entry from the menu,
+# leave the program idle at the next prompt, kill it with SIGKILL and check
+# that a new session replays both. Run from the repository root:
+#     sh tests/wal_idle_kill.sh
+set -e
+
+dir=$(mktemp -d)
+trap 'kill -9 "$pid" 2>/dev/null || true; rm -rf "$dir"' EXIT
+
+gcc -Wall main.c manager.c wal.c snapshot.c csv.c script.c loader.o -o "$dir/a2"
+mkfifo "$dir/input"
+
+# Keep the fifo open so the program blocks at the menu instead of seeing EOF
+"$dir/a2" "$dir/test.wal" < "$dir/input" > "$dir/first.txt" &
+pid=$!
+exec 3> "$dir/input"
+printf '4\nKitchen\n5\nKitchen\n100\n1\n21.5\n' >&3
+
+# Longer than the group commit window (WAL_GROUP_MS)
+sleep 1.5
+kill -9 "$pid"
+wait "$pid" 2>/dev/null || true
+exec 3>&-
+
+printf '0\n' | "$dir/a2" "$dir/test.wal" > "$dir/second.txt"
+if grep -q "Restored 2 record(s)" "$dir/second.txt"; then
+    echo "wal_idle_kill: PASSED"
+else
+    echo "wal_idle_kill: FAILED"
+    cat "$dir/second.txt"
+    exit 1
+fi
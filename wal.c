@@ -0,0 +1,697 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "defs.h"
+
+#define WAL_MAGIC         "SWAL"
+#define WAL_VERSION       1
+#define WAL_HEADER_SIZE   8      /* magic + 32-bit version */
+#define WAL_CHECKSUM_SIZE 4
+#define WAL_ENTRY_PAYLOAD 13     /* room seq, type, timestamp, value */
+
+// Helper function declarations
+static double now_ms(void);
+static void put_u32(unsigned char *out, unsigned int v);
+static unsigned int get_u32(const unsigned char *in);
+static unsigned int record_checksum(const unsigned char *record, int length);
+static unsigned int encode_value(int type, ReadingValue value);
+static ReadingValue decode_value(int type, unsigned int bits);
+static int write_all(int fd, const unsigned char *data, size_t length);
+static int wal_flush(WriteAheadLog *wal);
+static int wal_append(WriteAheadLog *wal, int kind, const unsigned char *payload, int length);
+static int wal_log_room(WriteAheadLog *wal, const Room *room);
+static int wal_log_entry(WriteAheadLog *wal, const Room *room, int type, int timestamp,
+                         ReadingValue value);
+static int apply_record(const unsigned char *record, int length,
+                        RoomCollection *rc, EntryCollection *ec);
+static int record_length(const unsigned char *data, int available);
+static int write_header(int fd);
+
+/* ---- now_ms ----------------------------------------------------------------
+   Purpose: Read a monotonic clock for the group commit timer.
+   Returns: milliseconds as a double
+----------------------------------------------------------------------------- */
+static double now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* ---- put_u32 / get_u32 -----------------------------------------------------
+   Purpose: Store and load a 32-bit value in little-endian byte order, so the
+            log reads the same on any machine.
+----------------------------------------------------------------------------- */
+static void put_u32(unsigned char *out, unsigned int v) {
+    out[0] = (unsigned char)(v & 0xff);
+    out[1] = (unsigned char)((v >> 8) & 0xff);
+    out[2] = (unsigned char)((v >> 16) & 0xff);
+    out[3] = (unsigned char)((v >> 24) & 0xff);
+}
+
+static unsigned int get_u32(const unsigned char *in) {
+    return (unsigned int)in[0] | ((unsigned int)in[1] << 8) |
+           ((unsigned int)in[2] << 16) | ((unsigned int)in[3] << 24);
+}
+
+/* ---- record_checksum -------------------------------------------------------
+   Purpose: FNV-1a over a record's kind byte and payload. A torn or damaged
+            record at the end of the log fails this check and is dropped.
+   Params:
+     - record (in): kind byte followed by the payload
+     - length (in): number of bytes to hash
+   Returns: 32-bit checksum
+----------------------------------------------------------------------------- */
+static unsigned int record_checksum(const unsigned char *record, int length) {
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= record[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* ---- encode_value / decode_value -------------------------------------------
+   Purpose: Pack the union member used by a type into 32 bits and back: the
+            float's bit pattern, the int, or the three motion flags.
+----------------------------------------------------------------------------- */
+static unsigned int encode_value(int type, ReadingValue value) {
+    unsigned int bits = 0;
+
+    if (type == TYPE_TEMP) {
+        memcpy(&bits, &value.temperature, sizeof(bits));
+    }
+    else if (type == TYPE_DB) {
+        bits = (unsigned int)value.decibels;
+    }
+    else {
+        bits = (unsigned int)value.motion[0] | ((unsigned int)value.motion[1] << 8) |
+               ((unsigned int)value.motion[2] << 16);
+    }
+    return bits;
+}
+
+static ReadingValue decode_value(int type, unsigned int bits) {
+    ReadingValue value;
+
+    memset(&value, 0, sizeof(value));
+    if (type == TYPE_TEMP) {
+        memcpy(&value.temperature, &bits, sizeof(bits));
+    }
+    else if (type == TYPE_DB) {
+        value.decibels = (int)bits;
+    }
+    else {
+        value.motion[0] = (unsigned char)(bits & 0xff);
+        value.motion[1] = (unsigned char)((bits >> 8) & 0xff);
+        value.motion[2] = (unsigned char)((bits >> 16) & 0xff);
+    }
+    return value;
+}
+
+/* ---- write_all ---------------------------------------------------------------
+   Purpose: Write a whole buffer, retrying short writes and interruptions.
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return C_ERR_IO;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return C_ERR_OK;
+}
+
+/* ---- wal_flush -----------------------------------------------------------------
+   Purpose: Hand the buffered records to the operating system (no fsync).
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int wal_flush(WriteAheadLog *wal) {
+    int result = write_all(wal->fd, wal->buffer, (size_t)wal->used);
+
+    wal->used = 0;
+    return result;
+}
+
+/* ---- wal_append ----------------------------------------------------------------
+   Purpose: Buffer one record and commit the group if it is now large or old
+            enough.
+   Params:
+     - wal (in/out): open log
+     - kind (in): WAL_RECORD_*
+     - payload (in): record payload
+     - length (in): payload length, at most 1 + MAX_PATH_STR
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int wal_append(WriteAheadLog *wal, int kind, const unsigned char *payload, int length) {
+    unsigned char *record;
+
+    if (wal->used + 1 + length + WAL_CHECKSUM_SIZE > WAL_BUFFER_SIZE &&
+        wal_flush(wal) != C_ERR_OK) {
+        return C_ERR_IO;
+    }
+
+    record = &wal->buffer[wal->used];
+    record[0] = (unsigned char)kind;
+    if (length > 0) {
+        memcpy(record + 1, payload, (size_t)length);
+    }
+    put_u32(record + 1 + length, record_checksum(record, 1 + length));
+    wal->used += 1 + length + WAL_CHECKSUM_SIZE;
+
+    wal->records++;
+    if (wal->pending == 0) {
+        wal->pending_since = now_ms();
+    }
+    wal->pending++;
+
+    if (wal->pending >= wal->group_records || now_ms() - wal->pending_since >= wal->group_ms) {
+        return wal_commit(wal);
+    }
+    return C_ERR_OK;
+}
+
+/* ---- wal_log_room / wal_log_entry -------------------------------------------
+   Purpose: Encode and append a room or entry record.
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int wal_log_room(WriteAheadLog *wal, const Room *room) {
+    unsigned char payload[1 + MAX_STR];
+    int length = (int)strlen(room->name);
+
+    payload[0] = (unsigned char)length;
+    memcpy(payload + 1, room->name, (size_t)length);
+    return wal_append(wal, WAL_RECORD_ROOM, payload, 1 + length);
+}
+
+static int wal_log_entry(WriteAheadLog *wal, const Room *room, int type, int timestamp,
+                         ReadingValue value) {
+    unsigned char payload[WAL_ENTRY_PAYLOAD];
+
+    put_u32(payload, (unsigned int)room->seq);
+    payload[4] = (unsigned char)type;
+    put_u32(payload + 5, (unsigned int)timestamp);
+    put_u32(payload + 9, encode_value(type, value));
+    return wal_append(wal, WAL_RECORD_ENTRY, payload, WAL_ENTRY_PAYLOAD);
+}
+
+/* ---- write_header --------------------------------------------------------------
+   Purpose: Write the header of a new, empty log file and sync it.
+   Returns: C_ERR_OK, C_ERR_IO
+----------------------------------------------------------------------------- */
+static int write_header(int fd) {
+    unsigned char header[WAL_HEADER_SIZE];
+
+    memcpy(header, WAL_MAGIC, 4);
+    put_u32(header + 4, WAL_VERSION);
+    if (write_all(fd, header, WAL_HEADER_SIZE) != C_ERR_OK || fsync(fd) != 0) {
+        return C_ERR_IO;
+    }
+    return C_ERR_OK;
+}
+
+/* ---- wal_open ------------------------------------------------------------------
+   Purpose: Open (or create) a log file and check its header. New records are
+            appended after the existing ones; call wal_replay first to load
+            them and to cut off a damaged tail.
+   Params:
+     - wal (out): log to initialise
+     - path (in): file name, shorter than MAX_PATH_STR
+     - group_records (in): commit after this many records, >= 1
+     - group_ms (in): commit once the oldest pending record is this old, >= 0
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for bad settings or a
+            file that is not a log, C_ERR_IO
+----------------------------------------------------------------------------- */
+int wal_open(WriteAheadLog *wal, const char *path, int group_records, int group_ms) {
+    unsigned char header[WAL_HEADER_SIZE];
+    off_t size;
+
+    if (wal == NULL || path == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (group_records < 1 || group_ms < 0 || strlen(path) >= MAX_PATH_STR) {
+        return C_ERR_INVALID;
+    }
+
+    memset(wal, 0, sizeof(*wal));
+    strcpy(wal->path, path);
+    wal->group_records = group_records;
+    wal->group_ms = group_ms;
+    wal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (wal->fd < 0) {
+        return C_ERR_IO;
+    }
+
+    size = lseek(wal->fd, 0, SEEK_END);
+    if (size == 0) {
+        // A new log starts with its header
+        if (write_header(wal->fd) != C_ERR_OK) {
+            wal_close(wal);
+            return C_ERR_IO;
+        }
+        return C_ERR_OK;
+    }
+
+    if (size < WAL_HEADER_SIZE || pread(wal->fd, header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE ||
+        memcmp(header, WAL_MAGIC, 4) != 0 || get_u32(header + 4) != WAL_VERSION) {
+        close(wal->fd);
+        wal->fd = -1;
+        return C_ERR_INVALID;
+    }
+
+    return C_ERR_OK;
+}
+
+/* ---- record_length -------------------------------------------------------------
+   Purpose: Work out the full length of the record starting at data.
+   Params:
+     - data (in): start of the record
+     - available (in): bytes available from data on
+   Returns: record length including the checksum, 0 if more bytes are needed
+            to tell, -1 for an unknown kind
+----------------------------------------------------------------------------- */
+static int record_length(const unsigned char *data, int available) {
+    if (available < 1) {
+        return 0;
+    }
+
+    if (data[0] == WAL_RECORD_ENTRY) {
+        return 1 + WAL_ENTRY_PAYLOAD + WAL_CHECKSUM_SIZE;
+    }
+    if (data[0] == WAL_RECORD_CLEAR) {
+        return 1 + WAL_CHECKSUM_SIZE;
+    }
+    if (data[0] == WAL_RECORD_RETENTION) {
+        return 1 + 4 + WAL_CHECKSUM_SIZE;
+    }
+    if (data[0] == WAL_RECORD_ROOM || data[0] == WAL_RECORD_SNAPSHOT) {
+        if (available < 2) {
+            return 0;
+        }
+        if (data[1] == 0 || (data[0] == WAL_RECORD_ROOM && data[1] >= MAX_STR)) {
+            return -1;
+        }
+        return 2 + data[1] + WAL_CHECKSUM_SIZE;
+    }
+    return -1;
+}
+
+/* ---- apply_record --------------------------------------------------------------
+   Purpose: Check one complete record and apply it to the collections.
+   Params:
+     - record (in): the record, checksum included
+     - length (in): its length from record_length
+     - rc, ec (in/out): collections being rebuilt
+   Returns: C_ERR_OK, C_ERR_INVALID for a damaged or inconsistent record,
+            C_ERR_NO_MEMORY, C_ERR_IO if a checkpoint's snapshot cannot be
+            opened
+----------------------------------------------------------------------------- */
+static int apply_record(const unsigned char *record, int length,
+                        RoomCollection *rc, EntryCollection *ec) {
+    char name[MAX_PATH_STR];
+    unsigned int seq;
+    int type, result;
+
+    if (get_u32(record + length - WAL_CHECKSUM_SIZE) !=
+        record_checksum(record, length - WAL_CHECKSUM_SIZE)) {
+        return C_ERR_INVALID;
+    }
+
+    if (record[0] == WAL_RECORD_CLEAR) {
+        entries_clear(ec);
+        rooms_clear(rc);
+        return C_ERR_OK;
+    }
+
+    if (record[0] == WAL_RECORD_RETENTION) {
+        result = retention_drop_before(ec, (int)get_u32(record + 1));
+        return (result < 0) ? result : C_ERR_OK;
+    }
+
+    if (record[0] == WAL_RECORD_SNAPSHOT) {
+        memset(name, 0, sizeof(name));
+        memcpy(name, record + 2, record[1]);
+        result = snapshot_open(name, rc, ec);
+        if (result == C_ERR_OK || result == C_ERR_NO_MEMORY) {
+            return result;
+        }
+        return C_ERR_IO;
+    }
+
+    if (record[0] == WAL_RECORD_ROOM) {
+        memset(name, 0, sizeof(name));
+        memcpy(name, record + 2, record[1]);
+        result = rooms_add(rc, name);
+        return (result == C_ERR_DUPLICATE) ? C_ERR_INVALID : result;
+    }
+
+    seq = get_u32(record + 1);
+    type = record[5];
+    if (seq >= (unsigned int)rc->size) {
+        return C_ERR_INVALID;
+    }
+    return entries_create(ec, rc->rooms[seq], type, decode_value(type, get_u32(record + 10)),
+                          (int)get_u32(record + 6));
+}
+
+/* ---- wal_replay ----------------------------------------------------------------
+   Purpose: Rebuild the collections from the log. Replay stops at the first
+            incomplete or damaged record (the tail of an interrupted commit);
+            the file is cut back to the last good record so new records follow
+            it directly.
+   Params:
+     - wal (in/out): log opened with wal_open, nothing appended yet
+     - rc (in/out): room collection to add to (normally empty)
+     - ec (in/out): entry collection to add to (normally empty)
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_NO_MEMORY, C_ERR_IO (also when a
+            checkpoint's snapshot cannot be opened)
+----------------------------------------------------------------------------- */
+int wal_replay(WriteAheadLog *wal, RoomCollection *rc, EntryCollection *ec) {
+    // Read buffer (records may straddle reads) and the parse position in it
+    unsigned char *data;
+    int filled = 0;
+    int pos = 0;
+    int length;
+    int result = C_ERR_OK;
+    int at_end = 0;
+    ssize_t got;
+    // File offset of the end of the last good record
+    off_t good = WAL_HEADER_SIZE;
+
+    if (wal == NULL || rc == NULL || ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    data = wal->buffer;
+    if (lseek(wal->fd, WAL_HEADER_SIZE, SEEK_SET) < 0) {
+        return C_ERR_IO;
+    }
+
+    while (result == C_ERR_OK) {
+        length = record_length(data + pos, filled - pos);
+        if (length > 0 && filled - pos >= length) {
+            result = apply_record(data + pos, length, rc, ec);
+            if (result == C_ERR_OK) {
+                pos += length;
+                good += length;
+                wal->replayed++;
+            }
+            continue;
+        }
+        if (length < 0 || at_end) {
+            break;
+        }
+
+        // Keep the partial record and read more behind it
+        memmove(data, data + pos, (size_t)(filled - pos));
+        filled -= pos;
+        pos = 0;
+        got = read(wal->fd, data + filled, WAL_BUFFER_SIZE - (size_t)filled);
+        if (got < 0 && errno != EINTR) {
+            return C_ERR_IO;
+        }
+        if (got == 0) {
+            at_end = 1;
+        }
+        if (got > 0) {
+            filled += (int)got;
+        }
+    }
+
+    // A checkpoint whose snapshot is missing is not a torn tail: keep the log
+    if (result == C_ERR_NO_MEMORY || result == C_ERR_IO) {
+        return result;
+    }
+
+    // Drop whatever follows the last good record and append from there
+    wal->used = 0;
+    if (ftruncate(wal->fd, good) != 0 || lseek(wal->fd, good, SEEK_SET) < 0) {
+        return C_ERR_IO;
+    }
+    return C_ERR_OK;
+}
+
+/* ---- wal_rooms_add -------------------------------------------------------------
+   Purpose: rooms_add, then log the new room.
+   Params:
+     - wal (in/out): open log, or NULL to only add the room
+     - rc, room_name: as for rooms_add
+   Returns: as rooms_add, or C_ERR_IO if the room was added but could not be
+            logged
+----------------------------------------------------------------------------- */
+int wal_rooms_add(WriteAheadLog *wal, RoomCollection *rc, const char *room_name) {
+    int result = rooms_add(rc, room_name);
+
+    if (result != C_ERR_OK || wal == NULL) {
+        return result;
+    }
+    return wal_log_room(wal, rc->rooms[rc->size - 1]);
+}
+
+/* ---- wal_entries_create --------------------------------------------------------
+   Purpose: entries_create, then log the new entry.
+   Params:
+     - wal (in/out): open log, or NULL to only create the entry
+     - ec, room, type, value, timestamp: as for entries_create
+   Returns: as entries_create, or C_ERR_IO if the entry was created but could
+            not be logged
+----------------------------------------------------------------------------- */
+int wal_entries_create(WriteAheadLog *wal, EntryCollection *ec, Room *room,
+                       int type, ReadingValue value, int timestamp) {
+    int result = entries_create(ec, room, type, value, timestamp);
+
+    if (result != C_ERR_OK || wal == NULL) {
+        return result;
+    }
+
+    return wal_log_entry(wal, room, type, timestamp, value);
+}
+
+/* ---- wal_entries_create_batch -------------------------------------------------
+   Purpose: entries_create_batch, then log each new entry. Replaying the
+            records one at a time gives the same order as the batch insert.
+   Params:
+     - wal (in/out): open log, or NULL to only insert the batch
+     - ec, rc, readings, count: as for entries_create_batch
+   Returns: as entries_create_batch, or C_ERR_IO if the entries were created
+            but could not all be logged
+----------------------------------------------------------------------------- */
+int wal_entries_create_batch(WriteAheadLog *wal, EntryCollection *ec, RoomCollection *rc,
+                             const SensorReading *readings, int count) {
+    int i;
+    int result = entries_create_batch(ec, rc, readings, count);
+
+    for (i = 0; i < count && result == C_ERR_OK && wal != NULL; i++) {
+        result = wal_log_entry(wal, rooms_find(rc, readings[i].room_name), readings[i].data.type,
+                               readings[i].timestamp, readings[i].data.value);
+    }
+    return result;
+}
+
+/* ---- wal_retention_drop_before ------------------------------------------------
+   Purpose: retention_drop_before, then log it so replay drops the same
+            readings.
+   Params:
+     - wal (in/out): open log, or NULL to only drop the readings
+     - ec, timestamp: as for retention_drop_before
+   Returns: as retention_drop_before, or C_ERR_IO if the readings were
+            dropped but the drop could not be logged
+----------------------------------------------------------------------------- */
+int wal_retention_drop_before(WriteAheadLog *wal, EntryCollection *ec, int timestamp) {
+    unsigned char payload[4];
+    int dropped = retention_drop_before(ec, timestamp);
+    int result;
+
+    if (dropped < 0 || wal == NULL) {
+        return dropped;
+    }
+
+    put_u32(payload, (unsigned int)timestamp);
+    result = wal_append(wal, WAL_RECORD_RETENTION, payload, 4);
+    return (result == C_ERR_OK) ? dropped : result;
+}
+
+/* ---- wal_log_snapshot ----------------------------------------------------------
+   Purpose: Log the complete current contents of both collections, after a
+            clear record, and commit. Used when the collections were replaced
+            wholesale (e.g. by loading the sample data).
+   Params:
+     - wal (in/out): open log
+     - rc (in): rooms to log, in the order they were added
+     - ec (in): entries to log
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int wal_log_snapshot(WriteAheadLog *wal, const RoomCollection *rc, const EntryCollection *ec) {
+    EntryCursor cursor;
+    const LogEntry *entry;
+    int i;
+    int result;
+
+    if (wal == NULL || rc == NULL || ec == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    result = wal_append(wal, WAL_RECORD_CLEAR, NULL, 0);
+    for (i = 0; i < rc->size && result == C_ERR_OK; i++) {
+        result = wal_log_room(wal, rc->rooms[i]);
+    }
+
+    entries_cursor_init(&cursor, ec);
+    while (result == C_ERR_OK && (entry = entries_cursor_next(&cursor)) != NULL) {
+        result = wal_log_entry(wal, entry_room(rc, entry), entry->type, entry->timestamp,
+                               entry->value);
+    }
+
+    return (result == C_ERR_OK) ? wal_commit(wal) : result;
+}
+
+/* ---- wal_checkpoint ------------------------------------------------------------
+   Purpose: Start a new log that holds only a reference to a snapshot of the
+            current contents, so replay opens the snapshot instead of
+            re-applying every record. The new log is written under a
+            temporary name and renamed over the old one; a crash keeps one or
+            the other.
+   Params:
+     - wal (in/out): open log
+     - snapshot_path (in): snapshot holding everything logged so far
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_INVALID for an empty or too long
+            path, C_ERR_IO (the old log is then still in use)
+----------------------------------------------------------------------------- */
+int wal_checkpoint(WriteAheadLog *wal, const char *snapshot_path) {
+    char temp_path[MAX_PATH_STR + 4];
+    unsigned char payload[1 + MAX_PATH_STR];
+    int length;
+    int fd;
+    int old_fd;
+    int result;
+
+    if (wal == NULL || snapshot_path == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    length = (int)strlen(snapshot_path);
+    if (length == 0 || length > 255) {
+        return C_ERR_INVALID;
+    }
+
+    // Anything pending is covered by the snapshot, but keep the old log whole
+    // until the new one is in place
+    if (wal_commit(wal) != C_ERR_OK) {
+        return C_ERR_IO;
+    }
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", wal->path);
+    fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return C_ERR_IO;
+    }
+    if (write_header(fd) != C_ERR_OK) {
+        close(fd);
+        remove(temp_path);
+        return C_ERR_IO;
+    }
+
+    // Append the reference through the normal path on the new file
+    old_fd = wal->fd;
+    wal->fd = fd;
+    payload[0] = (unsigned char)length;
+    memcpy(payload + 1, snapshot_path, (size_t)length);
+    result = wal_append(wal, WAL_RECORD_SNAPSHOT, payload, 1 + length);
+    if (result == C_ERR_OK) {
+        result = wal_commit(wal);
+    }
+    if (result == C_ERR_OK && rename(temp_path, wal->path) != 0) {
+        result = C_ERR_IO;
+    }
+
+    if (result != C_ERR_OK) {
+        wal->fd = old_fd;
+        wal->used = 0;
+        wal->pending = 0;
+        close(fd);
+        remove(temp_path);
+        return result;
+    }
+
+    close(old_fd);
+    return C_ERR_OK;
+}
+
+/* ---- wal_poll ------------------------------------------------------------------
+   Purpose: Commit pending records whose time is up. Records only trigger the
+            timer when they are appended, so an idle caller should poll.
+   Params:
+     - wal (in/out): open log
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int wal_poll(WriteAheadLog *wal) {
+    if (wal == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (wal->pending > 0 && now_ms() - wal->pending_since >= wal->group_ms) {
+        return wal_commit(wal);
+    }
+    return C_ERR_OK;
+}
+
+/* ---- wal_commit ----------------------------------------------------------------
+   Purpose: Write out and fsync every pending record.
+   Params:
+     - wal (in/out): open log
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int wal_commit(WriteAheadLog *wal) {
+    if (wal == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (wal->pending == 0 && wal->used == 0) {
+        return C_ERR_OK;
+    }
+
+    if (wal_flush(wal) != C_ERR_OK || fsync(wal->fd) != 0) {
+        return C_ERR_IO;
+    }
+
+    wal->pending = 0;
+    wal->commits++;
+    return C_ERR_OK;
+}
+
+/* ---- wal_close -----------------------------------------------------------------
+   Purpose: Commit anything pending and close the log file.
+   Params:
+     - wal (in/out): log to close
+   Returns: C_ERR_OK, C_ERR_NULL_PTR, C_ERR_IO
+----------------------------------------------------------------------------- */
+int wal_close(WriteAheadLog *wal) {
+    int result;
+
+    if (wal == NULL) {
+        return C_ERR_NULL_PTR;
+    }
+
+    if (wal->fd < 0) {
+        return C_ERR_OK;
+    }
+
+    result = wal_commit(wal);
+    if (close(wal->fd) != 0) {
+        result = C_ERR_IO;
+    }
+    wal->fd = -1;
+    return result;
+}